@@ -0,0 +1,76 @@
+#!/bin/sh
+# Benchmark andi end-to-end on synthetic collections of genomes.
+#
+# Usage: scripts/bench-collections.sh [GENOMES:LENGTH...]
+#
+# For each scale, a collection with a phylogeny, indels, rearrangements,
+# repeats, plasmids and varying genome sizes is generated by test/test_fasta.
+# Then andi compares the genomes in join mode. One JSON object per scale is
+# appended to $OUTPUT. The following variables can be set:
+#   ANDI        the binary to benchmark; default: ./src/andi
+#   ANDI_FLAGS  additional flags for andi, e.g. --low-memory
+#   TEST_FASTA  the generator; default: ./test/test_fasta
+#   WORK        the directory for the collections; default: a temporary one
+#   OUTPUT      the results; default: collections.jsonl
+#   SEED        the seed of the collections; default: 1729
+#   KEEP        set to keep the collections
+
+ANDI=${ANDI:-./src/andi}
+TEST_FASTA=${TEST_FASTA:-./test/test_fasta}
+OUTPUT=${OUTPUT:-collections.jsonl}
+SEED=${SEED:-1729}
+
+if [ -z "$WORK" ]; then
+	WORK=$(mktemp -d) || exit 1
+	# Also clean up when a scale fails; kept collections stay.
+	if [ -z "$KEEP" ]; then
+		trap 'rm -rf "$WORK"' EXIT
+	fi
+fi
+
+if [ $# -eq 0 ]; then
+	set -- 20:100000 100:1000000 500:2000000
+fi
+
+now() {
+	date +%s.%N
+}
+
+for SCALE in "$@"; do
+	GENOMES=${SCALE%%:*}
+	LENGTH=${SCALE##*:}
+	DIR="$WORK/$GENOMES-$LENGTH"
+	mkdir -p "$DIR/genomes" || exit 1
+
+	START=$(now)
+	"$TEST_FASTA" --genomes="$GENOMES" -l "$LENGTH" -s "$SEED" --plasmids=4 \
+		--out="$DIR/genomes" --tree="$DIR/tree.nwk" || exit 1
+	GENERATED=$(now)
+
+	find "$DIR/genomes" -name '*.fasta' | sort > "$DIR/files.txt"
+	# Warnings about low homology make andi fail softly; only a missing
+	# result is an error.
+	# shellcheck disable=SC2086
+	"$ANDI" -j $ANDI_FLAGS --file-of-filenames="$DIR/files.txt" \
+		--stats="$DIR/stats.json" > "$DIR/distances.txt" 2> "$DIR/andi.log"
+	DONE=$(now)
+	if [ ! -s "$DIR/stats.json" ]; then
+		cat "$DIR/andi.log" >&2
+		exit 1
+	fi
+
+	# Pick single values from the statistics.
+	WALL=$(grep -m1 '"wall":' "$DIR/stats.json" | tr -dc '0-9.')
+	RSS=$(grep -m1 '"peak_rss":' "$DIR/stats.json" | tr -dc '0-9')
+	THREADS=$(grep -m1 '"threads":' "$DIR/stats.json" | tr -dc '0-9')
+	MODE=$(grep -m1 '"mode":' "$DIR/stats.json" | cut -d'"' -f4)
+
+	printf '{"genomes": %s, "length": %s, "mode": "%s", "threads": %s, "generate": %s, "wall": %s, "total": %s, "peak_rss": %s}\n' \
+		"$GENOMES" "$LENGTH" "$MODE" "$THREADS" \
+		"$(awk "BEGIN {print $GENERATED - $START}")" "$WALL" \
+		"$(awk "BEGIN {print $DONE - $GENERATED}")" "$RSS" | tee -a "$OUTPUT"
+
+	if [ -z "$KEEP" ]; then
+		rm -rf "$DIR"
+	fi
+done
@@ -0,0 +1,168 @@
+#!/bin/sh
+# Measure how andi scales with the number of threads and catch regressions.
+#
+# Usage: scripts/bench-scaling.sh [BASELINE]
+#
+# A fixed collection of genomes is generated by test/test_fasta. Then andi
+# compares it with 1, 2, 4, ... and finally $MAX_THREADS threads, both in the
+# default mode and with --low-memory. For every run the wall time, speedup,
+# parallel efficiency and peak RSS are written to $OUTPUT as JSON, one run per
+# line. If a BASELINE from an earlier invocation is given, every run is
+# compared against it and the script fails on a regression. The following
+# variables can be set:
+#   ANDI            the binary to measure; default: ./src/andi
+#   TEST_FASTA      the generator; default: ./test/test_fasta
+#   MAX_THREADS     the largest number of threads; default: all processors
+#   GENOMES         the number of genomes; default: 32
+#   LENGTH          the length of the genomes; default: 200000
+#   SEED            the seed of the collection; default: 1729
+#   REPS            the repetitions of each run; the fastest counts; default: 3
+#   OUTPUT          the results; default: scaling.json
+#   WALL_TOLERANCE  the allowed relative slowdown; default: 0.2
+#   RSS_TOLERANCE   the allowed relative growth of the peak RSS; default: 0.1
+#   EFFICIENCY_TOLERANCE  the allowed drop of the efficiency; default: 0.1
+
+ANDI=${ANDI:-./src/andi}
+TEST_FASTA=${TEST_FASTA:-./test/test_fasta}
+GENOMES=${GENOMES:-32}
+LENGTH=${LENGTH:-200000}
+SEED=${SEED:-1729}
+REPS=${REPS:-3}
+OUTPUT=${OUTPUT:-scaling.json}
+WALL_TOLERANCE=${WALL_TOLERANCE:-0.2}
+RSS_TOLERANCE=${RSS_TOLERANCE:-0.1}
+EFFICIENCY_TOLERANCE=${EFFICIENCY_TOLERANCE:-0.1}
+BASELINE=$1
+
+if [ -z "$MAX_THREADS" ]; then
+	MAX_THREADS=$(getconf _NPROCESSORS_ONLN 2> /dev/null || echo 1)
+fi
+
+if [ -n "$BASELINE" ] && [ ! -r "$BASELINE" ]; then
+	echo "Cannot read the baseline $BASELINE." >&2
+	exit 1
+fi
+
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+"$TEST_FASTA" --genomes="$GENOMES" -l "$LENGTH" -s "$SEED" \
+	> "$WORK/collection.fasta" || exit 1
+
+THREAD_COUNTS=""
+T=1
+while [ "$T" -lt "$MAX_THREADS" ]; do
+	THREAD_COUNTS="$THREAD_COUNTS $T"
+	T=$((T * 2))
+done
+THREAD_COUNTS="$THREAD_COUNTS $MAX_THREADS"
+
+# Run andi once and print its wall time and peak RSS.
+measure() {
+	# shellcheck disable=SC2086
+	"$ANDI" -t "$1" $2 --stats="$WORK/stats.json" "$WORK/collection.fasta" \
+		> /dev/null 2> "$WORK/andi.log"
+	if [ ! -s "$WORK/stats.json" ]; then
+		cat "$WORK/andi.log" >&2
+		exit 1
+	fi
+
+	WALL=$(grep -m1 '"wall":' "$WORK/stats.json" | tr -dc '0-9.')
+	RSS=$(grep -m1 '"peak_rss":' "$WORK/stats.json" | tr -dc '0-9')
+	echo "$WALL $RSS"
+	rm -f "$WORK/stats.json"
+}
+
+printf '{"version": "%s", "genomes": %s, "length": %s, "seed": %s, "reps": %s, "runs": [' \
+	"$("$ANDI" --version | head -n1 | cut -d' ' -f2)" \
+	"$GENOMES" "$LENGTH" "$SEED" "$REPS" > "$OUTPUT"
+
+SEPARATOR=""
+for MODE in fast low-memory; do
+	FLAGS=""
+	if [ "$MODE" = "low-memory" ]; then
+		FLAGS="--low-memory"
+	fi
+
+	SERIAL=""
+	for T in $THREAD_COUNTS; do
+		BEST=""
+		PEAK=0
+		R=0
+		while [ "$R" -lt "$REPS" ]; do
+			RESULT=$(measure "$T" "$FLAGS") || exit 1
+			# shellcheck disable=SC2086
+			set -- $RESULT
+			if [ -z "$BEST" ] || awk "BEGIN {exit !($1 < $BEST)}"; then
+				BEST=$1
+			fi
+			if [ "$2" -gt "$PEAK" ]; then
+				PEAK=$2
+			fi
+			R=$((R + 1))
+		done
+
+		if [ -z "$SERIAL" ]; then
+			SERIAL=$BEST
+		fi
+
+		printf '%s\n{"mode": "%s", "threads": %s, "wall": %s, "speedup": %s, "efficiency": %s, "peak_rss": %s}' \
+			"$SEPARATOR" "$MODE" "$T" "$BEST" \
+			"$(awk "BEGIN {printf \"%.3f\", $SERIAL / $BEST}")" \
+			"$(awk "BEGIN {printf \"%.3f\", $SERIAL / $BEST / $T}")" \
+			"$PEAK" >> "$OUTPUT"
+		SEPARATOR=","
+	done
+done
+printf '\n]}\n' >> "$OUTPUT"
+
+cat "$OUTPUT"
+
+if [ -z "$BASELINE" ]; then
+	exit 0
+fi
+
+# Every run is on a line of its own; match them by mode and threads.
+awk -v wall_tolerance="$WALL_TOLERANCE" -v rss_tolerance="$RSS_TOLERANCE" \
+	-v efficiency_tolerance="$EFFICIENCY_TOLERANCE" '
+function field(line, name,    rest) {
+	rest = substr(line, index(line, "\"" name "\": ") + length(name) + 4)
+	sub(/[,}].*/, "", rest)
+	gsub(/"/, "", rest)
+	return rest
+}
+!/"mode":/ { next }
+{ key = field($0, "mode") "/" field($0, "threads") }
+FNR == NR {
+	wall[key] = field($0, "wall")
+	rss[key] = field($0, "peak_rss")
+	efficiency[key] = field($0, "efficiency")
+	next
+}
+!(key in wall) {
+	printf "%s: not in the baseline\n", key > "/dev/stderr"
+	next
+}
+{
+	if (field($0, "wall") + 0 > wall[key] * (1 + wall_tolerance)) {
+		printf "%s: wall time %s s, baseline %s s\n", key,
+			field($0, "wall"), wall[key] > "/dev/stderr"
+		failed = 1
+	}
+	if (field($0, "peak_rss") + 0 > rss[key] * (1 + rss_tolerance)) {
+		printf "%s: peak RSS %s bytes, baseline %s bytes\n", key,
+			field($0, "peak_rss"), rss[key] > "/dev/stderr"
+		failed = 1
+	}
+	if (field($0, "efficiency") + 0 < efficiency[key] - efficiency_tolerance) {
+		printf "%s: efficiency %s, baseline %s\n", key,
+			field($0, "efficiency"), efficiency[key] > "/dev/stderr"
+		failed = 1
+	}
+}
+END {
+	if (failed) {
+		print "Performance regressions found." > "/dev/stderr"
+		exit 1
+	}
+}' "$BASELINE" "$OUTPUT"
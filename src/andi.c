@@ -22,12 +22,24 @@
  *
  */
 
+#include "counters.h"
+#include "db.h"
 #include "global.h"
 #include "io.h"
+#include "numa.h"
+#include "pairs.h"
+#include "perf.h"
+#include "plan.h"
 #include "process.h"
+#include "profile.h"
+#include "progress.h"
 #include "sequence.h"
+#include "serve.h"
+#include "stats.h"
+#include "trace.h"
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <gsl/gsl_rng.h>
 #include <limits.h>
@@ -41,14 +53,6 @@
 #include <omp.h>
 #endif
 
-/* Global variables */
-int FLAGS = 0;
-int THREADS = 1;
-long unsigned int BOOTSTRAP = 0;
-double ANCHOR_P_VALUE = 0.025;
-gsl_rng *RNG = NULL;
-int MODEL = M_JC;
-
 void usage(int);
 void version(void);
 
@@ -66,6 +70,24 @@ int main(int argc, char *argv[]) {
 		{"truncate-names", no_argument, NULL, 0},
 		{"file-of-filenames", required_argument, NULL, 0},
 		{"progress", optional_argument, NULL, 0},
+		{"progress-fd", required_argument, NULL, 0},
+		{"stats", required_argument, NULL, 0},
+		{"slow-pairs", required_argument, NULL, 0},
+		{"pair-dump", required_argument, NULL, 0},
+		{"trace", required_argument, NULL, 0},
+		{"perf-counters", no_argument, NULL, 0},
+		{"plan", no_argument, NULL, 0},
+		{"socket", required_argument, NULL, 0},
+		{"db", required_argument, NULL, 0},
+		{"prefilter", optional_argument, NULL, 0},
+		{"min-coverage", required_argument, NULL, 0},
+		{"sample", required_argument, NULL, 0},
+		{"profile", required_argument, NULL, 0},
+		{"window", required_argument, NULL, 0},
+		{"index", required_argument, NULL, 0},
+		{"numa", optional_argument, NULL, 0},
+		{"huge-pages", required_argument, NULL, 0},
+		{"walk", no_argument, NULL, 0},
 		{"help", no_argument, NULL, 'h'},
 		{"verbose", no_argument, NULL, 'v'},
 		{"join", no_argument, NULL, 'j'},
@@ -81,6 +103,49 @@ int main(int argc, char *argv[]) {
 #endif
 
 	enum { P_AUTO, P_NEVER, P_ALWAYS } progress = P_AUTO;
+	int numa_replicate = 0;
+	double p_value = 0.0;
+	int progress_fd = -1;
+	const char *stats_file_name = NULL;
+	const char *pair_dump_file_name = NULL;
+	const char *trace_file_name = NULL;
+	int only_plan = 0;
+	const char *socket_path = NULL;
+	const char *db_path = NULL;
+	const char *profile_file_name = NULL;
+	long unsigned int window = 10000, window_step = 0;
+	long unsigned int slow_pairs = 0;
+
+	// A command may precede all options.
+	enum {
+		C_COMPARE,
+		C_SERVE,
+		C_CLIENT,
+		C_DB_BUILD,
+		C_DB_QUERY
+	} command = C_COMPARE;
+	int command_words = 1;
+	if (argc > 1 && strcmp(argv[1], "serve") == 0) {
+		command = C_SERVE;
+	} else if (argc > 1 && strcmp(argv[1], "client") == 0) {
+		command = C_CLIENT;
+	} else if (argc > 2 && strcmp(argv[1], "db") == 0) {
+		command_words = 2;
+		if (strcmp(argv[2], "build") == 0) {
+			command = C_DB_BUILD;
+		} else if (strcmp(argv[2], "query") == 0) {
+			command = C_DB_QUERY;
+		} else {
+			errx(1, "Unknown command 'db %s'. Expected 'db build' or 'db "
+					"query'.",
+				 argv[2]);
+		}
+	}
+	if (command != C_COMPARE) {
+		argv[command_words] = argv[0];
+		argc -= command_words;
+		argv += command_words;
+	}
 
 	struct string_vector file_names;
 	string_vector_init(&file_names);
@@ -121,6 +186,181 @@ int main(int argc, char *argv[]) {
 							  optarg);
 					}
 				}
+				if (strcasecmp(option_str, "stats") == 0) {
+					stats_file_name = optarg;
+				}
+				if (strcasecmp(option_str, "trace") == 0) {
+					trace_file_name = optarg;
+				}
+				if (strcasecmp(option_str, "perf-counters") == 0) {
+					FLAGS |= F_PERF;
+				}
+				if (strcasecmp(option_str, "plan") == 0) {
+					only_plan = 1;
+				}
+				if (strcasecmp(option_str, "socket") == 0) {
+					socket_path = optarg;
+				}
+				if (strcasecmp(option_str, "db") == 0) {
+					db_path = optarg;
+				}
+				if (strcasecmp(option_str, "walk") == 0) {
+					FLAGS |= F_WALK;
+				}
+				if (strcasecmp(option_str, "prefilter") == 0) {
+					FLAGS |= F_PREFILTER;
+					if (!optarg) break;
+
+					errno = 0;
+					char *end;
+					double threshold = strtod(optarg, &end);
+
+					if (errno || end == optarg || *end != '\0' ||
+						threshold <= 0.0 || threshold >= 1.0) {
+						soft_errx("Expected a containment between 0 and 1, "
+								  "exclusive, for --prefilter, but '%s' was "
+								  "given. Using the default of %g.",
+								  optarg, PREFILTER_THRESHOLD);
+						break;
+					}
+
+					PREFILTER_THRESHOLD = threshold;
+				}
+				if (strcasecmp(option_str, "min-coverage") == 0) {
+					errno = 0;
+					char *end;
+					double coverage = strtod(optarg, &end);
+
+					if (errno || end == optarg || *end != '\0' ||
+						coverage < 0.0 || coverage >= 1.0) {
+						soft_errx("Expected a coverage between 0, inclusive, "
+								  "and 1 for --min-coverage, but '%s' was "
+								  "given. Ignoring argument.",
+								  optarg);
+						break;
+					}
+
+					MIN_COVERAGE = coverage;
+				}
+				if (strcasecmp(option_str, "sample") == 0) {
+					errno = 0;
+					char *end;
+					long unsigned int windows = strtoul(optarg, &end, 10);
+					long unsigned int length = SAMPLE_LENGTH;
+					if (!errno && end != optarg && *end == ',') {
+						const char *length_str = end + 1;
+						length = strtoul(length_str, &end, 10);
+						if (end == length_str) length = 0;
+					}
+
+					if (errno || end == optarg || *end != '\0' ||
+						windows < 2 || length == 0 ||
+						windows > SIZE_MAX / length) {
+						soft_errx("Expected at least two windows and an "
+								  "optional length for --sample, as in "
+								  "'100,10000', but '%s' was given. Ignoring "
+								  "argument.",
+								  optarg);
+						break;
+					}
+
+					SAMPLE_WINDOWS = windows;
+					SAMPLE_LENGTH = length;
+				}
+				if (strcasecmp(option_str, "profile") == 0) {
+					profile_file_name = optarg;
+				}
+				if (strcasecmp(option_str, "window") == 0) {
+					errno = 0;
+					char *end;
+					long unsigned int length = strtoul(optarg, &end, 10);
+					long unsigned int step = length;
+					if (!errno && end != optarg && *end == ',') {
+						const char *step_str = end + 1;
+						step = strtoul(step_str, &end, 10);
+						if (end == step_str) step = 0;
+					}
+
+					if (errno || end == optarg || *end != '\0' || step == 0 ||
+						length < step || length % step != 0) {
+						soft_errx("Expected a window length and an optional "
+								  "step dividing it for --window, as in "
+								  "'10000,1000', but '%s' was given. Ignoring "
+								  "argument.",
+								  optarg);
+						break;
+					}
+
+					window = length;
+					window_step = step;
+				}
+				if (strcasecmp(option_str, "index") == 0) {
+					if (strcasecmp(optarg, "separate") == 0) {
+						FLAGS &= ~(F_GENERALIZED | F_PACKED);
+					} else if (strcasecmp(optarg, "generalized") == 0) {
+						FLAGS &= ~F_PACKED;
+						FLAGS |= F_GENERALIZED;
+					} else if (strcasecmp(optarg, "packed") == 0) {
+						FLAGS &= ~F_GENERALIZED;
+						FLAGS |= F_PACKED;
+					} else {
+						soft_errx("Ignoring argument for --index. Expected "
+								  "'separate', 'generalized' or 'packed'.");
+					}
+				}
+				if (strcasecmp(option_str, "huge-pages") == 0) {
+					if (strcasecmp(optarg, "never") == 0) {
+						mem_set_pages(MEM_PAGES_DEFAULT);
+					} else if (strcasecmp(optarg, "thp") == 0) {
+						mem_set_pages(MEM_PAGES_THP);
+					} else if (strcasecmp(optarg, "hugetlb") == 0) {
+						mem_set_pages(MEM_PAGES_HUGETLB);
+					} else {
+						soft_errx("Ignoring argument for --huge-pages. "
+								  "Expected 'never', 'thp' or 'hugetlb'.");
+					}
+				}
+				if (strcasecmp(option_str, "numa") == 0) {
+					FLAGS |= F_NUMA;
+					if (!optarg || strcasecmp(optarg, "bind") == 0) {
+						numa_replicate = 0;
+					} else if (strcasecmp(optarg, "replicate") == 0) {
+						numa_replicate = 1;
+					} else {
+						soft_errx("Ignoring argument for --numa. Expected "
+								  "'bind' or 'replicate'.");
+					}
+				}
+				if (strcasecmp(option_str, "slow-pairs") == 0) {
+					errno = 0;
+					char *end;
+					slow_pairs = strtoul(optarg, &end, 10);
+
+					if (errno || end == optarg || *end != '\0') {
+						soft_errx("Expected a number for --slow-pairs, but "
+								  "'%s' was given. Ignoring argument.",
+								  optarg);
+						slow_pairs = 0;
+					}
+				}
+				if (strcasecmp(option_str, "pair-dump") == 0) {
+					pair_dump_file_name = optarg;
+				}
+				if (strcasecmp(option_str, "progress-fd") == 0) {
+					errno = 0;
+					char *end;
+					long fd = strtol(optarg, &end, 10);
+
+					if (errno || end == optarg || *end != '\0' || fd < 0 ||
+						fd > INT_MAX || fcntl(fd, F_GETFD) == -1) {
+						soft_errx("Expected an open file descriptor for "
+								  "--progress-fd, but '%s' was given. Ignoring "
+								  "argument.",
+								  optarg);
+					} else {
+						progress_fd = fd;
+					}
+				}
 				break;
 			}
 			case 'h': usage(EXIT_SUCCESS); break;
@@ -148,6 +388,7 @@ int main(int argc, char *argv[]) {
 				}
 
 				ANCHOR_P_VALUE = prop;
+				p_value = prop;
 				break;
 			}
 			case 'l': FLAGS |= F_LOW_MEMORY; break;
@@ -227,12 +468,29 @@ int main(int argc, char *argv[]) {
 		string_vector_push_back(&file_names, argv[i]);
 	}
 
+	if ((command == C_SERVE || command == C_CLIENT) && !socket_path) {
+		errx(1, "The commands serve and client need a --socket.");
+	}
+	if ((command == C_DB_BUILD || command == C_DB_QUERY) && !db_path) {
+		errx(1, "The db commands need a --db.");
+	}
+	if ((MIN_COVERAGE > 0.0 || SAMPLE_WINDOWS) && command != C_COMPARE) {
+		warnx("--min-coverage and --sample are only used when comparing all "
+			  "sequences. Ignoring them.");
+		MIN_COVERAGE = 0.0;
+		SAMPLE_WINDOWS = 0;
+	}
+
 	// at least one file name must be given
 	if (FLAGS & F_JOIN && string_vector_size(&file_names) == 0) {
 		errx(1, "In join mode at least one filename needs to be supplied.");
 	}
 
 	size_t minfiles = FLAGS & F_JOIN ? 2 : 1;
+	if (command == C_SERVE && db_path) {
+		// The references are taken from the database.
+		minfiles = 0;
+	}
 	if (string_vector_size(&file_names) < minfiles) {
 		// not enough files passed via arguments
 		if (!isatty(STDIN_FILENO)) {
@@ -244,23 +502,77 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	// predict the resources without comparing anything
+	if (only_plan) {
+		int status = plan(&file_names);
+		string_vector_free(&file_names);
+		return status;
+	}
+
+	// send the queries to a running server
+	if (command == C_CLIENT) {
+		int status = serve_client(socket_path, &file_names);
+		string_vector_free(&file_names);
+		return status;
+	}
+
+	// serve the references of a database
+	if (command == C_SERVE && db_path) {
+		if (string_vector_size(&file_names) > 0) {
+			warnx("The references are read from the database; ignoring the "
+				  "given files.");
+		}
+		string_vector_free(&file_names);
+
+		struct reference_set rs;
+		if (db_open(&rs, db_path, p_value)) {
+			return EXIT_FAILURE;
+		}
+		int status = serve(socket_path, &rs);
+		reference_set_free(&rs);
+		return status;
+	}
+
+	// start collecting statistics before any work is done
+	if (stats_file_name) {
+		FLAGS |= F_STATS;
+		stats_init(THREADS);
+	}
+	if (FLAGS & F_PERF && !stats_file_name) {
+		warnx("The hardware counters are only reported with --stats.");
+		FLAGS &= ~F_PERF;
+	}
+	perf_init(THREADS);
+	numa_init(THREADS, numa_replicate);
+	if (trace_file_name) {
+		FLAGS |= F_TRACE;
+		trace_init(THREADS);
+	}
+
+	counters_init(THREADS);
+
 	// parse fasta files
 	dsa_t dsa;
 	dsa_init(&dsa);
 	for (size_t i = 0; i < string_vector_size(&file_names); i++) {
 		char *file_name = string_vector_at(&file_names, i);
+		double begin = stats_now();
 		if (FLAGS & F_JOIN) {
 			read_fasta_join(file_name, &dsa);
 		} else {
 			read_fasta(file_name, &dsa);
 		}
+		trace_span("io", "read", file_name, begin, stats_now());
 	}
 
-	string_vector_free(&file_names);
-
 	size_t n = dsa_size(&dsa);
 
-	if (n < 2) {
+	if (command != C_COMPARE && n == 0) {
+		errx(1, "I am truly sorry, but without sequences there is nothing "
+				"to do.");
+	}
+
+	if (n < 2 && command == C_COMPARE) {
 		errx(1,
 			 "I am truly sorry, but with less than two sequences (%zu given) "
 			 "there is nothing to compare.",
@@ -320,9 +632,100 @@ int main(int argc, char *argv[]) {
 	if (progress == P_ALWAYS) {
 		FLAGS |= F_PRINT_PROGRESS;
 	}
+	progress_init(THREADS, progress_fd);
 
-	// compute distance matrix
-	calculate_distances(dsa_data(&dsa), n);
+	// record the distances along the queries
+	if (profile_file_name && command == C_COMPARE) {
+		if (profile_open(profile_file_name, window,
+						 window_step ? window_step : window) == 0) {
+			FLAGS |= F_PROFILE;
+		}
+	} else if (profile_file_name || window_step) {
+		warnx("Profiles are only written when comparing all sequences with "
+			  "--profile. Ignoring --profile and --window.");
+	}
+	if (FLAGS & F_PROFILE && SAMPLE_WINDOWS) {
+		warnx("Profiles need the complete queries. Ignoring --sample.");
+		SAMPLE_WINDOWS = 0;
+	}
+
+	// shared indexes scan whole queries against many subjects at once
+	if (FLAGS & (F_GENERALIZED | F_PACKED) && command != C_COMPARE) {
+		warnx("Shared indexes are only used when comparing all sequences. "
+			  "Ignoring --index.");
+		FLAGS &= ~(F_GENERALIZED | F_PACKED);
+	}
+	if (FLAGS & (F_GENERALIZED | F_PACKED) && FLAGS & F_LOW_MEMORY) {
+		warnx("Shared indexes have no low-memory mode. Ignoring "
+			  "--low-memory.");
+		FLAGS &= ~F_LOW_MEMORY;
+	}
+	if (FLAGS & (F_GENERALIZED | F_PACKED) &&
+		(MIN_COVERAGE > 0.0 || SAMPLE_WINDOWS)) {
+		warnx("Shared indexes always compare whole queries. Ignoring "
+			  "--min-coverage and --sample.");
+		MIN_COVERAGE = 0.0;
+		SAMPLE_WINDOWS = 0;
+	}
+
+	// record the diagnostics of individual comparisons
+	if ((slow_pairs || pair_dump_file_name) && command != C_COMPARE) {
+		warnx("Pairs are only recorded when comparing all sequences. "
+			  "Ignoring --slow-pairs and --pair-dump.");
+		slow_pairs = 0;
+		pair_dump_file_name = NULL;
+	}
+	if (slow_pairs || pair_dump_file_name) {
+		FLAGS |= F_PAIR_STATS;
+		pairs_init(THREADS, slow_pairs, pair_dump_file_name, n);
+	}
+
+	int status = EXIT_SUCCESS;
+	if (command == C_SERVE) {
+		// answer queries against the references until interrupted
+		struct reference_set rs;
+		if (reference_set_init(&rs, dsa_data(&dsa), n)) {
+			status = EXIT_FAILURE;
+		} else {
+			status = serve(socket_path, &rs);
+			reference_set_free(&rs);
+		}
+	} else if (command == C_DB_BUILD) {
+		status = db_build(db_path, dsa_data(&dsa), n);
+	} else if (command == C_DB_QUERY) {
+		// compare the queries to all references, without a matrix
+		status = db_query(db_path, p_value, dsa_data(&dsa), n);
+	} else {
+		// compute distance matrix
+		calculate_distances(dsa_data(&dsa), n);
+	}
+	if (status != EXIT_SUCCESS) {
+		FLAGS |= F_SOFT_ERROR;
+	}
+
+	if (FLAGS & F_PROFILE) {
+		profile_close();
+	}
+
+	if (FLAGS & F_STATS) {
+		stats_write(stats_file_name, n);
+		stats_free();
+	}
+	perf_free();
+	numa_free();
+	progress_free();
+
+	// The spans refer to file and sequence names.
+	if (FLAGS & F_TRACE) {
+		trace_write(trace_file_name);
+		trace_free();
+	}
+	string_vector_free(&file_names);
+
+	if (FLAGS & F_VERBOSE) {
+		counters_print(stderr);
+	}
+	counters_free();
 
 	dsa_free(&dsa);
 	gsl_rng_free(RNG);
@@ -336,26 +739,60 @@ int main(int argc, char *argv[]) {
 void usage(int status) {
 	const char str[] = {
 		"Usage: andi [OPTIONS...] FILES...\n"
+		"       andi serve --socket=PATH [OPTIONS...] REFERENCES...\n"
+		"       andi client --socket=PATH QUERIES...\n"
+		"       andi db build --db=FILE [OPTIONS...] REFERENCES...\n"
+		"       andi db query --db=FILE [OPTIONS...] QUERIES...\n"
 		"\tFILES... can be any sequence of FASTA files.\n"
 		"\tUse '-' as file name to read from stdin.\n"
+		"\tA server or database compares each query to all references.\n"
 		"Options:\n"
 		"  -b, --bootstrap=INT  Print additional bootstrap matrices\n"
+		"      --db=FILE        The database of the db commands; with serve, "
+		"the references\n"
 		"      --file-of-filenames=FILE  Read additional filenames from FILE; "
 		"one per line\n"
+		"      --huge-pages=MODE  Back the indexes by 'thp' or 'hugetlb' huge "
+		"pages, or 'never'; default: never\n"
+		"      --index=MODE     Index each subject 'separate'ly, all in one "
+		"'generalized' index, or small ones 'packed' together; default: "
+		"separate\n"
 		"  -j, --join           Treat all sequences from one file as a single "
 		"genome\n"
 		"  -l, --low-memory     Use less memory at the cost of speed\n"
 		"  -m, --model=MODEL    Pick an evolutionary model of 'Raw', 'JC', "
 		"'Kimura', 'LogDet'; default: JC\n"
+		"      --min-coverage=FLOAT  Abort pairs predicted to cover less than "
+		"FLOAT\n"
+		"      --numa[=MODE]    Bind threads to NUMA nodes; 'replicate' also "
+		"copies shared data to each node\n"
 		"  -p FLOAT             Significance of an anchor; default: 0.025\n"
+		"      --pair-dump=FILE Write the diagnostics of all comparisons to "
+		"FILE\n"
+		"      --perf-counters  Add hardware counters per phase to --stats\n"
+		"      --plan           Predict memory and runtime as JSON and exit\n"
+		"      --prefilter[=FLOAT]  Skip pairs sharing fewer k-mers than "
+		"FLOAT; default: 0.0007\n"
+		"      --profile=FILE   Write the distances along each query to FILE\n"
 		"      --progress=WHEN  Print a progress bar 'always', 'never', or "
 		"'auto'; default: auto\n"
+		"      --progress-fd=FD Write the progress as lines of JSON to FD\n"
+		"      --sample=INT[,LEN]  Only compare INT windows of LEN "
+		"nucleotides; default LEN: 10000\n"
+		"      --socket=PATH    The socket for the serve and client commands\n"
+		"      --slow-pairs=INT Report the INT slowest comparisons\n"
+		"      --stats=FILE     Write timings of all phases as JSON to FILE\n"
 #ifdef _OPENMP
 		"  -t, --threads=INT    Set the number of threads; by default, all "
 		"processors are used\n"
 #endif
+		"      --trace=FILE     Write a timeline of all threads to FILE\n"
 		"      --truncate-names Truncate names to ten characters\n"
+		"      --window=LEN[,STEP]  Window length and step of --profile; "
+		"default: 10000\n"
 		"  -v, --verbose        Prints additional information\n"
+		"      --walk           Follow the diagonal of anchor pairs; faster, "
+		"but distances may shift\n"
 		"  -h, --help           Display this help and exit\n"
 		"      --version        Output version information and "
 		"acknowledgments\n"};
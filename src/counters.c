@@ -0,0 +1,165 @@
+/**
+ * @file
+ * @brief Counters for the hot path of the anchor search.
+ *
+ * Every thread increments its own thread-local set of counters. Once a
+ * comparison is done, the thread flushes its counters into a padded slot, so
+ * the main thread can sum them up at the end of the run. See counters.h.
+ */
+#include "counters.h"
+#include "global.h"
+#include "slots.h"
+#include <errno.h>
+#include <string.h>
+
+#ifdef ENABLE_COUNTERS
+
+__thread struct counters COUNTERS_LOCAL;
+
+/** @brief A counter slot padded to a cache line. */
+struct counters_slot {
+	struct counters c;
+} __attribute__((aligned(SLOT_ALIGNMENT)));
+
+static struct counters_slot *SLOTS = NULL;
+static size_t SLOTS_COUNT = 0;
+
+/**
+ * @brief Allocate the per-thread slots.
+ *
+ * @param threads - The maximum number of threads used.
+ */
+void counters_init(size_t threads) {
+	if (threads == 0) threads = 1;
+
+	SLOTS = slots_new(threads, sizeof(*SLOTS));
+	SLOTS_COUNT = threads;
+}
+
+/** @brief Move the counters of the calling thread into its slot. */
+void counters_flush(void) {
+	struct counters_slot *slot =
+		slots_local(SLOTS, SLOTS_COUNT, sizeof(*SLOTS));
+	if (!slot) return;
+
+	size_t *dst = (size_t *)&slot->c;
+	size_t *src = (size_t *)&COUNTERS_LOCAL;
+
+	for (size_t k = 0; k < sizeof(struct counters) / sizeof(size_t); k++) {
+		dst[k] += src[k];
+	}
+
+	counters_reset();
+}
+
+/** @brief Free the per-thread slots. */
+void counters_free(void) {
+	free(SLOTS);
+	SLOTS = NULL;
+	SLOTS_COUNT = 0;
+}
+
+/** @brief Sum up the slots of all threads. */
+static struct counters counters_total(void) {
+	struct counters total = {};
+	size_t *dst = (size_t *)&total;
+
+	for (size_t t = 0; t < SLOTS_COUNT; t++) {
+		const size_t *src = (const size_t *)&SLOTS[t].c;
+		for (size_t k = 0; k < sizeof(struct counters) / sizeof(size_t); k++) {
+			dst[k] += src[k];
+		}
+	}
+
+	return total;
+}
+
+/** @brief Print one set of counters as a JSON object. */
+static void counters_write_one(FILE *file, const struct counters *c,
+							   const char *indent) {
+	fprintf(file, "{\n");
+	fprintf(file, "%s\t\"get_match_cached\": %zu,\n", indent,
+			c->get_match_cached);
+	fprintf(file, "%s\t\"cache_hits\": %zu,\n", indent, c->cache_hits);
+	fprintf(file, "%s\t\"cache_fallbacks\": %zu,\n", indent,
+			c->cache_fallbacks);
+	fprintf(file, "%s\t\"get_interval\": %zu,\n", indent, c->get_interval);
+	fprintf(file, "%s\t\"get_interval_iterations\": %zu,\n", indent,
+			c->get_interval_iterations);
+	fprintf(file, "%s\t\"lucky_successes\": %zu,\n", indent,
+			c->lucky_successes);
+	fprintf(file, "%s\t\"lucky_failures\": %zu,\n", indent, c->lucky_failures);
+	fprintf(file, "%s\t\"walk_successes\": %zu,\n", indent,
+			c->walk_successes);
+	fprintf(file, "%s\t\"walk_failures\": %zu,\n", indent, c->walk_failures);
+	fprintf(file, "%s\t\"anchors\": %zu,\n", indent, c->anchors);
+	fprintf(file, "%s\t\"match_length\": [", indent);
+	for (size_t k = 0; k < COUNTERS_BUCKETS; k++) {
+		fprintf(file, "%s%zu", k ? ", " : "", c->match_length[k]);
+	}
+	fprintf(file, "]\n%s}", indent);
+}
+
+/**
+ * @brief Write the total and per-thread counters as the value of a JSON key.
+ *
+ * @param file - The file to write to.
+ * @param indent - The indentation of the enclosing key.
+ */
+void counters_write_json(FILE *file, const char *indent) {
+	struct counters total = counters_total();
+
+	fprintf(file, "{\n%s\t\"total\": ", indent);
+
+	char inner[32];
+	snprintf(inner, sizeof(inner), "%s\t", indent);
+	counters_write_one(file, &total, inner);
+
+	fprintf(file, ",\n%s\t\"per_thread\": [\n", indent);
+	snprintf(inner, sizeof(inner), "%s\t\t", indent);
+	for (size_t t = 0; t < SLOTS_COUNT; t++) {
+		fprintf(file, "%s", inner);
+		counters_write_one(file, &SLOTS[t].c, inner);
+		fprintf(file, "%s\n", t + 1 < SLOTS_COUNT ? "," : "");
+	}
+	fprintf(file, "%s\t]\n%s}", indent, indent);
+}
+
+/** @brief Print a human readable summary of all counters. */
+void counters_print(FILE *file) {
+	struct counters total = counters_total();
+
+	double lookups = total.get_match_cached ? total.get_match_cached : 1;
+	double lucky = total.lucky_successes + total.lucky_failures;
+	double walks = total.walk_successes + total.walk_failures;
+
+	fprintf(file, "Matching counters:\n");
+	fprintf(file, "  get_match_cached calls:  %zu\n", total.get_match_cached);
+	fprintf(file, "  cache hits:              %zu (%.1f%%)\n", total.cache_hits,
+			100.0 * total.cache_hits / lookups);
+	fprintf(file, "  fallbacks to get_match:  %zu (%.1f%%)\n",
+			total.cache_fallbacks, 100.0 * total.cache_fallbacks / lookups);
+	fprintf(file, "  get_interval calls:      %zu\n", total.get_interval);
+	fprintf(file, "  get_interval iterations: %zu\n",
+			total.get_interval_iterations);
+	fprintf(file, "  lucky anchors:           %zu of %zu attempts\n",
+			total.lucky_successes, (size_t)lucky);
+	fprintf(file, "  diagonal walks:          %zu of %zu attempts\n",
+			total.walk_successes, (size_t)walks);
+	fprintf(file, "  anchors:                 %zu\n", total.anchors);
+	fprintf(file, "  match lengths:\n");
+	for (size_t k = 0; k < COUNTERS_BUCKETS; k++) {
+		if (!total.match_length[k]) continue;
+		fprintf(file, "    [%zu, %zu): %zu\n", ((size_t)1 << k) - 1,
+				((size_t)2 << k) - 1, total.match_length[k]);
+	}
+
+	for (size_t t = 0; SLOTS_COUNT > 1 && t < SLOTS_COUNT; t++) {
+		const struct counters *c = &SLOTS[t].c;
+		fprintf(file,
+				"  thread %zu: %zu lookups, %zu lucky anchors, %zu anchors\n",
+				t, c->get_match_cached, c->lucky_successes, c->anchors);
+	}
+}
+
+#endif // ENABLE_COUNTERS
@@ -0,0 +1,106 @@
+/**
+ * @file
+ * @brief Counters for the hot path of the anchor search.
+ *
+ * These counters explain where the matching time goes: how often the
+ * lcp-interval cache helps, how many lucky anchors are found, how often a
+ * diagonal walk replaces lookups, how deep the virtual suffix tree is
+ * traversed, and how long the matches are. As even a simple increment is
+ * noticeable in the innermost loops, the counters are compiled out by default.
+ * Use `./configure --enable-counters` to enable them.
+ */
+#ifndef _COUNTERS_H_
+#define _COUNTERS_H_
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/** The number of buckets in the match length histogram. */
+#define COUNTERS_BUCKETS 32
+
+/**
+ * @brief All counters of a single thread.
+ */
+struct counters {
+	/** Calls to get_match_cached(). */
+	size_t get_match_cached;
+	/** Lookups where the cache provided a starting interval. */
+	size_t cache_hits;
+	/** Lookups where get_match_cached() fell back to get_match(). */
+	size_t cache_fallbacks;
+	/** Calls to get_interval(). */
+	size_t get_interval;
+	/** Iterations of the child-table loop within get_interval(). */
+	size_t get_interval_iterations;
+	/** Lucky anchors found. */
+	size_t lucky_successes;
+	/** Failed attempts to find a lucky anchor. */
+	size_t lucky_failures;
+	/** Diagonal walks that ended in an anchor. */
+	size_t walk_successes;
+	/** Diagonal walks that were abandoned. */
+	size_t walk_failures;
+	/** All anchors found, including lucky ones. */
+	size_t anchors;
+	/** Histogram of match lengths; bucket `k` holds lengths in
+	 * [2^k - 1, 2^(k+1) - 1). */
+	size_t match_length[COUNTERS_BUCKETS];
+};
+
+#ifdef ENABLE_COUNTERS
+
+extern __thread struct counters COUNTERS_LOCAL;
+
+/** @brief Increment the counter `NAME` of the calling thread. */
+#define COUNT(NAME) (COUNTERS_LOCAL.NAME++)
+
+/** @brief Drop all counts of the calling thread not yet flushed. */
+#define counters_reset() (COUNTERS_LOCAL = (struct counters){})
+
+/** @brief Add a match of length `L` to the histogram. */
+#define COUNT_MATCH_LENGTH(L) counters_match_length(L)
+
+static inline void counters_match_length(size_t length) {
+	size_t bucket = 0;
+	for (size_t l = length + 1; l > 1 && bucket < COUNTERS_BUCKETS - 1;
+		 l >>= 1) {
+		bucket++;
+	}
+	COUNTERS_LOCAL.match_length[bucket]++;
+}
+
+void counters_init(size_t threads);
+void counters_flush(void);
+void counters_free(void);
+void counters_print(FILE *);
+void counters_write_json(FILE *, const char *indent);
+
+#else
+
+#define COUNT(NAME)                                                            \
+	do {                                                                       \
+	} while (0)
+#define COUNT_MATCH_LENGTH(L)                                                  \
+	do {                                                                       \
+	} while (0)
+
+#define counters_init(threads)                                                 \
+	do {                                                                       \
+	} while (0)
+#define counters_flush()                                                       \
+	do {                                                                       \
+	} while (0)
+#define counters_reset()                                                       \
+	do {                                                                       \
+	} while (0)
+#define counters_free()                                                        \
+	do {                                                                       \
+	} while (0)
+#define counters_print(file)                                                   \
+	do {                                                                       \
+	} while (0)
+
+#endif // ENABLE_COUNTERS
+
+#endif // _COUNTERS_H_
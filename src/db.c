@@ -0,0 +1,438 @@
+/**
+ * @file
+ * @brief A database of indexed references
+ *
+ * The database is a single file, which starts with a header and a table with
+ * one entry per reference. Then follow the names and, per reference, its
+ * strands (`RS`) and the arrays of its index, including the cache. Every array
+ * starts at a page boundary. Thus the whole file can be mapped and the arrays
+ * used as they are; the operating system only reads the pages a query
+ * touches, and keeps them cached for the next query.
+ *
+ * All values are stored in host byte order. The anchor thresholds depend on
+ * the significance `-p`, so it is fixed when the database is built.
+ */
+#define _GNU_SOURCE
+#include "db.h"
+#include "esa.h"
+#include "global.h"
+#include "model.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** The version of the file format. */
+#define DB_VERSION 1
+/** The alignment of all arrays. */
+#define DB_ALIGNMENT 4096
+/** A marker to detect a different byte order. */
+#define DB_BYTE_ORDER 0x01020304
+
+/**
+ * @brief The header of a database.
+ */
+struct db_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_size;
+	uint32_t byte_order;
+	uint32_t index_width;
+	uint64_t cache_entries;
+	uint64_t count;
+	/** The significance of an anchor used for the thresholds. */
+	double p_value;
+	/** The size of the whole file. */
+	uint64_t size;
+};
+
+/**
+ * @brief A reference. All arrays are given as offsets into the file.
+ */
+struct db_entry {
+	/** The length of the forward strand. */
+	uint64_t length;
+	uint64_t threshold;
+	double gc;
+	/** The null-terminated name. */
+	uint64_t name;
+	uint64_t RS, SA, LCP, CLD, FVC, cache;
+};
+
+/** @brief Round up to the alignment of the arrays. */
+static uint64_t db_align(uint64_t offset) {
+	return (offset + DB_ALIGNMENT - 1) / DB_ALIGNMENT * DB_ALIGNMENT;
+}
+
+/**
+ * @brief Compute the position of all data.
+ *
+ * @param entries - (output parameter) The entries; one per reference.
+ * @param sequences - The references.
+ * @param n - The number of references.
+ * @returns the size of the file.
+ */
+static uint64_t db_layout(struct db_entry *entries, const seq_t *sequences,
+						  size_t n) {
+	uint64_t cache_size = ((uint64_t)1 << (2 * CACHE_LENGTH)) *
+						  sizeof(lcp_inter_t);
+	uint64_t offset = sizeof(struct db_header) + n * sizeof(struct db_entry);
+
+	for (size_t i = 0; i < n; i++) {
+		entries[i].name = offset;
+		offset += strlen(sequences[i].name) + 1;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		uint64_t RSlen = 2 * sequences[i].len + 1;
+		struct db_entry *entry = &entries[i];
+
+		entry->length = sequences[i].len;
+		entry->RS = offset = db_align(offset);
+		offset += RSlen + 1;
+		entry->SA = offset = db_align(offset);
+		offset += RSlen * sizeof(saidx_t);
+		entry->LCP = offset = db_align(offset);
+		offset += (RSlen + 1) * sizeof(saidx_t);
+		entry->CLD = offset = db_align(offset);
+		offset += (RSlen + 1) * sizeof(saidx_t);
+		entry->FVC = offset = db_align(offset);
+		offset += RSlen;
+		entry->cache = offset = db_align(offset);
+		offset += cache_size;
+	}
+
+	return offset;
+}
+
+/**
+ * @brief Write a whole buffer at a position.
+ *
+ * @returns 0 iff successful.
+ */
+static int db_write(int file_descriptor, const void *buffer, size_t count,
+					uint64_t offset) {
+	const char *ptr = buffer;
+	while (count > 0) {
+		ssize_t written = pwrite(file_descriptor, ptr, count, offset);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return 1;
+		}
+		ptr += written;
+		count -= written;
+		offset += written;
+	}
+	return 0;
+}
+
+/**
+ * @brief Index the references and write them into a database.
+ *
+ * The references are indexed in parallel and each index is written as soon as
+ * it is done. The database is written to a temporary file first, which then
+ * replaces an existing one. If an index cannot be built, the temporary file is
+ * removed and nothing is replaced.
+ *
+ * @param db_path - The file of the database.
+ * @param sequences - The references.
+ * @param n - The number of references.
+ * @returns the exit status.
+ */
+int db_build(const char *db_path, const seq_t *sequences, size_t n) {
+	struct db_entry *entries = calloc(n, sizeof(*entries));
+	CHECK_MALLOC(entries);
+
+	struct db_header header = {
+		.magic = "ANDIREFS",
+		.version = DB_VERSION,
+		.entry_size = sizeof(struct db_entry),
+		.byte_order = DB_BYTE_ORDER,
+		.index_width = sizeof(saidx_t),
+		.cache_entries = (uint64_t)1 << (2 * CACHE_LENGTH),
+		.count = n,
+		.p_value = ANCHOR_P_VALUE};
+	header.size = db_layout(entries, sequences, n);
+
+	char *tmp_path = NULL;
+	if (asprintf(&tmp_path, "%s.tmp", db_path) < 0) {
+		tmp_path = NULL;
+	}
+	CHECK_MALLOC(tmp_path);
+
+	int file_descriptor = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (file_descriptor < 0) {
+		err(1, "%s", tmp_path);
+	}
+
+	// The errno of the first failed write, which may happen on any thread.
+	int errnum = 0;
+	int failed = ftruncate(file_descriptor, header.size) != 0;
+
+	for (size_t i = 0; i < n && !failed; i++) {
+		failed = db_write(file_descriptor, sequences[i].name,
+						  strlen(sequences[i].name) + 1, entries[i].name);
+	}
+	if (failed) {
+		errnum = errno;
+	}
+
+	int index_failed = 0;
+	size_t i;
+#pragma omp parallel for num_threads(THREADS) schedule(dynamic, 1)
+	for (i = 0; i < n; i++) {
+		// After a failure, the database is discarded anyway.
+		int stop;
+#pragma omp atomic read
+		stop = failed;
+		if (stop) continue;
+
+		seq_subject subject = {0};
+		esa_s E = {0};
+		if (seq_subject_init(&subject, &sequences[i]) ||
+			esa_init(&E, &subject)) {
+#pragma omp critical(db_build)
+			warnx("Failed to create index for %s.", sequences[i].name);
+#pragma omp atomic write
+			index_failed = 1;
+#pragma omp atomic write
+			failed = 1;
+
+			esa_free(&E);
+			seq_subject_free(&subject);
+			continue;
+		}
+
+		struct db_entry *entry = &entries[i];
+		entry->threshold = subject.threshold;
+		entry->gc = subject.gc;
+
+		size_t RSlen = subject.RSlen;
+		int check =
+			db_write(file_descriptor, subject.RS, RSlen + 1, entry->RS) ||
+			db_write(file_descriptor, E.SA, RSlen * sizeof(saidx_t),
+					 entry->SA) ||
+			db_write(file_descriptor, E.LCP, (RSlen + 1) * sizeof(saidx_t),
+					 entry->LCP) ||
+			db_write(file_descriptor, E.CLD, (RSlen + 1) * sizeof(saidx_t),
+					 entry->CLD) ||
+			db_write(file_descriptor, E.FVC, RSlen, entry->FVC) ||
+			db_write(file_descriptor, E.cache,
+					 header.cache_entries * sizeof(lcp_inter_t), entry->cache);
+		if (check) {
+			int error = errno;
+#pragma omp critical(db_build)
+			if (!errnum) errnum = error;
+#pragma omp atomic write
+			failed = 1;
+		}
+
+		esa_free(&E);
+		seq_subject_free(&subject);
+	}
+
+	if (index_failed) {
+		close(file_descriptor);
+		unlink(tmp_path);
+		free(tmp_path);
+		free(entries);
+		return EXIT_FAILURE;
+	}
+
+	// The header goes last, so an incomplete file is never valid.
+	if (!failed &&
+		(db_write(file_descriptor, entries, n * sizeof(*entries),
+				  sizeof(header)) ||
+		 db_write(file_descriptor, &header, sizeof(header), 0))) {
+		failed = 1;
+		errnum = errno;
+	}
+
+	if (close(file_descriptor) != 0 && !failed) {
+		failed = 1;
+		errnum = errno;
+	}
+	if (!failed && rename(tmp_path, db_path) != 0) {
+		failed = 1;
+		errnum = errno;
+	}
+	if (failed) {
+		unlink(tmp_path);
+		errno = errnum;
+		err(1, "%s", db_path);
+	}
+
+	free(tmp_path);
+	free(entries);
+
+	return FLAGS & F_SOFT_ERROR ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Map a database.
+ *
+ * The set of references points into the mapping; nothing is copied. The
+ * significance of anchors is set to the one the database was built with, as
+ * the thresholds of the references depend on it. A different one given by the
+ * user is ignored with a warning.
+ *
+ * @param rs - (output parameter) The references.
+ * @param db_path - The file of the database.
+ * @param p_value - The significance given by the user; zero if none.
+ * @returns 0 iff successful.
+ */
+int db_open(struct reference_set *rs, const char *db_path, double p_value) {
+	*rs = (struct reference_set){};
+
+	int file_descriptor = open(db_path, O_RDONLY);
+	if (file_descriptor < 0) {
+		warn("%s", db_path);
+		return 1;
+	}
+
+	struct stat st;
+	if (fstat(file_descriptor, &st) != 0) {
+		warn("%s", db_path);
+		close(file_descriptor);
+		return 1;
+	}
+
+	size_t size = st.st_size;
+	char *map = NULL;
+	if (size >= sizeof(struct db_header)) {
+		map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+		if (map == MAP_FAILED) {
+			warn("%s", db_path);
+			close(file_descriptor);
+			return 1;
+		}
+	}
+	close(file_descriptor);
+
+	const struct db_header *header = (const struct db_header *)map;
+	if (!map || memcmp(header->magic, "ANDIREFS", 8) != 0 ||
+		header->byte_order != DB_BYTE_ORDER || header->size != size) {
+		warnx("%s: Not a database of andi.", db_path);
+		goto fail;
+	}
+
+	if (header->version != DB_VERSION ||
+		header->entry_size != sizeof(struct db_entry) ||
+		header->index_width != sizeof(saidx_t) ||
+		header->cache_entries != (uint64_t)1 << (2 * CACHE_LENGTH)) {
+		warnx("%s: The database was built by an incompatible version of "
+			  "andi. Please rebuild it.",
+			  db_path);
+		goto fail;
+	}
+
+	size_t n = header->count;
+	const struct db_entry *entries =
+		(const struct db_entry *)(map + sizeof(*header));
+	if (n == 0 || n > (size - sizeof(*header)) / sizeof(*entries)) {
+		warnx("%s: The database is corrupt.", db_path);
+		goto fail;
+	}
+
+	rs->data = malloc(n * sizeof(*rs->data));
+	rs->sequences = malloc(n * sizeof(*rs->sequences));
+	CHECK_MALLOC(rs->data);
+	CHECK_MALLOC(rs->sequences);
+	rs->size = n;
+	rs->map = map;
+	rs->map_size = size;
+
+	uint64_t cache_size = header->cache_entries * sizeof(lcp_inter_t);
+	for (size_t i = 0; i < n; i++) {
+		const struct db_entry *entry = &entries[i];
+		uint64_t RSlen = 2 * entry->length + 1;
+
+		// Only the ends of the arrays need to be checked, as db_build()
+		// writes them in this order.
+		if (entry->name >= size || !memchr(map + entry->name, '\0',
+										   size - entry->name) ||
+			entry->cache + cache_size > size ||
+			entry->RS + RSlen + 1 > entry->SA ||
+			entry->SA + RSlen * sizeof(saidx_t) > entry->LCP ||
+			entry->LCP + (RSlen + 1) * sizeof(saidx_t) > entry->CLD ||
+			entry->CLD + (RSlen + 1) * sizeof(saidx_t) > entry->FVC ||
+			entry->FVC + RSlen > entry->cache) {
+			warnx("%s: The database is corrupt.", db_path);
+			reference_set_free(rs);
+			return 1;
+		}
+
+		char *RS = map + entry->RS;
+		rs->sequences[i] = (seq_t){.S = RS + entry->length + 1,
+								   .len = entry->length,
+								   .name = map + entry->name};
+
+		struct reference *ref = &rs->data[i];
+		ref->seq = &rs->sequences[i];
+		ref->subject = (seq_subject){.RS = RS,
+									 .RSlen = RSlen,
+									 .gc = entry->gc,
+									 .threshold = entry->threshold};
+		ref->E = (esa_s){.S = RS,
+						 .SA = (saidx_t *)(map + entry->SA),
+						 .LCP = (saidx_t *)(map + entry->LCP),
+						 .len = RSlen,
+						 .cache = (lcp_inter_t *)(map + entry->cache),
+						 .FVC = map + entry->FVC,
+						 .CLD = (saidx_t *)(map + entry->CLD)};
+	}
+
+	// The thresholds of queries have to match the ones of the references.
+	if (p_value != 0.0 && p_value != header->p_value) {
+		warnx("%s: The database was built with -p %g. Ignoring -p %g.",
+			  db_path, header->p_value, p_value);
+	}
+	ANCHOR_P_VALUE = header->p_value;
+
+	return 0;
+
+fail:
+	if (map) munmap(map, size);
+	return 1;
+}
+
+/**
+ * @brief Compare queries against all references of a database.
+ *
+ * Each query is compared to every reference in both directions, in parallel
+ * over the references. The results are printed as by reference_set_print().
+ *
+ * @param db_path - The file of the database.
+ * @param p_value - The significance given by the user; zero if none.
+ * @param queries - The queries.
+ * @param n - The number of queries.
+ * @returns the exit status.
+ */
+int db_query(const char *db_path, double p_value, const seq_t *queries,
+			 size_t n) {
+	struct reference_set rs;
+	if (db_open(&rs, db_path, p_value)) {
+		return EXIT_FAILURE;
+	}
+
+	struct model *forward = malloc(rs.size * sizeof(*forward));
+	struct model *backward = malloc(rs.size * sizeof(*backward));
+	CHECK_MALLOC(forward);
+	CHECK_MALLOC(backward);
+
+	for (size_t i = 0; i < n; i++) {
+		if (reference_set_compare(&rs, &queries[i], forward, backward)) {
+			errx(1, "Failed to create index for %s.", queries[i].name);
+		}
+		reference_set_print(stdout, &rs, &queries[i], forward, backward);
+	}
+
+	free(forward);
+	free(backward);
+	reference_set_free(&rs);
+
+	return FLAGS & F_SOFT_ERROR ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file
+ * @brief A database of indexed references
+ *
+ * `andi db build` writes the normalized references together with their names,
+ * anchor thresholds and complete indices into a single file. `andi db query`
+ * maps this file and compares queries against all references, without
+ * building any index of a reference.
+ */
+#ifndef _DB_H_
+#define _DB_H_
+
+#include "reference.h"
+#include "sequence.h"
+
+int db_build(const char *db_path, const seq_t *sequences, size_t n);
+int db_open(struct reference_set *rs, const char *db_path, double p_value);
+int db_query(const char *db_path, double p_value, const seq_t *queries,
+			 size_t n);
+
+#endif // _DB_H_
@@ -5,20 +5,29 @@
 // clang-format off
 #ifdef FAST
 #define NAME distMatrix
-#define P_OUTER _Pragma("omp parallel for num_threads( THREADS) default(none) shared(progress_counter) firstprivate( stderr, M, sequences, n, print_progress)")
+#define P_OUTER _Pragma("omp parallel for num_threads( THREADS) default(none) firstprivate( stderr, sequences, n, store, data, related, groups, print_profile, kind, distinct)")
 #define P_INNER
+#define P_BARRIER
+#define P_FOR
+#define P_REPLICATE NULL
 #else
 #undef NAME
 #undef P_OUTER
 #undef P_INNER
+#undef P_BARRIER
+#undef P_FOR
+#undef P_REPLICATE
 #define NAME distMatrixLM
 #define P_OUTER
-#define P_INNER _Pragma("omp parallel for num_threads( THREADS) default(none) shared(progress_counter) firstprivate( stderr, M, sequences, n, print_progress, i, E, subject)")
+#define P_INNER _Pragma("omp parallel num_threads( THREADS) default(none) firstprivate( stderr, sequences, n, store, data, related, groups, print_profile, kind, i, E, subject, replicas)")
+#define P_BARRIER _Pragma("omp barrier")
+#define P_FOR _Pragma("omp for")
+#define P_REPLICATE numa_index_new()
 #endif
 // clang-format on
 
 /** @brief This function calls dist_andi for pairs of subjects and queries, and
- * thereby fills the distance matrix.
+ * hands each result to a callback.
  *
  * This function is actually two functions. It is one template that gets
  * compiled into two functions via preprocessor hacks. The reason is DRY (Do not
@@ -26,71 +35,124 @@
  * The two functions only differ by their name and pragmas; i.e. They run in
  * different parallel modes.
  * `distMatrix` is faster than `distMatrixLM` but needs more memory.
+ * With `--numa`, each thread works on the copies of its node, if any.
+ *
+ * The callback is called concurrently from all threads, but only once per
+ * pair of subject and query. Pairs rejected by the prefilter are not compared
+ * and handed to the callback as an empty result. Only the first of identical
+ * sequences is compared; its results are handed on for all copies.
  *
  * @param sequences - The sequences to compare
  * @param n - The number of sequences
- * @param M - A matrix for additional output data
+ * @param related - The pairs to compare
+ * @param groups - The groups of identical sequences
+ * @param store - The callback receiving each result
+ * @param data - Passed on to the callback
  */
-void NAME(struct model *M, const seq_t *sequences, size_t n) {
+void NAME(const seq_t *sequences, size_t n, const struct dist_related *related,
+		  const struct dist_groups *groups, dist_callback store, void *data) {
 	size_t i;
 
-	size_t progress_counter = 0;
-	int print_progress = FLAGS & F_PRINT_PROGRESS;
-
-	if (print_progress) {
-		fprintf(stderr, "Comparing %zu sequences: %5.1f%% (%zu/%zu)", n, 0.0,
-				(size_t)0, n * n - n);
-	}
+	int print_profile = FLAGS & F_PROFILE;
+	int kind = MODEL;
+	size_t distinct = groups->distinct;
+	progress_begin(n, distinct, distinct * distinct - distinct);
 
 	//#pragma
 	P_OUTER
 	for (i = 0; i < n; i++) {
-		seq_subject subject;
-		esa_s E;
+		seq_subject subject = {0};
+		esa_s E = {0};
+
+		if (groups->first[i] != i) {
+			continue;
+		}
 
+		// Without a single related query, the index is not needed.
+		if (related->counts && related->counts[i] == 0) {
+			dist_store_missing(groups, n, i, store, data);
+			continue;
+		}
+
+		numa_bind();
+		double begin = stats_now();
 		if (seq_subject_init(&subject, &sequences[i]) ||
 			esa_init(&E, &subject)) {
-			errx(1, "Failed to create index for %s.", sequences[i].name);
+			dist_index_failed(sequences, n, i, groups, store, data);
+			esa_free(&E);
+			seq_subject_free(&subject);
+			continue;
 		}
+		trace_span("index", "index", sequences[i].name, begin, stats_now());
 
-		// now compare every other sequence to i
-		size_t j;
+		// With --numa=replicate, each node compares against its own copy.
+		struct numa_index *replicas = P_REPLICATE;
 
+		// now compare every other sequence to i
 		P_INNER
-		for (j = 0; j < n; j++) {
-			if (j == i) {
-				M(i, j) = (struct model){.seq_len = 9, .counts = {9}};
-				continue;
+		{
+			numa_bind();
+			numa_index_copy(replicas, &E);
+			P_BARRIER
+			const esa_s *local_E = numa_index_local(replicas, &E);
+
+			P_FOR
+			for (size_t j = 0; j < n; j++) {
+				if (j == i || groups->first[j] != j) {
+					continue;
+				}
+
+				if (!dist_related(related, i, j)) {
+					const model missing = {.seq_len = 0};
+					dist_store_groups(groups, i, j, &missing, NULL, store,
+									  data);
+					progress_add(1, 0);
+					continue;
+				}
+
+				numa_bind();
+				const char *query = numa_sequences(sequences)[j].S;
+				size_t ql = sequences[j].len;
+
+				struct profile profile;
+				struct profile *pr = NULL;
+				if (print_profile) {
+					profile_init(&profile, ql);
+					pr = &profile;
+				}
+
+				struct dist_info info;
+				struct stats_timer timer = stats_begin();
+				model datum =
+					dist_anchor_profile(local_E, query, ql, subject.threshold,
+										kind, &info, pr);
+				double seconds = stats_end(PH_MATCH, &timer);
+				dist_store_groups(groups, i, j, &datum, &info, store, data);
+
+				if (pr) {
+					for (size_t a = i; a != SIZE_MAX && !info.aborted;
+						 a = groups->next[a]) {
+						for (size_t b = j; b != SIZE_MAX;
+							 b = groups->next[b]) {
+							profile_write(pr, sequences[a].name,
+										  sequences[b].name);
+						}
+					}
+					profile_free(pr);
+				}
+				stats_count_pair(info.aborted);
+				counters_flush();
+				pairs_record(i, j, seconds, &info);
+				trace_block("match", "compare", sequences[i].name, timer.wall,
+							timer.wall + seconds);
+				progress_add(1, ql);
 			}
-
-			size_t ql = sequences[j].len;
-
-			M(i, j) = dist_anchor(&E, sequences[j].S, ql, subject.threshold);
-
-#pragma omp atomic update
-			progress_counter++;
-		}
-
-		if (print_progress) {
-			size_t local_progress_counter;
-			size_t num_comparisons = n * n - n;
-
-#pragma omp atomic read
-			local_progress_counter = progress_counter;
-
-			double progress =
-				100.0 * (double)local_progress_counter / num_comparisons;
-
-#pragma omp critical
-			fprintf(stderr, "\rComparing %zu sequences: %5.1f%% (%zu/%zu)", n,
-					progress, local_progress_counter, num_comparisons);
 		}
 
+		numa_index_free(replicas);
 		esa_free(&E);
 		seq_subject_free(&subject);
 	}
 
-	if (print_progress) {
-		fprintf(stderr, ", done.\n");
-	}
+	progress_end();
 }
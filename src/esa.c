@@ -14,7 +14,9 @@
  * for each query we are significantly faster (up to 7 times).
  */
 #include "esa.h"
+#include "counters.h"
 #include "global.h"
+#include "stats.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
@@ -71,8 +73,10 @@ ssize_t char2code(const char c) {
  * @returns 0 iff successful
  */
 int esa_init_cache(esa_s *self) {
-	lcp_inter_t *cache = malloc((1 << (2 * CACHE_LENGTH)) * sizeof(*cache));
+	lcp_inter_t *cache =
+		mem_alloc_pages((1 << (2 * CACHE_LENGTH)) * sizeof(*cache));
 	CHECK_MALLOC(cache);
+	mem_add(MEM_CACHE, (1 << (2 * CACHE_LENGTH)) * sizeof(*cache));
 
 	self->cache = cache;
 
@@ -179,9 +183,10 @@ void esa_init_cache_dfs(esa_s *C, char *str, size_t pos, const lcp_inter_t in) {
 		// fill the cache. However, I haven't yet figured out how to do that
 		// properly and whether it is worth it.
 
-		if (non_acgt) {
-			esa_init_cache_fill(C, str, k, ij);
-		} else {
+		// Past a non-acgt character, no cached string shares all `ij.l`
+		// characters with the interval. Its entries keep the shorter match
+		// filled in above.
+		if (!non_acgt) {
 			esa_init_cache_dfs(C, str, k, ij);
 		}
 	}
@@ -229,8 +234,9 @@ void esa_init_cache_fill(esa_s *C, char *str, size_t pos, lcp_inter_t in) {
 int esa_init_FVC(esa_s *self) {
 	size_t len = self->len;
 
-	char *FVC = self->FVC = malloc(len);
+	char *FVC = self->FVC = mem_alloc_pages(len);
 	CHECK_MALLOC(FVC);
+	mem_add(MEM_FVC, len);
 
 	const char *S = self->S;
 	const int *SA = self->SA;
@@ -257,35 +263,143 @@ int esa_init(esa_s *C, const seq_subject *S) {
 	*C = (esa_s){.S = S->RS, .len = S->RSlen};
 
 	int result;
+	struct stats_timer timer = stats_begin();
 
 	result = esa_init_SA(C);
 	if (result) return result;
+	stats_end(PH_SA, &timer);
 
+	timer = stats_begin();
 	result = esa_init_LCP(C);
 	if (result) return result;
+	stats_end(PH_LCP, &timer);
 
+	timer = stats_begin();
 	result = esa_init_CLD(C);
 	if (result) return result;
+	stats_end(PH_CLD, &timer);
 
+	timer = stats_begin();
 	result = esa_init_FVC(C);
 	if (result) return result;
+	stats_end(PH_FVC, &timer);
 
+	timer = stats_begin();
 	result = esa_init_cache(C);
 	if (result) return result;
+	stats_end(PH_CACHE, &timer);
+
+	// Filling the cache traverses the ESA just like the matching. Do not
+	// account these steps to the matching counters.
+	counters_reset();
 
+	stats_count_subject();
 	return 0;
 }
 
 /** @brief Free the private data of an ESA. */
 void esa_free(esa_s *self) {
-	free(self->SA);
-	free(self->LCP);
-	free(self->CLD);
-	free(self->cache);
-	free(self->FVC);
+	size_t len = self->len;
+	if (self->SA) mem_sub(MEM_SA, len * sizeof(*self->SA));
+	if (self->LCP) mem_sub(MEM_LCP, (len + 1) * sizeof(*self->LCP));
+	if (self->CLD) mem_sub(MEM_CLD, (len + 1) * sizeof(*self->CLD));
+	if (self->cache) {
+		mem_sub(MEM_CACHE, (1 << (2 * CACHE_LENGTH)) * sizeof(*self->cache));
+	}
+	if (self->FVC) mem_sub(MEM_FVC, len);
+
+	mem_free_pages(self->SA, len * sizeof(*self->SA));
+	mem_free_pages(self->LCP, (len + 1) * sizeof(*self->LCP));
+	mem_free_pages(self->CLD, (len + 1) * sizeof(*self->CLD));
+	mem_free_pages(self->cache,
+				   (1 << (2 * CACHE_LENGTH)) * sizeof(*self->cache));
+	mem_free_pages(self->FVC, len);
 	*self = (esa_s){};
 }
 
+/**
+ * @brief Copy an ESA.
+ *
+ * All arrays are allocated and written by the calling thread. Thus, on a NUMA
+ * machine, the copy resides on the node of that thread.
+ *
+ * @param C - (output parameter) The copy.
+ * @param src - The ESA to copy.
+ * @param S - The string of the copy; it has to equal the one of `src`.
+ * @returns 0 iff successful
+ */
+int esa_clone(esa_s *C, const esa_s *src, const char *S) {
+	if (!C || !src || !S) return 1;
+
+	size_t len = src->len;
+	size_t cache_size = (1 << (2 * CACHE_LENGTH)) * sizeof(*src->cache);
+	*C = (esa_s){.S = S, .len = len};
+
+	C->SA = mem_alloc_pages(len * sizeof(*C->SA));
+	C->LCP = mem_alloc_pages((len + 1) * sizeof(*C->LCP));
+	C->CLD = mem_alloc_pages((len + 1) * sizeof(*C->CLD));
+	C->FVC = mem_alloc_pages(len);
+	C->cache = mem_alloc_pages(cache_size);
+
+	if (C->SA) mem_add(MEM_SA, len * sizeof(*C->SA));
+	if (C->LCP) mem_add(MEM_LCP, (len + 1) * sizeof(*C->LCP));
+	if (C->CLD) mem_add(MEM_CLD, (len + 1) * sizeof(*C->CLD));
+	if (C->FVC) mem_add(MEM_FVC, len);
+	if (C->cache) mem_add(MEM_CACHE, cache_size);
+
+	if (!C->SA || !C->LCP || !C->CLD || !C->FVC || !C->cache) {
+		esa_free(C);
+		return 1;
+	}
+
+	memcpy(C->SA, src->SA, len * sizeof(*C->SA));
+	memcpy(C->LCP, src->LCP, (len + 1) * sizeof(*C->LCP));
+	memcpy(C->CLD, src->CLD, (len + 1) * sizeof(*C->CLD));
+	memcpy(C->FVC, src->FVC, len);
+	memcpy(C->cache, src->cache, cache_size);
+
+	return 0;
+}
+
+/**
+ * @brief The memory held by a built ESA, excluding the string.
+ *
+ * @param C - The ESA.
+ * @returns the number of bytes.
+ */
+size_t esa_size(const esa_s *C) {
+	size_t len = C->len;
+	return len * sizeof(saidx_t) + 2 * (len + 1) * sizeof(saidx_t) + len +
+		   (1 << (2 * CACHE_LENGTH)) * sizeof(lcp_inter_t);
+}
+
+/**
+ * @brief Predict the peak memory needed to build an ESA.
+ *
+ * This mirrors the allocations of esa_init(), including the temporary arrays
+ * of the LCP and CLD construction. The string itself is not included.
+ *
+ * @param len - The length of the string to index, i.e. `RSlen`.
+ * @returns the peak number of bytes.
+ */
+size_t esa_memory(size_t len) {
+	size_t SA = len * sizeof(saidx_t);
+	size_t LCP = (len + 1) * sizeof(saidx_t);
+	size_t PHI = len * sizeof(saidx_t);
+	size_t CLD = (len + 1) * sizeof(saidx_t);
+	size_t stack = (len + 1) * 2 * sizeof(saidx_t);
+	size_t FVC = len;
+	size_t cache = (1 << (2 * CACHE_LENGTH)) * sizeof(lcp_inter_t);
+
+	size_t peak = SA + LCP + PHI;
+	if (SA + LCP + CLD + stack > peak) peak = SA + LCP + CLD + stack;
+	if (SA + LCP + CLD + FVC + cache > peak) {
+		peak = SA + LCP + CLD + FVC + cache;
+	}
+
+	return peak;
+}
+
 /**
  * Computes the SA given a string S. To do so it uses libdivsufsort.
  * @param C The enhanced suffix array to use. Reads C->S, fills C->SA.
@@ -297,8 +411,9 @@ int esa_init_SA(esa_s *C) {
 		return 1;
 	}
 
-	C->SA = malloc(C->len * sizeof(*C->SA));
+	C->SA = mem_alloc_pages(C->len * sizeof(*C->SA));
 	CHECK_MALLOC(C->SA);
+	mem_add(MEM_SA, C->len * sizeof(*C->SA));
 
 	return divsufsort((const unsigned char *)C->S, C->SA, C->len);
 }
@@ -313,8 +428,9 @@ int esa_init_CLD(esa_s *C) {
 	if (!C || !C->LCP) {
 		return 1;
 	}
-	saidx_t *CLD = C->CLD = malloc((C->len + 1) * sizeof(*CLD));
+	saidx_t *CLD = C->CLD = mem_alloc_pages((C->len + 1) * sizeof(*CLD));
 	CHECK_MALLOC(CLD);
+	mem_add(MEM_CLD, (C->len + 1) * sizeof(*CLD));
 
 	const saidx_t *LCP = C->LCP;
 
@@ -324,6 +440,7 @@ int esa_init_CLD(esa_s *C) {
 
 	pair_t *stack = malloc((C->len + 1) * sizeof(*stack));
 	CHECK_MALLOC(stack);
+	mem_add(MEM_CLD, (C->len + 1) * sizeof(*stack));
 	pair_t *top = stack; // points at the topmost filled element
 	pair_t last;
 
@@ -359,6 +476,7 @@ int esa_init_CLD(esa_s *C) {
 	}
 
 	free(stack);
+	mem_sub(MEM_CLD, (C->len + 1) * sizeof(*stack));
 	return 0;
 }
 
@@ -382,8 +500,9 @@ int esa_init_LCP(esa_s *C) {
 
 	// Allocate new memory
 	// The LCP array is one element longer than S.
-	saidx_t *LCP = C->LCP = malloc((len + 1) * sizeof(*LCP));
+	saidx_t *LCP = C->LCP = mem_alloc_pages((len + 1) * sizeof(*LCP));
 	CHECK_MALLOC(LCP);
+	mem_add(MEM_LCP, (len + 1) * sizeof(*LCP));
 
 	LCP[0] = -1;
 	LCP[len] = -1;
@@ -392,6 +511,7 @@ int esa_init_LCP(esa_s *C) {
 	saidx_t *PHI = malloc(len * sizeof(*PHI));
 	saidx_t *PLCP = PHI;
 	CHECK_MALLOC(PHI);
+	mem_add(MEM_LCP, len * sizeof(*PHI));
 
 	PHI[SA[0]] = -1;
 	saidx_t k;
@@ -422,6 +542,7 @@ int esa_init_LCP(esa_s *C) {
 	}
 
 	free(PHI);
+	mem_sub(MEM_LCP, len * sizeof(*PHI));
 	return 0;
 }
 
@@ -447,6 +568,9 @@ static lcp_inter_t get_interval(const esa_s *self, lcp_inter_t ij, char a) {
 	const char *S = self->S;
 	const saidx_t *CLD = self->CLD;
 	const char *FVC = self->FVC;
+
+	COUNT(get_interval);
+
 	// check for singleton or empty interval
 	if (i == j) {
 		if (S[SA[i] + ij.l] != a) {
@@ -465,6 +589,7 @@ static lcp_inter_t get_interval(const esa_s *self, lcp_inter_t ij, char a) {
 		c = FVC[i];
 
 	SoSueMe:
+		COUNT(get_interval_iterations);
 		if (c == a) {
 			/* found ! */
 
@@ -634,7 +759,12 @@ lcp_inter_t get_match(const esa_s *C, const char *query, size_t qlen) {
  * @returns The LCP interval for the longest prefix.
  */
 lcp_inter_t get_match_cached(const esa_s *C, const char *query, size_t qlen) {
-	if (qlen <= CACHE_LENGTH) return get_match(C, query, qlen);
+	COUNT(get_match_cached);
+
+	if (qlen <= CACHE_LENGTH) {
+		COUNT(cache_fallbacks);
+		return get_match(C, query, qlen);
+	}
 
 	ssize_t offset = 0;
 	for (size_t i = 0; i < CACHE_LENGTH && offset >= 0; i++) {
@@ -643,14 +773,17 @@ lcp_inter_t get_match_cached(const esa_s *C, const char *query, size_t qlen) {
 	}
 
 	if (offset < 0) {
+		COUNT(cache_fallbacks);
 		return get_match(C, query, qlen);
 	}
 
 	lcp_inter_t ij = C->cache[offset];
 
 	if (ij.i == -1 && ij.j == -1) {
+		COUNT(cache_fallbacks);
 		return get_match(C, query, qlen);
 	}
 
+	COUNT(cache_hits);
 	return get_match_from(C, query, qlen, ij.l, ij);
 }
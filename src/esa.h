@@ -58,10 +58,16 @@ typedef struct esa_s {
 	saidx_t *CLD;
 } esa_s;
 
+/** The prefix length up to which lcp-intervals are cached. */
+extern const size_t CACHE_LENGTH;
+
 lcp_inter_t get_match_cached(const esa_s *, const char *query, size_t qlen);
 lcp_inter_t get_match(const esa_s *, const char *query, size_t qlen);
 int esa_init(esa_s *, const seq_subject *S);
 void esa_free(esa_s *);
+int esa_clone(esa_s *, const esa_s *src, const char *S);
+size_t esa_size(const esa_s *);
+size_t esa_memory(size_t len);
 
 #ifdef DEBUG
 
@@ -0,0 +1,19 @@
+/**
+ * @file
+ * @brief Global variables
+ *
+ * The definitions of the variables declared in global.h. They are part of
+ * libandi, so the library and the command line tool share them.
+ */
+#include "global.h"
+
+int FLAGS = 0;
+int THREADS = 1;
+long unsigned int BOOTSTRAP = 0;
+double ANCHOR_P_VALUE = 0.025;
+gsl_rng *RNG = NULL;
+int MODEL = M_JC;
+double PREFILTER_THRESHOLD = 0.0007;
+double MIN_COVERAGE = 0.0;
+size_t SAMPLE_WINDOWS = 0;
+size_t SAMPLE_LENGTH = 10000;
@@ -10,6 +10,7 @@
 #include <gsl/gsl_rng.h>
 
 #include "config.h"
+#include "mem.h"
 #include <err.h>
 
 /**
@@ -47,6 +48,28 @@ extern gsl_rng *RNG;
  */
 extern int MODEL;
 
+/**
+ * With `--prefilter`, pairs whose k-mer containment is significantly below this
+ * value in both directions are not compared. The default of about 0.65^17
+ * corresponds to a distance of 0.35; beyond it, andi covers less than a fifth
+ * of genomes of a few megabases.
+ */
+extern double PREFILTER_THRESHOLD;
+
+/**
+ * With `--min-coverage`, comparisons predicted to end below this coverage are
+ * aborted. Zero compares all pairs completely.
+ */
+extern double MIN_COVERAGE;
+
+/**
+ * With `--sample`, only ::SAMPLE_WINDOWS windows of ::SAMPLE_LENGTH
+ * nucleotides of each query are compared. Zero windows compare the complete
+ * queries.
+ */
+extern size_t SAMPLE_WINDOWS;
+extern size_t SAMPLE_LENGTH;
+
 enum { M_RAW, M_JC, M_KIMURA, M_LOGDET };
 
 /**
@@ -63,17 +86,32 @@ enum {
 	F_LOW_MEMORY = 32,
 	F_SHORT = 64,
 	F_PRINT_PROGRESS = 128,
-	F_SOFT_ERROR = 256
+	F_SOFT_ERROR = 256,
+	F_STATS = 512,
+	F_PAIR_STATS = 1024,
+	F_TRACE = 2048,
+	F_PERF = 4096,
+	F_PREFILTER = 8192,
+	F_PROFILE = 16384,
+	F_GENERALIZED = 32768,
+	F_PACKED = 65536,
+	F_NUMA = 131072,
+	F_WALK = 262144,
+	F_SOFT_INDEX = 524288
 };
 
 /**
  * @brief This macro is used to unify the checks for the return value of malloc.
+ * On failure, the memory used by each component is printed before exiting.
  *
  * @param PTR - The pointer getting checked.
  */
 #define CHECK_MALLOC(PTR)                                                      \
 	do {                                                                       \
 		if (PTR == NULL) {                                                     \
+			int errnum = errno;                                                \
+			mem_print(stderr);                                                 \
+			errno = errnum;                                                    \
 			err(errno, "Out of memory");                                       \
 		}                                                                      \
 	} while (0)
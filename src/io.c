@@ -16,6 +16,7 @@
 
 #include "global.h"
 #include "io.h"
+#include "stats.h"
 
 /**
  * @brief Access an element.
@@ -212,7 +213,10 @@ void read_fasta(const char *file_name, dsa_t *dsa) {
 
 	seq_t top = {};
 	while (!pp.done) {
+		struct stats_timer timer = stats_begin();
 		struct pfasta_record pr = pfasta_read(&pp);
+		stats_end(PH_PARSE, &timer);
+
 		if (pp.errstr) {
 			soft_errx("%s: %s", file_name, pp.errstr);
 			goto fail;
@@ -232,6 +236,31 @@ fail:
 	close(file_descriptor);
 }
 
+/**
+ * @brief Prints a matrix of distances in PHYLIP format.
+ *
+ * @param DD - The distances.
+ * @param sequences - An array of pointers to the sequences.
+ * @param n - The number of sequences.
+ * @param use_scientific - Use scientific notation for all distances.
+ */
+static void print_matrix(const double *DD, const seq_t *sequences, size_t n,
+						 int use_scientific) {
+	printf("%zu\n", n);
+	for (size_t i = 0; i < n; i++) {
+		// Print ten characters of the name. Pad with spaces, if
+		// necessary. Truncate to exactly ten characters if requested by user.
+		printf(FLAGS & F_TRUNCATE_NAMES ? "%-10.10s" : "%-10s",
+			   sequences[i].name);
+
+		for (size_t j = 0; j < n; j++) {
+			// use scientific notation for small numbers
+			printf(use_scientific ? " %1.4e" : " %1.4f", DD[i * n + j]);
+		}
+		printf("\n");
+	}
+}
+
 /**
  * @brief Prints the distance matrix.
  *
@@ -247,9 +276,11 @@ void print_distances(const struct model *D, const seq_t *sequences, size_t n,
 					 int warnings) {
 	size_t i, j;
 	int use_scientific = 0;
+	size_t skipped = 0;
 
 	double *DD = malloc(n * n * sizeof(*DD));
 	CHECK_MALLOC(DD);
+	mem_add(MEM_DISTANCES, n * n * sizeof(*DD));
 
 #define DD(X, Y) (DD[(X)*n + (Y)])
 
@@ -276,6 +307,14 @@ void print_distances(const struct model *D, const seq_t *sequences, size_t n,
 
 			double dist = DD(i, j) = i == j ? 0.0 : estimate(&datum);
 
+			// The prefilter and --min-coverage leave unrelated pairs empty.
+			// If only one direction is empty, the pair is still missing.
+			if (i != j && (D(i, j).seq_len == 0 || D(j, i).seq_len == 0)) {
+				DD(i, j) = NAN;
+				skipped += i < j;
+				continue;
+			}
+
 			if (dist > 0 && dist < 0.001) {
 				use_scientific = 1;
 			}
@@ -303,21 +342,67 @@ void print_distances(const struct model *D, const seq_t *sequences, size_t n,
 		}
 	}
 
-	printf("%zu\n", n);
-	for (i = 0; i < n; i++) {
-		// Print ten characters of the name. Pad with spaces, if
-		// necessary. Truncate to exactly ten characters if requested by user.
-		printf(FLAGS & F_TRUNCATE_NAMES ? "%-10.10s" : "%-10s",
-			   sequences[i].name);
+	if (skipped && warnings) {
+		warnx("For %zu pairs of sequences too little homology was predicted. "
+			  "They were not compared and are reported as nan.",
+			  skipped);
+	}
 
-		for (j = 0; j < n; j++) {
-			// use scientific notation for small numbers
-			printf(use_scientific ? " %1.4e" : " %1.4f", DD(i, j));
+	print_matrix(DD, sequences, n, use_scientific);
+
+	free(DD);
+	mem_sub(MEM_DISTANCES, n * n * sizeof(*DD));
+}
+
+/**
+ * @brief Prints the confidence intervals of sampled distances.
+ *
+ * Two further matrices are printed in the same format as the distances: the
+ * lower and the upper bound of the 95% interval. The variance of a distance
+ * is the mean of the jackknife variances of both directions, halved.
+ *
+ * @param D - The distance matrix
+ * @param V - The variances of the distances, in the same layout as D.
+ * @param sequences - An array of pointers to the sequences.
+ * @param n - The number of sequences.
+ */
+void print_intervals(const struct model *D, const double *V,
+					 const seq_t *sequences, size_t n) {
+	double *lower = malloc(n * n * sizeof(*lower));
+	double *upper = malloc(n * n * sizeof(*upper));
+	CHECK_MALLOC(lower);
+	CHECK_MALLOC(upper);
+	mem_add(MEM_DISTANCES, 2 * n * n * sizeof(*lower));
+
+	int use_scientific = 0;
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = 0; j < n; j++) {
+			size_t ij = i * n + j, ji = j * n + i;
+			if (i == j) {
+				lower[ij] = upper[ij] = 0.0;
+				continue;
+			}
+
+			model datum = model_average(&D[ij], &D[ji]);
+			double dist = model_estimate(&datum, MODEL);
+			double error = 1.96 * sqrt((V[ij] + V[ji]) / 4);
+
+			// Keep nan, unlike fmax().
+			lower[ij] = dist - error < 0.0 ? 0.0 : dist - error;
+			upper[ij] = dist + error;
+
+			if (lower[ij] > 0 && lower[ij] < 0.001) {
+				use_scientific = 1;
+			}
 		}
-		printf("\n");
 	}
 
-	free(DD);
+	print_matrix(lower, sequences, n, use_scientific);
+	print_matrix(upper, sequences, n, use_scientific);
+
+	free(lower);
+	free(upper);
+	mem_sub(MEM_DISTANCES, 2 * n * n * sizeof(*lower));
 }
 
 /**
@@ -22,6 +22,8 @@ void read_fasta_join(const char *, dsa_t *dsa);
 
 void print_distances(const struct model *, const seq_t *, size_t, int);
 void print_coverages(const struct model *, size_t);
+void print_intervals(const struct model *, const double *, const seq_t *,
+					 size_t);
 
 /**
  * @brief A dynamically growing structure for file_names.
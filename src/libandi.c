@@ -0,0 +1,313 @@
+/**
+ * @file
+ * @brief The public interface of libandi
+ *
+ * These functions translate between the public types and the internal ones.
+ * An index keeps its options, so the options of indexes do not go through the
+ * global variables. andi_compare_all() sets them from the options. The work
+ * itself is done by the same code as in the andi program, which is why the
+ * library is not thread-safe.
+ */
+#define _GNU_SOURCE
+#include "libandi.h"
+#include "esa.h"
+#include "global.h"
+#include "model.h"
+#include "process.h"
+#include "sequence.h"
+#include <limits.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+_Static_assert((int)ANDI_MODEL_RAW == M_RAW && (int)ANDI_MODEL_JC == M_JC &&
+				   (int)ANDI_MODEL_KIMURA == M_KIMURA &&
+				   (int)ANDI_MODEL_LOGDET == M_LOGDET,
+			   "The public models must match the internal ones.");
+_Static_assert(sizeof(((struct andi_counts *)0)->substitutions) ==
+				   sizeof(((model *)0)->counts),
+			   "The public counts must match the internal ones.");
+
+/**
+ * @brief An indexed sequence.
+ */
+struct andi_index {
+	/** The normalized sequence, used when this is the query. */
+	seq_t seq;
+	/** Both strands. */
+	seq_subject subject;
+	esa_s E;
+	/** The model determines how matching nucleotides are counted. */
+	int model;
+};
+
+/** @brief Set the global variables from the options. */
+static void libandi_apply(const struct andi_options *options) {
+	struct andi_options defaults;
+	if (!options) {
+		andi_options_init(&defaults);
+		options = &defaults;
+	}
+
+	ANCHOR_P_VALUE = options->p_value;
+	MODEL = options->model;
+	THREADS = options->threads;
+#ifdef _OPENMP
+	if (THREADS <= 0) {
+		THREADS = omp_get_num_procs();
+	}
+#else
+	THREADS = 1;
+#endif
+
+	// A subject without an index must not terminate the host.
+	FLAGS &= ~(F_LOW_MEMORY | F_PRINT_PROGRESS);
+	FLAGS |= F_SOFT_INDEX;
+	if (options->low_memory) {
+		FLAGS |= F_LOW_MEMORY;
+	}
+}
+
+/**
+ * @brief Normalize a sequence.
+ *
+ * @param S - (output parameter) The sequence.
+ * @param residues - The residues; not necessarily null-terminated.
+ * @param length - The number of residues.
+ * @param name - The name.
+ * @returns 0 iff the sequence is usable.
+ */
+static int libandi_sequence(seq_t *S, const char *residues, size_t length,
+							const char *name) {
+	char *copy = strndup(residues, length);
+	CHECK_MALLOC(copy);
+
+	int check = seq_init(S, copy, name ? name : "");
+	free(copy);
+	if (check) return 1;
+
+	const size_t LENGTH_LIMIT = (INT_MAX - 1) / 2;
+	if (S->len == 0 || S->len > LENGTH_LIMIT) {
+		seq_free(S);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Initialise the options with the defaults of andi.
+ *
+ * @param options - The options.
+ */
+void andi_options_init(struct andi_options *options) {
+	*options = (struct andi_options){.p_value = 0.025,
+									 .model = ANDI_MODEL_JC,
+									 .threads = 0,
+									 .low_memory = 0};
+}
+
+/**
+ * @brief Build the index of a sequence.
+ *
+ * The index can be used as subject and as query of andi_index_compare(), and
+ * any number of times.
+ *
+ * @param residues - The sequence.
+ * @param length - The length of the sequence.
+ * @param options - The options; NULL for the defaults.
+ * @returns the index, or NULL if the sequence is empty or too long.
+ */
+andi_index *andi_index_new(const char *residues, size_t length,
+						   const struct andi_options *options) {
+	if (!residues) return NULL;
+
+	struct andi_options defaults;
+	if (!options) {
+		andi_options_init(&defaults);
+		options = &defaults;
+	}
+
+	andi_index *index = malloc(sizeof(*index));
+	CHECK_MALLOC(index);
+	index->model = options->model;
+
+	if (libandi_sequence(&index->seq, residues, length, "")) {
+		free(index);
+		return NULL;
+	}
+
+	if (seq_subject_init(&index->subject, &index->seq)) {
+		seq_free(&index->seq);
+		free(index);
+		return NULL;
+	}
+
+	// Use the p-value of the options, not the global one.
+	index->subject.threshold =
+		min_anchor_length(options->p_value, index->subject.gc,
+						  index->subject.RSlen);
+
+	if (esa_init(&index->E, &index->subject)) {
+		esa_free(&index->E);
+		seq_subject_free(&index->subject);
+		seq_free(&index->seq);
+		free(index);
+		return NULL;
+	}
+
+	return index;
+}
+
+/** @brief Free an index. */
+void andi_index_free(andi_index *index) {
+	if (!index) return;
+
+	esa_free(&index->E);
+	seq_subject_free(&index->subject);
+	seq_free(&index->seq);
+	free(index);
+}
+
+/**
+ * @brief Match the sequence of a query against a subject.
+ *
+ * For a distance, compare both ways and pass both results to andi_distance().
+ * The model of the subject is used.
+ *
+ * @param subject - The subject.
+ * @param query - The query.
+ * @param counts - (output parameter) The result.
+ * @returns 0 iff successful.
+ */
+int andi_index_compare(const andi_index *subject, const andi_index *query,
+					   struct andi_counts *counts) {
+	if (!subject || !query || !counts) return 1;
+
+	model datum =
+		dist_anchor_profile(&subject->E, query->seq.S, query->seq.len,
+							subject->subject.threshold, subject->model, NULL,
+							NULL);
+
+	memcpy(counts->substitutions, datum.counts, sizeof(datum.counts));
+	counts->length = datum.seq_len;
+	return 0;
+}
+
+/**
+ * @brief The state of andi_compare_all().
+ */
+struct libandi_all {
+	andi_callback callback;
+	void *user_data;
+	/** The number of pairs that could not be compared. */
+	size_t failed;
+};
+
+/** @brief Hand a result to the user. */
+static void libandi_store(size_t subject, size_t query,
+						  const struct model *datum,
+						  const struct dist_info *info, void *data) {
+	(void)info;
+	struct libandi_all *all = data;
+	struct andi_result result = {.subject = subject, .query = query};
+
+	memcpy(result.counts.substitutions, datum->counts, sizeof(datum->counts));
+	result.counts.length = datum->seq_len;
+
+#pragma omp critical(libandi)
+	{
+		// Only pairs of a subject without an index are empty.
+		if (datum->seq_len == 0) all->failed++;
+		all->callback(&result, all->user_data);
+	}
+}
+
+/**
+ * @brief Compare all sequences against each other.
+ *
+ * For each ordered pair of distinct sequences, the second is matched against
+ * the index of the first, and the result is handed to the callback. The
+ * parallelization follows the options. No matrix is allocated.
+ *
+ * @param sequences - The sequences.
+ * @param n - The number of sequences.
+ * @param options - The options; NULL for the defaults.
+ * @param callback - Receives each result.
+ * @param user_data - Passed on to the callback.
+ * @returns 0 iff successful; fails on an empty or too long sequence, and if
+ * an index could not be built. The pairs of such a subject are still handed to
+ * the callback, with a length of zero.
+ */
+int andi_compare_all(const struct andi_sequence *sequences, size_t n,
+					 const struct andi_options *options, andi_callback callback,
+					 void *user_data) {
+	if ((!sequences && n) || !callback) return 1;
+
+	libandi_apply(options);
+
+	seq_t *seqs = malloc(n * sizeof(*seqs));
+	CHECK_MALLOC(seqs);
+
+	for (size_t i = 0; i < n; i++) {
+		if (libandi_sequence(&seqs[i], sequences[i].residues,
+							 sequences[i].length, sequences[i].name)) {
+			while (i--) {
+				seq_free(&seqs[i]);
+			}
+			free(seqs);
+			return 1;
+		}
+	}
+
+	struct libandi_all all = {callback, user_data, 0};
+	dist_all(seqs, n, libandi_store, &all);
+
+	for (size_t i = 0; i < n; i++) {
+		seq_free(&seqs[i]);
+	}
+	free(seqs);
+	return all.failed ? 1 : 0;
+}
+
+/**
+ * @brief The fraction of the query covered by anchors.
+ *
+ * @param counts - A result.
+ * @returns the coverage.
+ */
+double andi_coverage(const struct andi_counts *counts) {
+	model datum = {.seq_len = counts->length};
+	memcpy(datum.counts, counts->substitutions, sizeof(datum.counts));
+	return model_coverage(&datum);
+}
+
+/**
+ * @brief Estimate the distance of two sequences.
+ *
+ * The results of both directions are averaged, as andi does. Use the same
+ * model as for the comparison.
+ *
+ * @param forward - The result of one direction.
+ * @param backward - The result of the other direction.
+ * @param model - The evolutionary model.
+ * @returns the distance; NaN if it cannot be estimated.
+ */
+double andi_distance(const struct andi_counts *forward,
+					 const struct andi_counts *backward,
+					 enum andi_model model) {
+	struct model a = {.seq_len = forward->length};
+	struct model b = {.seq_len = backward->length};
+	memcpy(a.counts, forward->substitutions, sizeof(a.counts));
+	memcpy(b.counts, backward->substitutions, sizeof(b.counts));
+
+	struct model datum = model_average(&a, &b);
+	return model_estimate(&datum, model);
+}
+
+/** @brief The version of andi. */
+const char *andi_version(void) {
+	return VERSION;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file
+ * @brief The public interface of libandi
+ *
+ * libandi estimates evolutionary distances between closely related genomes,
+ * just like the andi program, but without any files or text in between.
+ * Sequences are passed as strings in memory. An index can be built once and
+ * compared against many queries. For a whole set of sequences, every result is
+ * handed to a callback as soon as it is computed.
+ *
+ * Link with `-landi -ldivsufsort -lgsl -lgslcblas -lm` and the OpenMP flag of
+ * your compiler.
+ *
+ * The library is NOT thread-safe. No two calls may run at the same time, not
+ * even on different indexes, neither from threads of the host program nor
+ * from OpenMP threads. A multi-threaded host has to serialize all calls, for
+ * instance with a mutex. The calls share internal state: global flags set by
+ * the normalization, and statistics kept per OpenMP thread number, so that
+ * all threads of the host would use the same slot. Instead, andi_compare_all()
+ * runs in parallel itself; see `threads` of ::andi_options.
+ *
+ * An index keeps the options it was built with, so indexes of different
+ * options can be compared with each other. A failure to build an index is
+ * reported, not fatal. Only running out of memory terminates the process.
+ *
+ * Only the `andi_` symbols are exported; all internals are local to the
+ * library.
+ */
+#ifndef _LIBANDI_H_
+#define _LIBANDI_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The version of this interface. It changes with incompatible changes. */
+#define ANDI_API_VERSION 1
+
+/**
+ * @brief The evolutionary models.
+ */
+enum andi_model {
+	/** Uncorrected substitution rate. */
+	ANDI_MODEL_RAW,
+	/** Jukes-Cantor correction; the default. */
+	ANDI_MODEL_JC,
+	/** Kimura two-parameter model. */
+	ANDI_MODEL_KIMURA,
+	/** Logarithmic determinant. */
+	ANDI_MODEL_LOGDET
+};
+
+/**
+ * @brief The options of a computation. Initialise with andi_options_init().
+ */
+struct andi_options {
+	/** The significance of an anchor; see `-p`. */
+	double p_value;
+	/** The model used by andi_distance() of andi_compare_all() results. */
+	enum andi_model model;
+	/** The number of threads; zero uses all processors. */
+	int threads;
+	/** Use the parallelization of `--low-memory`. */
+	int low_memory;
+};
+
+/**
+ * @brief A sequence in memory.
+ *
+ * Characters other than `ACGTacgt` are ignored.
+ */
+struct andi_sequence {
+	const char *name;
+	const char *residues;
+	size_t length;
+};
+
+/**
+ * @brief The result of matching a query against a subject.
+ *
+ * The substitutions are indexed by `4 * from + to` in the order ACGT, with
+ * `from` on the subject and `to` on the query.
+ */
+struct andi_counts {
+	unsigned int substitutions[16];
+	/** The length of the query. */
+	unsigned int length;
+};
+
+/**
+ * @brief A single comparison of andi_compare_all().
+ */
+struct andi_result {
+	/** The position of the subject in the given sequences. */
+	size_t subject;
+	/** The position of the query in the given sequences. */
+	size_t query;
+	struct andi_counts counts;
+};
+
+/**
+ * @brief Receives each result of andi_compare_all().
+ *
+ * The callback is called from several threads, but never concurrently.
+ */
+typedef void (*andi_callback)(const struct andi_result *result,
+							  void *user_data);
+
+/** @brief The index of a sequence. */
+typedef struct andi_index andi_index;
+
+void andi_options_init(struct andi_options *options);
+
+andi_index *andi_index_new(const char *residues, size_t length,
+						   const struct andi_options *options);
+void andi_index_free(andi_index *index);
+int andi_index_compare(const andi_index *subject, const andi_index *query,
+					   struct andi_counts *counts);
+
+int andi_compare_all(const struct andi_sequence *sequences, size_t n,
+					 const struct andi_options *options, andi_callback callback,
+					 void *user_data);
+
+double andi_coverage(const struct andi_counts *counts);
+double andi_distance(const struct andi_counts *forward,
+					 const struct andi_counts *backward, enum andi_model model);
+
+const char *andi_version(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _LIBANDI_H_
@@ -0,0 +1,242 @@
+/**
+ * @file
+ * @brief Accounting of the big allocations
+ *
+ * Only a handful of allocations per subject are accounted. Thus a critical
+ * section is cheap enough and keeps the current values and the peaks
+ * consistent.
+ *
+ * The arrays of an index may also be backed by huge pages. Such arrays are
+ * mapped directly, so that their memory is returned to the system when the
+ * index is freed.
+ */
+#include "mem.h"
+#include "global.h"
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+/** The size of a huge page. Smaller arrays are allocated regularly. */
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+/** @brief The names of the components as used in reports. */
+static const char *COMPONENT_NAMES[MEM_COUNT] = {
+	"sequences", "RS",	"SA",	  "LCP",	   "CLD",
+	"FVC",		 "cache", "matrix", "distances", "bootstrap", "sketches",
+	"ranks"};
+
+static size_t CURRENT[MEM_COUNT];
+static size_t PEAK[MEM_COUNT];
+static size_t CURRENT_TOTAL = 0;
+static size_t PEAK_TOTAL = 0;
+
+static enum mem_pages PAGES = MEM_PAGES_DEFAULT;
+static const char *PAGES_NAMES[] = {"default", "thp", "hugetlb"};
+
+/** The bytes mapped from the hugetlb pool and with transparent huge pages. */
+static size_t HUGETLB_BYTES = 0;
+static size_t THP_BYTES = 0;
+static int HUGETLB_FAILED = 0;
+
+/**
+ * @brief Account an allocation.
+ *
+ * @param component - The owner of the memory.
+ * @param bytes - The size of the allocation.
+ */
+void mem_add(enum mem_component component, size_t bytes) {
+#pragma omp critical(mem)
+	{
+		CURRENT[component] += bytes;
+		if (CURRENT[component] > PEAK[component]) {
+			PEAK[component] = CURRENT[component];
+		}
+
+		CURRENT_TOTAL += bytes;
+		if (CURRENT_TOTAL > PEAK_TOTAL) {
+			PEAK_TOTAL = CURRENT_TOTAL;
+		}
+	}
+}
+
+/**
+ * @brief Account the release of an allocation.
+ *
+ * @param component - The owner of the memory.
+ * @param bytes - The size of the allocation.
+ */
+void mem_sub(enum mem_component component, size_t bytes) {
+#pragma omp critical(mem)
+	{
+		CURRENT[component] -= bytes < CURRENT[component] ? bytes
+														  : CURRENT[component];
+		CURRENT_TOTAL -= bytes < CURRENT_TOTAL ? bytes : CURRENT_TOTAL;
+	}
+}
+
+/**
+ * @brief Get the peak resident set size of the process.
+ *
+ * @returns the size in bytes, or zero if unknown.
+ */
+size_t mem_peak_rss(void) {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+/**
+ * @brief Print a human-readable table of all components.
+ *
+ * This is called when an allocation fails, so it must not allocate itself.
+ *
+ * @param file - The file to print to.
+ */
+void mem_print(FILE *file) {
+	const double MiB = 1024.0 * 1024.0;
+
+	fprintf(file, "Memory by component (current / peak in MiB):\n");
+	for (int k = 0; k < MEM_COUNT; k++) {
+		fprintf(file, "  %-10s %10.1f / %10.1f\n", COMPONENT_NAMES[k],
+				CURRENT[k] / MiB, PEAK[k] / MiB);
+	}
+	fprintf(file, "  %-10s %10.1f / %10.1f\n", "total", CURRENT_TOTAL / MiB,
+			PEAK_TOTAL / MiB);
+	fprintf(file, "  peak RSS: %.1f MiB\n", mem_peak_rss() / MiB);
+}
+
+/**
+ * @brief Print all components as a JSON object.
+ *
+ * @param file - The file to print to.
+ * @param indent - The indentation of the object.
+ */
+void mem_write_json(FILE *file, const char *indent) {
+	fprintf(file, "{\n");
+	fprintf(file, "%s\t\"peak_rss\": %zu,\n", indent, mem_peak_rss());
+	fprintf(file, "%s\t\"peak\": %zu,\n", indent, PEAK_TOTAL);
+	fprintf(file, "%s\t\"pages\": \"%s\",\n", indent, PAGES_NAMES[PAGES]);
+	fprintf(file, "%s\t\"mapped_hugetlb\": %zu,\n", indent, HUGETLB_BYTES);
+	fprintf(file, "%s\t\"mapped_thp\": %zu,\n", indent, THP_BYTES);
+	fprintf(file, "%s\t\"components\": {\n", indent);
+	for (int k = 0; k < MEM_COUNT; k++) {
+		fprintf(file, "%s\t\t\"%s\": {\"current\": %zu, \"peak\": %zu}%s\n",
+				indent, COMPONENT_NAMES[k], CURRENT[k], PEAK[k],
+				k + 1 < MEM_COUNT ? "," : "");
+	}
+	fprintf(file, "%s\t}\n", indent);
+	fprintf(file, "%s}", indent);
+}
+
+/**
+ * @brief Select how the arrays of an index are backed.
+ *
+ * This has to be called before any index is built, as mem_free_pages() relies
+ * on the same setting as the allocation.
+ *
+ * @param pages - The kind of pages.
+ */
+void mem_set_pages(enum mem_pages pages) {
+	PAGES = pages;
+}
+
+/**
+ * @brief Map anonymous memory aligned to a huge page.
+ *
+ * Only aligned huge pages can back a mapping. So a bit more is mapped and the
+ * excess at both ends is returned right away.
+ */
+static void *mem_map_aligned(size_t size) {
+	size_t span = size + HUGE_PAGE_SIZE;
+	char *raw = mmap(NULL, span, PROT_READ | PROT_WRITE,
+					 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED) return NULL;
+
+	uintptr_t mask = HUGE_PAGE_SIZE - 1;
+	char *aligned = (char *)(((uintptr_t)raw + mask) & ~mask);
+	size_t head = aligned - raw;
+	size_t tail = span - head - size;
+	if (head) munmap(raw, head);
+	if (tail) munmap(aligned + size, tail);
+
+	return aligned;
+}
+
+/**
+ * @brief Allocate a large array, possibly backed by huge pages.
+ *
+ * Arrays smaller than a huge page are always allocated with malloc(). The
+ * memory is not accounted; see mem_add().
+ *
+ * @param bytes - The size of the array.
+ * @returns the array, or NULL if the allocation failed.
+ */
+void *mem_alloc_pages(size_t bytes) {
+	if (PAGES == MEM_PAGES_DEFAULT || bytes < HUGE_PAGE_SIZE) {
+		return malloc(bytes);
+	}
+
+	size_t size = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+#ifdef MAP_HUGETLB
+	if (PAGES == MEM_PAGES_HUGETLB) {
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_2MB
+		flags |= MAP_HUGE_2MB;
+#endif
+		void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (ptr != MAP_FAILED) {
+#pragma omp atomic update
+			HUGETLB_BYTES += size;
+			return ptr;
+		}
+
+		int warn = 0;
+#pragma omp critical(mem)
+		{
+			warn = !HUGETLB_FAILED;
+			HUGETLB_FAILED = 1;
+		}
+		if (warn) {
+			warnx("The hugetlb pool is exhausted; using transparent huge "
+				  "pages instead. See /proc/sys/vm/nr_hugepages.");
+		}
+	}
+#endif
+
+	void *ptr = mem_map_aligned(size);
+	if (!ptr) return NULL;
+
+#ifdef MADV_HUGEPAGE
+	// Without THP support, the regular pages still work.
+	madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+
+#pragma omp atomic update
+	THP_BYTES += size;
+	return ptr;
+}
+
+/**
+ * @brief Free an array allocated by mem_alloc_pages().
+ *
+ * @param ptr - The array; may be NULL.
+ * @param bytes - The size as passed to mem_alloc_pages().
+ */
+void mem_free_pages(void *ptr, size_t bytes) {
+	if (!ptr) return;
+
+	if (PAGES == MEM_PAGES_DEFAULT || bytes < HUGE_PAGE_SIZE) {
+		free(ptr);
+		return;
+	}
+
+	munmap(ptr, (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+}
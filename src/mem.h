@@ -0,0 +1,74 @@
+/**
+ * @file
+ * @brief Accounting of the big allocations
+ *
+ * The large data structures of andi register their allocations here. For each
+ * component the number of bytes currently in use and the high-water mark are
+ * tracked. Together with the peak resident set size this shows which structure
+ * exhausted the memory. The components of the index are summed over all
+ * threads.
+ */
+#ifndef _MEM_H_
+#define _MEM_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @brief The accounted components.
+ */
+enum mem_component {
+	/** The residues of all input sequences. */
+	MEM_SEQUENCES,
+	/** The reverse complement and forward strand of subjects. */
+	MEM_RS,
+	/** Suffix arrays. */
+	MEM_SA,
+	/** LCP arrays, including the temporary PHI array. */
+	MEM_LCP,
+	/** Child arrays, including the temporary stack. */
+	MEM_CLD,
+	/** FVC arrays. */
+	MEM_FVC,
+	/** The lcp-interval caches. */
+	MEM_CACHE,
+	/** The matrix of all comparisons, `M`. */
+	MEM_MATRIX,
+	/** The distances as printed, `DD`. */
+	MEM_DISTANCES,
+	/** The bootstrap matrix, `B`. */
+	MEM_BOOTSTRAP,
+	/** The sketches of the prefilter. */
+	MEM_SKETCHES,
+	/** The ranks of the suffixes of each subject of a generalized index. */
+	MEM_RANKS,
+	MEM_COUNT
+};
+
+/**
+ * @brief How the arrays of an index are backed.
+ *
+ * The lookups jump around the arrays of an index. With regular pages, almost
+ * every step misses the TLB. Huge pages of 2 MiB cover the arrays with a few
+ * hundred entries.
+ */
+enum mem_pages {
+	/** Regular allocations. */
+	MEM_PAGES_DEFAULT,
+	/** Anonymous mappings advised to use transparent huge pages. */
+	MEM_PAGES_THP,
+	/** Explicit huge pages from the hugetlb pool; if the pool is exhausted,
+	 * transparent huge pages are used instead. */
+	MEM_PAGES_HUGETLB
+};
+
+void mem_add(enum mem_component, size_t bytes);
+void mem_sub(enum mem_component, size_t bytes);
+size_t mem_peak_rss(void);
+void mem_print(FILE *file);
+void mem_write_json(FILE *file, const char *indent);
+void mem_set_pages(enum mem_pages);
+void *mem_alloc_pages(size_t bytes);
+void mem_free_pages(void *ptr, size_t bytes);
+
+#endif // _MEM_H_
@@ -197,6 +197,23 @@ double estimate_LOGDET(const model *MM) {
 	return dist <= 0.0 ? 0.0 : dist;
 }
 
+/**
+ * @brief Estimate the distance with one of the models.
+ *
+ * @param MM - The mutation matrix.
+ * @param kind - One of `M_RAW`, `M_JC`, `M_KIMURA` or `M_LOGDET`.
+ * @returns The estimated distance.
+ */
+double model_estimate(const model *MM, int kind) {
+	switch (kind) {
+		case M_RAW: return estimate_RAW(MM);
+		case M_KIMURA: return estimate_KIMURA(MM);
+		case M_LOGDET: return estimate_LOGDET(MM);
+		default:
+		case M_JC: return estimate_JC(MM);
+	}
+}
+
 /** @brief Bootstrap a mutation matrix.
  *
  * The classical bootstrapping process, as described by Felsenstein, resamples
@@ -231,9 +248,10 @@ model model_bootstrap(model datum) {
  * @param MM - The mutation matrix
  * @param S - The subject
  * @param len - The anchor length
+ * @param kind - The model the counts are used for
  */
-void model_count_equal(model *MM, const char *S, size_t len) {
-	if (MODEL == M_RAW || MODEL == M_JC || MODEL == M_KIMURA) {
+void model_count_equal(model *MM, const char *S, size_t len, int kind) {
+	if (kind == M_RAW || kind == M_JC || kind == M_KIMURA) {
 		size_t fourth = len / 4;
 		MM->counts[AtoA] += fourth;
 		MM->counts[CtoC] += fourth;
@@ -56,7 +56,7 @@ typedef struct model {
 	unsigned int seq_len;
 } model;
 
-void model_count_equal(model *, const char *, size_t);
+void model_count_equal(model *, const char *, size_t, int kind);
 void model_count(model *, const char *, const char *, size_t);
 model model_average(const model *, const model *);
 double model_coverage(const model *);
@@ -64,4 +64,5 @@ double estimate_RAW(const model *);
 double estimate_JC(const model *);
 double estimate_KIMURA(const model *);
 double estimate_LOGDET(const model *);
+double model_estimate(const model *, int kind);
 model model_bootstrap(model);
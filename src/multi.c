@@ -0,0 +1,262 @@
+/**
+ * @file
+ * @brief A generalized index over many subjects
+ *
+ * In the ESA of a single subject, the longest match of a query is an
+ * lcp-interval, and the match is unique iff the interval is a singleton. In a
+ * generalized ESA, the longest match with one subject may be shorter than the
+ * longest match overall. However, the suffixes of one subject appear in the
+ * generalized suffix array in the same order as in the subject's own. So the
+ * ranks of a subject's suffixes within the interval of the overall match are
+ * its occurrences. If there are none, its longest match is with one of the
+ * two suffixes of the subject next to the interval, just as the query would be
+ * sorted in between them. Both cases need two binary searches on the ranks of
+ * the subject and a few direct comparisons of characters, no matter how many
+ * subjects there are.
+ *
+ * The query itself is a subject, too. Its suffix matches the whole rest of the
+ * query, so that lookups are cut off at the largest anchor length of the
+ * subjects. Matches reaching that depth are extended character by character.
+ */
+#include "multi.h"
+#include "global.h"
+#include "mem.h"
+#include <limits.h>
+#include <string.h>
+
+/**
+ * @brief Build the generalized index of some sequences.
+ *
+ * @param M - (output parameter) The index.
+ * @param sequences - The sequences.
+ * @param subjects - The indices of the sequences to include; the subject `k`
+ * of the index is the sequence `subjects[k]`.
+ * @param n - The number of subjects.
+ * @returns 0 iff successful. On failure, nothing needs to be freed.
+ */
+int multi_init(struct multi_index *M, const seq_t *sequences,
+			   const size_t *subjects, size_t n) {
+	*M = (struct multi_index){.n = n};
+
+	size_t total = 0;
+	for (size_t k = 0; k < n; k++) {
+		total += 2 * sequences[subjects[k]].len + 2;
+	}
+
+	// The suffix array is limited to 32 bit indices.
+	if (n == 0 || total >= INT_MAX) {
+		return 1;
+	}
+
+	M->start = malloc((n + 1) * sizeof(*M->start));
+	M->threshold = malloc(n * sizeof(*M->threshold));
+	char *text = malloc(total + 1);
+	CHECK_MALLOC(M->start);
+	CHECK_MALLOC(M->threshold);
+	CHECK_MALLOC(text);
+	mem_add(MEM_RS, total + 1);
+	M->all = (seq_subject){.RS = text, .RSlen = total};
+
+	size_t pos = 0;
+	for (size_t k = 0; k < n; k++) {
+		seq_subject subject;
+		if (seq_subject_init(&subject, &sequences[subjects[k]])) {
+			multi_free(M);
+			return 1;
+		}
+
+		M->start[k] = pos;
+		M->threshold[k] = subject.threshold;
+		memcpy(text + pos, subject.RS, subject.RSlen);
+		pos += subject.RSlen;
+		text[pos++] = '#';
+
+		seq_subject_free(&subject);
+	}
+	text[total] = '\0';
+	M->start[n] = total;
+
+	if (esa_init(&M->E, &M->all)) {
+		multi_free(M);
+		return 1;
+	}
+
+	M->ranks = malloc(total * sizeof(*M->ranks));
+	CHECK_MALLOC(M->ranks);
+	mem_add(MEM_RANKS, total * sizeof(*M->ranks));
+
+	// Each subject has as many suffixes as characters, including the `#`.
+	size_t *fill = malloc(n * sizeof(*fill));
+	CHECK_MALLOC(fill);
+	memcpy(fill, M->start, n * sizeof(*fill));
+
+	for (size_t r = 0; r < total; r++) {
+		size_t p = M->E.SA[r];
+
+		// Find the last subject starting at or before p.
+		size_t lo = 0, hi = n;
+		while (hi - lo > 1) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (M->start[mid] <= p) {
+				lo = mid;
+			} else {
+				hi = mid;
+			}
+		}
+		M->ranks[fill[lo]++] = r;
+	}
+
+	free(fill);
+	return 0;
+}
+
+/** @brief Free a generalized index. */
+void multi_free(struct multi_index *M) {
+	size_t total = M->all.RSlen;
+
+	esa_free(&M->E);
+	if (M->ranks) mem_sub(MEM_RANKS, total * sizeof(*M->ranks));
+	if (M->all.RS) mem_sub(MEM_RS, total + 1);
+
+	free(M->ranks);
+	free(M->all.RS);
+	free(M->start);
+	free(M->threshold);
+	*M = (struct multi_index){0};
+}
+
+/**
+ * @brief The number of ranks in `R[0..count)` below `rank`.
+ *
+ * The search is branchless. Its steps cannot be predicted anyway, and so
+ * consecutive loads may overlap.
+ */
+static size_t multi_lower_bound(const saidx_t *R, size_t count, saidx_t rank) {
+	const saidx_t *base = R;
+	while (count > 1) {
+		size_t half = count / 2;
+		base = base[half] < rank ? base + half : base;
+		count -= half;
+	}
+	return (base - R) + (count == 1 && *base < rank);
+}
+
+/**
+ * @brief The length of the common prefix of the query and a suffix.
+ *
+ * The comparison starts after `from` characters known to match. The `#` at
+ * the end of each subject stops it.
+ */
+static size_t multi_extend(const char *S, const char *query, size_t qlen,
+						   size_t from) {
+	size_t k = from;
+	while (k < qlen && S[k] == query[k]) {
+		k++;
+	}
+	return k;
+}
+
+/**
+ * @brief Account one occurrence of the match with a subject.
+ *
+ * @param mm - The match so far.
+ * @param pos_S - The position of the occurrence.
+ * @param length - The length of the common prefix with the query.
+ */
+static void multi_add(struct multi_match *mm, size_t pos_S, size_t length) {
+	if (mm->count == 0 || length > mm->length) {
+		*mm = (struct multi_match){pos_S, length, 1};
+	} else if (length == mm->length) {
+		mm->count++;
+	}
+}
+
+/**
+ * @brief Find the longest match of a query with several subjects at once.
+ *
+ * For each subject, the match has the same length as a lookup in the subject's
+ * own ESA would yield. Its occurrences are only counted as far as needed to
+ * tell whether a match long enough for an anchor is unique.
+ *
+ * @param M - The generalized index.
+ * @param query - The query.
+ * @param qlen - The length of the query.
+ * @param subjects - The subjects to match against.
+ * @param count - The number of subjects.
+ * @param matches - (output parameter) The match with each subject.
+ */
+void multi_lookup(const struct multi_index *M, const char *query, size_t qlen,
+				  const size_t *subjects, size_t count,
+				  struct multi_match *matches) {
+	const saidx_t *SA = M->E.SA;
+	const char *S = M->E.S;
+
+	size_t depth = 0;
+	for (size_t k = 0; k < count; k++) {
+		size_t t = M->threshold[subjects[k]];
+		depth = t > depth ? t : depth;
+	}
+	depth = qlen < depth ? qlen : depth;
+	lcp_inter_t ij = get_match_cached(&M->E, query, depth);
+	size_t length = ij.l <= 0 ? 0 : ij.l;
+	int capped = length == depth && depth < qlen;
+
+	for (size_t k = 0; k < count; k++) {
+		size_t s = subjects[k];
+		const saidx_t *R = M->ranks + M->start[s];
+		size_t size = M->start[s + 1] - M->start[s];
+		struct multi_match *mm = &matches[k];
+
+		*mm = (struct multi_match){M->start[s], 0, 0};
+		if (ij.i < 0) continue;
+
+		size_t a = multi_lower_bound(R, size, ij.i);
+
+		if (a < size && R[a] <= ij.j) {
+			// The subject shares the overall match. Only a unique match
+			// matters, so a second occurrence is as good as all of them.
+			if (!capped) {
+				size_t twice = a + 1 < size && R[a + 1] <= ij.j;
+				*mm = (struct multi_match){SA[R[a]], length, 1 + twice};
+				continue;
+			}
+
+			for (size_t x = a; x < size && R[x] <= ij.j; x++) {
+				size_t p = SA[R[x]];
+				multi_add(mm, p, multi_extend(S + p, query, qlen, depth));
+			}
+			continue;
+		}
+
+		// Otherwise the longest match is with a neighbor of the interval.
+		size_t left = 0, right = 0;
+		if (a > 0) {
+			left = multi_extend(S + SA[R[a - 1]], query, qlen, 0);
+		}
+		if (a < size) {
+			right = multi_extend(S + SA[R[a]], query, qlen, 0);
+		}
+		size_t best = left > right ? left : right;
+
+		// Only the occurrences of a potential anchor need to be counted.
+		if (best < M->threshold[s]) {
+			size_t x = left >= right && a > 0 ? a - 1 : a;
+			*mm = (struct multi_match){SA[R[x]], best, 1};
+			continue;
+		}
+
+		for (size_t x = a; x-- > 0;) {
+			size_t p = SA[R[x]];
+			size_t match =
+				x + 1 == a ? left : multi_extend(S + p, query, qlen, 0);
+			if (match < best) break;
+			multi_add(mm, p, match);
+		}
+		for (size_t x = a; x < size; x++) {
+			size_t p = SA[R[x]];
+			size_t match = x == a ? right : multi_extend(S + p, query, qlen, 0);
+			if (match < best) break;
+			multi_add(mm, p, match);
+		}
+	}
+}
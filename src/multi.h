@@ -0,0 +1,63 @@
+/**
+ * @file
+ * @brief A generalized index over many subjects
+ *
+ * Comparing n sequences with one index per subject builds n indexes and scans
+ * every query n-1 times. For many small genomes, the fixed costs of each index
+ * and the repeated scans dominate. Instead, all subjects can be concatenated
+ * into one generalized ESA. The suffixes of each subject are also kept in a
+ * list of their ranks, so that the longest match of a query and its
+ * uniqueness can still be told for every subject on its own. A single lookup
+ * then serves all subjects at once.
+ */
+#ifndef _MULTI_H_
+#define _MULTI_H_
+
+#include "esa.h"
+#include "sequence.h"
+#include <stdlib.h>
+
+/**
+ * @brief An ESA over the concatenation of several subjects.
+ *
+ * Each subject contributes both strands, just as a seq_subject, followed by a
+ * `#`. That character never occurs in a query. Thus no match crosses the border
+ * of a subject.
+ */
+struct multi_index {
+	/** The ESA of all subjects. */
+	esa_s E;
+	/** The concatenation of all subjects. */
+	seq_subject all;
+	/** The ranks of the suffixes of each subject, in ascending order. The
+	 * ranks of subject `k` start at `start[k]`. */
+	saidx_t *ranks;
+	/** The number of subjects. */
+	size_t n;
+	/** The start of each subject in the concatenation, which is also the start
+	 * of its ranks; the entry `n` is the length of the concatenation. */
+	size_t *start;
+	/** The minimum anchor length of each subject. */
+	size_t *threshold;
+};
+
+/**
+ * @brief The longest match of a query with one subject of a generalized index.
+ */
+struct multi_match {
+	/** The position of one occurrence in the concatenation. */
+	size_t pos_S;
+	/** The length of the match. */
+	size_t length;
+	/** The number of occurrences in the subject. */
+	size_t count;
+};
+
+int multi_init(struct multi_index *, const seq_t *sequences,
+			   const size_t *subjects, size_t n);
+void multi_free(struct multi_index *);
+void multi_lookup(const struct multi_index *, const char *query, size_t qlen,
+				  const size_t *subjects, size_t count,
+				  struct multi_match *matches);
+
+#endif // _MULTI_H_
@@ -0,0 +1,450 @@
+/**
+ * @file
+ * @brief Placement of threads and data on NUMA nodes
+ *
+ * The topology is read from sysfs; nodes without processors are ignored. The
+ * threads are assigned to the nodes in blocks of consecutive thread numbers,
+ * just like a static OpenMP schedule distributes work. A thread binds itself
+ * to all processors of its node, not to a single one, so that the scheduler
+ * may still balance within the node. As with the hardware counters, a slot
+ * remembers the system thread it was bound for.
+ */
+#define _GNU_SOURCE
+#include "numa.h"
+#include "global.h"
+#include "mem.h"
+#include "slots.h"
+#include <dirent.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <string.h>
+
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/** At most this many nodes are used. */
+#define NUMA_MAX_NODES 64
+
+/**
+ * @brief The binding of a single thread.
+ */
+struct numa_slot {
+	/** The system thread which was bound; zero if none. */
+	long tid;
+} __attribute__((aligned(SLOT_ALIGNMENT)));
+
+/** The number of nodes in use; one if NUMA awareness is off. */
+static size_t NODES = 1;
+static size_t THREAD_COUNT = 1;
+static int REPLICATE = 0;
+static struct numa_slot *SLOTS = NULL;
+
+/** The system number of each node in use. */
+static int NODE_IDS[NUMA_MAX_NODES];
+
+#ifdef HAVE_SCHED_SETAFFINITY
+static cpu_set_t CPUS[NUMA_MAX_NODES];
+#endif
+
+/** The sequences as replicated by numa_replicate(); one array per node. */
+static const seq_t *REPLICA_SOURCE = NULL;
+static seq_t *REPLICAS = NULL;
+static char *REPLICA_DATA[NUMA_MAX_NODES];
+static size_t REPLICA_COUNT = 0;
+static size_t REPLICA_BYTES = 0;
+
+/** The number of index copies made and their size, for the statistics. */
+static size_t INDEX_COPIES = 0;
+static size_t INDEX_BYTES = 0;
+
+/** @brief The node of a thread. */
+static size_t numa_node_of(size_t thread) {
+	return (thread % THREAD_COUNT) * NODES / THREAD_COUNT;
+}
+
+/** @brief Check whether a thread is the first of its node. */
+static int numa_first_of_node(size_t thread) {
+	return thread == 0 || numa_node_of(thread) != numa_node_of(thread - 1);
+}
+
+#ifdef HAVE_SCHED_SETAFFINITY
+
+/**
+ * @brief Parse a list of processors, such as `0-3,8-11`.
+ *
+ * @param list - The list.
+ * @param set - (output parameter) The processors.
+ * @returns the number of processors.
+ */
+static size_t numa_parse_cpus(const char *list, cpu_set_t *set) {
+	CPU_ZERO(set);
+
+	const char *ptr = list;
+	while (*ptr && *ptr != '\n') {
+		char *end;
+		unsigned long first = strtoul(ptr, &end, 10);
+		if (end == ptr) break;
+
+		unsigned long last = first;
+		if (*end == '-') {
+			ptr = end + 1;
+			last = strtoul(ptr, &end, 10);
+			if (end == ptr) break;
+		}
+
+		for (unsigned long cpu = first; cpu <= last && cpu < CPU_SETSIZE;
+			 cpu++) {
+			CPU_SET(cpu, set);
+		}
+
+		ptr = *end == ',' ? end + 1 : end;
+	}
+
+	return CPU_COUNT(set);
+}
+
+/**
+ * @brief Read the nodes with processors from sysfs.
+ *
+ * sysfs is expected at `/sys`, unless the environment variable
+ * `ANDI_SYSFS_ROOT` names another directory. The latter allows to test the
+ * placement on machines with a single node.
+ *
+ * @returns the number of nodes found.
+ */
+static size_t numa_read_topology(void) {
+	const char *root = getenv("ANDI_SYSFS_ROOT");
+	if (!root || !*root) root = "/sys";
+
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/devices/system/node", root);
+	DIR *dir = opendir(path);
+	if (!dir) return 0;
+
+	size_t nodes = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) && nodes < NUMA_MAX_NODES) {
+		int id;
+		char rest;
+		if (sscanf(entry->d_name, "node%d%c", &id, &rest) != 1) continue;
+
+		char file_name[PATH_MAX + 32];
+		snprintf(file_name, sizeof(file_name), "%s/node%d/cpulist", path, id);
+		FILE *file = fopen(file_name, "r");
+		if (!file) continue;
+
+		char list[4096] = "";
+		if (!fgets(list, sizeof(list), file)) list[0] = '\0';
+		fclose(file);
+
+		if (numa_parse_cpus(list, &CPUS[nodes]) == 0) continue;
+		NODE_IDS[nodes++] = id;
+	}
+	closedir(dir);
+
+	// Keep the nodes in their natural order.
+	for (size_t a = 1; a < nodes; a++) {
+		for (size_t b = a; b > 0 && NODE_IDS[b - 1] > NODE_IDS[b]; b--) {
+			int id = NODE_IDS[b];
+			NODE_IDS[b] = NODE_IDS[b - 1];
+			NODE_IDS[b - 1] = id;
+
+			cpu_set_t set = CPUS[b];
+			CPUS[b] = CPUS[b - 1];
+			CPUS[b - 1] = set;
+		}
+	}
+
+	return nodes;
+}
+
+#else
+
+static size_t numa_read_topology(void) {
+	return 0;
+}
+
+#endif
+
+/**
+ * @brief Detect the nodes and prepare the binding of threads.
+ *
+ * If fewer than two nodes with processors are found, or the platform does not
+ * support binding threads, NUMA awareness stays off.
+ *
+ * @param threads - The number of threads used.
+ * @param replicate - Whether shared read-only data is copied to every node.
+ */
+void numa_init(size_t threads, int replicate) {
+	if (!(FLAGS & F_NUMA)) return;
+	if (threads == 0) threads = 1;
+
+	size_t nodes = numa_read_topology();
+	if (nodes < 2) {
+		warnx("Only %s NUMA node was found. Ignoring --numa.",
+			  nodes ? "a single" : "no");
+		FLAGS &= ~F_NUMA;
+		return;
+	}
+
+	// Nodes without a thread are of no use.
+	NODES = nodes < threads ? nodes : threads;
+	THREAD_COUNT = threads;
+	REPLICATE = replicate;
+
+	SLOTS = slots_new(threads, sizeof(*SLOTS));
+}
+
+/** @brief Release everything; threads stay bound. */
+void numa_free(void) {
+	numa_replicate_free();
+	free(SLOTS);
+	SLOTS = NULL;
+	NODES = 1;
+	THREAD_COUNT = 1;
+}
+
+/** @brief The number of nodes in use; one if NUMA awareness is off. */
+size_t numa_nodes(void) {
+	return NODES;
+}
+
+/** @brief The node of the calling thread. */
+size_t numa_node(void) {
+	return NODES > 1 ? numa_node_of(slots_thread()) : 0;
+}
+
+/**
+ * @brief Bind the calling thread to the processors of its node.
+ *
+ * This is cheap if the thread is already bound, so it can be called at the
+ * beginning of every task.
+ */
+void numa_bind(void) {
+	if (NODES < 2) return;
+
+#ifdef HAVE_SCHED_SETAFFINITY
+	size_t t = slots_thread();
+	struct numa_slot *slot = slots_local(SLOTS, THREAD_COUNT, sizeof(*SLOTS));
+	if (!slot) return;
+
+	long tid = syscall(SYS_gettid);
+	if (slot->tid == tid) return;
+
+	if (sched_setaffinity(0, sizeof(cpu_set_t), &CPUS[numa_node_of(t)]) != 0) {
+		soft_err("Binding thread %zu to NUMA node %d failed", t,
+				 NODE_IDS[numa_node_of(t)]);
+	}
+	slot->tid = tid;
+#endif
+}
+
+/**
+ * @brief Copy the sequences to every node.
+ *
+ * The copy of a node is written by its first thread and thus placed on that
+ * node. Only the residues are copied; the names are shared.
+ *
+ * @param sequences - The sequences.
+ * @param n - The number of sequences.
+ */
+void numa_replicate(const seq_t *sequences, size_t n) {
+	if (NODES < 2 || !REPLICATE) return;
+
+	size_t bytes = 0;
+	for (size_t i = 0; i < n; i++) {
+		bytes += sequences[i].len + 1;
+	}
+
+	REPLICAS = malloc(NODES * n * sizeof(*REPLICAS));
+	CHECK_MALLOC(REPLICAS);
+	for (size_t node = 0; node < NODES; node++) {
+		memcpy(REPLICAS + node * n, sequences, n * sizeof(*REPLICAS));
+		REPLICA_DATA[node] = NULL;
+	}
+
+	size_t threads = THREAD_COUNT;
+	seq_t *replicas = REPLICAS;
+
+#pragma omp parallel num_threads(threads) default(none) shared(REPLICA_DATA)   \
+	firstprivate(stderr, sequences, n, bytes, replicas)
+	{
+		numa_bind();
+		size_t t = slots_thread();
+
+		if (numa_first_of_node(t)) {
+			size_t node = numa_node_of(t);
+			char *data = malloc(bytes);
+			CHECK_MALLOC(data);
+
+			seq_t *local = replicas + node * n;
+			for (size_t i = 0, offset = 0; i < n; i++) {
+				memcpy(data + offset, sequences[i].S, sequences[i].len + 1);
+				local[i].S = data + offset;
+				offset += sequences[i].len + 1;
+			}
+			REPLICA_DATA[node] = data;
+		}
+	}
+
+	for (size_t node = 0; node < NODES; node++) {
+		if (REPLICA_DATA[node]) mem_add(MEM_SEQUENCES, bytes);
+	}
+
+	REPLICA_SOURCE = sequences;
+	REPLICA_COUNT = n;
+	REPLICA_BYTES = bytes;
+}
+
+/** @brief Free the copies of the sequences. */
+void numa_replicate_free(void) {
+	if (!REPLICAS) return;
+
+	for (size_t node = 0; node < NODES; node++) {
+		if (REPLICA_DATA[node]) mem_sub(MEM_SEQUENCES, REPLICA_BYTES);
+		free(REPLICA_DATA[node]);
+		REPLICA_DATA[node] = NULL;
+	}
+	free(REPLICAS);
+	REPLICAS = NULL;
+	REPLICA_SOURCE = NULL;
+	REPLICA_COUNT = 0;
+}
+
+/**
+ * @brief The sequences as seen by the calling thread.
+ *
+ * @param sequences - The sequences passed to numa_replicate().
+ * @returns the copy on the node of the calling thread, or `sequences` itself
+ * if they were not replicated.
+ */
+const seq_t *numa_sequences(const seq_t *sequences) {
+	if (!REPLICAS || sequences != REPLICA_SOURCE) return sequences;
+	return REPLICAS + numa_node() * REPLICA_COUNT;
+}
+
+/**
+ * @brief Prepare the copies of an index, one per node.
+ *
+ * @returns the empty copies, or NULL if indexes are not replicated.
+ */
+struct numa_index *numa_index_new(void) {
+	if (NODES < 2 || !REPLICATE) return NULL;
+
+	struct numa_index *replicas = calloc(NODES, sizeof(*replicas));
+	CHECK_MALLOC(replicas);
+	return replicas;
+}
+
+/**
+ * @brief Copy an index to the node of the calling thread.
+ *
+ * This is called by every thread of a parallel region, of which only the first
+ * thread of each node but the first makes a copy. The index is assumed to be
+ * built by the main thread, which is on the first node. The copies must not be
+ * used before all threads have returned from here.
+ *
+ * @param replicas - The copies of the index; may be NULL.
+ * @param E - The index.
+ */
+void numa_index_copy(struct numa_index *replicas, const esa_s *E) {
+	if (!replicas) return;
+
+	size_t t = slots_thread();
+	size_t node = numa_node_of(t);
+	if (node == 0 || !numa_first_of_node(t)) return;
+
+	size_t len = E->len;
+	char *RS = malloc(len + 1);
+	if (RS) {
+		memcpy(RS, E->S, len + 1);
+		if (esa_clone(&replicas[node].E, E, RS) == 0) {
+			mem_add(MEM_RS, len + 1);
+			replicas[node].RS = RS;
+			return;
+		}
+	}
+
+	// Without a copy, the node uses the original.
+	warnx("Failed to copy the index to NUMA node %d.", NODE_IDS[node]);
+	free(RS);
+}
+
+/**
+ * @brief The index as seen by the calling thread.
+ *
+ * @param replicas - The copies of the index; may be NULL.
+ * @param E - The original index.
+ * @returns the copy on the node of the calling thread, or the original.
+ */
+const esa_s *numa_index_local(const struct numa_index *replicas,
+							  const esa_s *E) {
+	if (!replicas) return E;
+
+	size_t node = numa_node();
+	return node > 0 && replicas[node].RS ? &replicas[node].E : E;
+}
+
+/** @brief Free the copies of an index. */
+void numa_index_free(struct numa_index *replicas) {
+	if (!replicas) return;
+
+	for (size_t node = 1; node < NODES; node++) {
+		if (!replicas[node].RS) continue;
+
+		size_t len = replicas[node].E.len;
+		INDEX_COPIES++;
+		INDEX_BYTES += len + 1 + esa_size(&replicas[node].E);
+
+		mem_sub(MEM_RS, len + 1);
+		esa_free(&replicas[node].E);
+		free(replicas[node].RS);
+	}
+	free(replicas);
+}
+
+/**
+ * @brief Print the placement as a JSON object.
+ *
+ * The loads are those served by the memory of the loading thread's node and
+ * of another node, as counted by the hardware. They show whether the mode
+ * keeps the accesses local.
+ *
+ * @param file - The file to write to.
+ * @param indent - The indentation of the object.
+ * @param loads - The local and the remote loads; NULL if not counted.
+ */
+void numa_write_json(FILE *file, const char *indent, const uint64_t *loads) {
+	fprintf(file, "{\n");
+	fprintf(file, "%s\t\"nodes\": [", indent);
+	for (size_t node = 0; node < NODES; node++) {
+		fprintf(file, "%s%d", node ? ", " : "", NODE_IDS[node]);
+	}
+	fprintf(file, "],\n");
+	fprintf(file, "%s\t\"thread_nodes\": [", indent);
+	for (size_t t = 0; t < THREAD_COUNT; t++) {
+		fprintf(file, "%s%d", t ? ", " : "", NODE_IDS[numa_node_of(t)]);
+	}
+	fprintf(file, "],\n");
+	fprintf(file, "%s\t\"mode\": \"%s\",\n", indent,
+			REPLICATE ? "replicate" : "bind");
+	fprintf(file, "%s\t\"replicate\": %s,\n", indent,
+			REPLICATE ? "true" : "false");
+	fprintf(file, "%s\t\"replicated_sequences\": %zu,\n", indent,
+			REPLICATE ? REPLICA_BYTES * NODES : 0);
+	fprintf(file, "%s\t\"replicated_indexes\": %zu,\n", indent, INDEX_COPIES);
+	fprintf(file, "%s\t\"replicated_index_bytes\": %zu,\n", indent,
+			INDEX_BYTES);
+	if (loads) {
+		fprintf(file,
+				"%s\t\"loads\": {\"local\": %" PRIu64 ", \"remote\": %" PRIu64
+				"}\n",
+				indent, loads[0], loads[1]);
+	} else {
+		fprintf(file, "%s\t\"loads\": null\n", indent);
+	}
+	fprintf(file, "%s}", indent);
+}
@@ -0,0 +1,46 @@
+/**
+ * @file
+ * @brief Placement of threads and data on NUMA nodes
+ *
+ * On machines with several sockets, memory is local to one node and slower to
+ * reach from the others. Linux places a page on the node of the thread that
+ * first writes it. With `--numa`, the threads are spread over the nodes in
+ * blocks and bound to the processors of their node. Whatever a thread
+ * allocates and fills itself, such as the index in the fast mode, is then
+ * local to it. With `--numa=replicate`, the read-only data shared by all
+ * threads is copied once per node: the sequences, and the index of the
+ * low-memory mode.
+ */
+#ifndef _NUMA_H_
+#define _NUMA_H_
+
+#include "esa.h"
+#include "sequence.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @brief A copy of an index on one node.
+ */
+struct numa_index {
+	/** The copied string of the subject. */
+	char *RS;
+	esa_s E;
+};
+
+void numa_init(size_t threads, int replicate);
+void numa_free(void);
+size_t numa_nodes(void);
+size_t numa_node(void);
+void numa_bind(void);
+void numa_replicate(const seq_t *sequences, size_t n);
+void numa_replicate_free(void);
+const seq_t *numa_sequences(const seq_t *sequences);
+struct numa_index *numa_index_new(void);
+void numa_index_copy(struct numa_index *, const esa_s *E);
+const esa_s *numa_index_local(const struct numa_index *, const esa_s *E);
+void numa_index_free(struct numa_index *);
+void numa_write_json(FILE *file, const char *indent, const uint64_t *loads);
+
+#endif // _NUMA_H_
@@ -0,0 +1,232 @@
+/**
+ * @file
+ * @brief Per-pair diagnostics
+ *
+ * Every thread keeps a small min-heap of the slowest comparisons it has seen
+ * and a buffer of records for the binary dump. Full buffers are appended to
+ * the dump file one at a time. At the end, the heaps of all threads are merged
+ * into a single report. See pairs.h for the format of the dump.
+ */
+#include "pairs.h"
+#include "global.h"
+#include "slots.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The number of records a thread buffers before writing them. */
+#define PAIRS_BUFFER_SIZE 4096
+
+/**
+ * @brief The diagnostics gathered by a single thread.
+ */
+struct pairs_slot {
+	/** A min-heap of the slowest comparisons, ordered by time. */
+	struct pair_record *heap;
+	size_t heap_size;
+	/** Records not yet written to the dump. */
+	struct pair_record *buffer;
+	size_t buffer_size;
+} __attribute__((aligned(SLOT_ALIGNMENT)));
+
+static struct pairs_slot *SLOTS = NULL;
+static size_t SLOTS_COUNT = 0;
+static size_t SLOWEST = 0;
+static FILE *DUMP = NULL;
+static const char *DUMP_FILE_NAME = NULL;
+
+/**
+ * @brief Prepare the recording of per-pair diagnostics.
+ *
+ * @param threads - The maximum number of threads used.
+ * @param slowest - The number of slowest pairs to report; may be zero.
+ * @param dump_file_name - The file to dump all records to; may be NULL.
+ * @param n - The number of sequences.
+ */
+void pairs_init(size_t threads, size_t slowest, const char *dump_file_name,
+				size_t n) {
+	if (!(FLAGS & F_PAIR_STATS)) return;
+	if (threads == 0) threads = 1;
+
+	SLOTS = slots_new(threads, sizeof(*SLOTS));
+	SLOTS_COUNT = threads;
+	SLOWEST = slowest;
+
+	if (dump_file_name) {
+		DUMP = fopen(dump_file_name, "wb");
+		if (!DUMP) {
+			soft_err("%s", dump_file_name);
+		} else {
+			uint32_t version = 1;
+			uint32_t record_size = sizeof(struct pair_record);
+			uint64_t count = n;
+			if (fwrite("ANDIPAIR", 1, 8, DUMP) != 8 ||
+				fwrite(&version, sizeof(version), 1, DUMP) != 1 ||
+				fwrite(&record_size, sizeof(record_size), 1, DUMP) != 1 ||
+				fwrite(&count, sizeof(count), 1, DUMP) != 1 ||
+				fflush(DUMP) != 0) {
+				// Without a header, the records are of no use.
+				soft_err("%s", dump_file_name);
+				fclose(DUMP);
+				DUMP = NULL;
+			}
+		}
+		DUMP_FILE_NAME = dump_file_name;
+	}
+
+	for (size_t t = 0; t < threads; t++) {
+		if (SLOWEST) {
+			SLOTS[t].heap = malloc(SLOWEST * sizeof(struct pair_record));
+			CHECK_MALLOC(SLOTS[t].heap);
+		}
+		if (DUMP) {
+			SLOTS[t].buffer =
+				malloc(PAIRS_BUFFER_SIZE * sizeof(struct pair_record));
+			CHECK_MALLOC(SLOTS[t].buffer);
+		}
+	}
+}
+
+/** @brief Insert a record into a bounded min-heap. */
+static void heap_push(struct pairs_slot *slot, const struct pair_record *rec) {
+	struct pair_record *heap = slot->heap;
+	size_t k;
+
+	if (slot->heap_size < SLOWEST) {
+		// sift up
+		k = slot->heap_size++;
+		while (k > 0 && heap[(k - 1) / 2].seconds > rec->seconds) {
+			heap[k] = heap[(k - 1) / 2];
+			k = (k - 1) / 2;
+		}
+		heap[k] = *rec;
+		return;
+	}
+
+	if (rec->seconds <= heap[0].seconds) return;
+
+	// replace the fastest pair and sift down
+	size_t size = slot->heap_size;
+	k = 0;
+	while (2 * k + 1 < size) {
+		size_t child = 2 * k + 1;
+		if (child + 1 < size && heap[child + 1].seconds < heap[child].seconds) {
+			child++;
+		}
+		if (heap[child].seconds >= rec->seconds) break;
+		heap[k] = heap[child];
+		k = child;
+	}
+	heap[k] = *rec;
+}
+
+/** @brief Append the buffered records of a thread to the dump. */
+static void pairs_flush(struct pairs_slot *slot) {
+	if (!slot->buffer_size) return;
+
+#pragma omp critical(pairs_dump)
+	fwrite(slot->buffer, sizeof(struct pair_record), slot->buffer_size, DUMP);
+
+	slot->buffer_size = 0;
+}
+
+/**
+ * @brief Record the diagnostics of one comparison.
+ *
+ * @param subject - The index of the subject.
+ * @param query - The index of the query.
+ * @param seconds - The wall time of the comparison.
+ * @param info - The diagnostics returned by dist_anchor().
+ */
+void pairs_record(size_t subject, size_t query, double seconds,
+				  const struct dist_info *info) {
+	struct pairs_slot *slot = slots_local(SLOTS, SLOTS_COUNT, sizeof(*SLOTS));
+	if (!(FLAGS & F_PAIR_STATS) || !slot) return;
+
+	struct pair_record rec = {.subject = subject,
+							  .query = query,
+							  .seconds = seconds,
+							  .lookups = info->lookups,
+							  .anchors = info->anchors};
+
+	if (SLOWEST) {
+		heap_push(slot, &rec);
+	}
+
+	if (DUMP) {
+		slot->buffer[slot->buffer_size++] = rec;
+		if (slot->buffer_size == PAIRS_BUFFER_SIZE) {
+			pairs_flush(slot);
+		}
+	}
+}
+
+/** @brief Order records by descending time. */
+static int compare_slowest(const void *a, const void *b) {
+	double sa = ((const struct pair_record *)a)->seconds;
+	double sb = ((const struct pair_record *)b)->seconds;
+	return (sa < sb) - (sa > sb);
+}
+
+/**
+ * @brief Write the remaining records, report the slowest pairs and free all
+ * resources.
+ *
+ * @param M - The matrix of all comparisons.
+ * @param sequences - The sequences, for their names.
+ * @param n - The number of sequences.
+ */
+void pairs_finish(const struct model *M, const seq_t *sequences, size_t n) {
+	if (!(FLAGS & F_PAIR_STATS) || !SLOTS) return;
+
+	if (DUMP) {
+		for (size_t t = 0; t < SLOTS_COUNT; t++) {
+			pairs_flush(&SLOTS[t]);
+		}
+		int failed = ferror(DUMP);
+		failed |= fclose(DUMP);
+		if (failed) {
+			soft_err("%s", DUMP_FILE_NAME);
+		}
+		DUMP = NULL;
+	}
+
+	if (SLOWEST) {
+		size_t total = 0;
+		struct pair_record *all =
+			malloc(SLOTS_COUNT * SLOWEST * sizeof(struct pair_record));
+		CHECK_MALLOC(all);
+
+		for (size_t t = 0; t < SLOTS_COUNT; t++) {
+			memcpy(all + total, SLOTS[t].heap,
+				   SLOTS[t].heap_size * sizeof(struct pair_record));
+			total += SLOTS[t].heap_size;
+		}
+
+		qsort(all, total, sizeof(struct pair_record), compare_slowest);
+		if (total > SLOWEST) total = SLOWEST;
+
+		fprintf(stderr, "The %zu slowest comparisons:\n", total);
+		fprintf(stderr, "%12s %12s %10s %9s  %s\n", "seconds", "lookups",
+				"anchors", "coverage", "subject / query");
+		for (size_t k = 0; k < total; k++) {
+			const struct pair_record *rec = &all[k];
+			double coverage = model_coverage(&M[rec->subject * n + rec->query]);
+			fprintf(stderr,
+					"%12.6f %12" PRIu64 " %10" PRIu64 " %9.4f  %s / %s\n",
+					rec->seconds, rec->lookups, rec->anchors, coverage,
+					sequences[rec->subject].name, sequences[rec->query].name);
+		}
+
+		free(all);
+	}
+
+	for (size_t t = 0; t < SLOTS_COUNT; t++) {
+		free(SLOTS[t].heap);
+		free(SLOTS[t].buffer);
+	}
+	free(SLOTS);
+	SLOTS = NULL;
+	SLOTS_COUNT = 0;
+}
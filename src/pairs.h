@@ -0,0 +1,46 @@
+/**
+ * @file
+ * @brief Per-pair diagnostics
+ *
+ * Some comparisons take orders of magnitude longer than others, typically
+ * because of repeat-rich inputs. This module records the wall time, number of
+ * lookups and anchors of every comparison. It can report the slowest pairs and
+ * dump all records to a binary file.
+ */
+#ifndef _PAIRS_H_
+#define _PAIRS_H_
+
+#include "model.h"
+#include "process.h"
+#include "sequence.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief The diagnostics of one comparison as stored in the binary dump.
+ *
+ * The dump starts with the eight bytes `ANDIPAIR`, followed by a 32 bit
+ * version number (currently 1), the 32 bit size of a record and the 64 bit
+ * number of sequences. Then the records follow in no particular order. All
+ * numbers are in host byte order.
+ */
+struct pair_record {
+	/** The index of the subject in the input. */
+	uint32_t subject;
+	/** The index of the query in the input. */
+	uint32_t query;
+	/** The wall time of the comparison in seconds. */
+	double seconds;
+	/** The number of lookups in the ESA of the subject. */
+	uint64_t lookups;
+	/** The number of anchors found. */
+	uint64_t anchors;
+};
+
+void pairs_init(size_t threads, size_t slowest, const char *dump_file_name,
+				size_t n);
+void pairs_record(size_t subject, size_t query, double seconds,
+				  const struct dist_info *info);
+void pairs_finish(const struct model *M, const seq_t *sequences, size_t n);
+
+#endif // _PAIRS_H_
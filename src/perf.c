@@ -0,0 +1,279 @@
+/**
+ * @file
+ * @brief Hardware performance counters
+ *
+ * Every thread owns a group of counters, which is opened on the first reading
+ * in that thread. A group only counts the thread that opened it. Thus the
+ * group is reopened, if a slot is suddenly used by another system thread. The
+ * main thread probes which events are available in perf_init(); the other
+ * threads only open those.
+ */
+#define _GNU_SOURCE
+#include "perf.h"
+#include "global.h"
+#include "slots.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/** @brief The names of the events as used in the JSON output. */
+static const char *EVENT_NAMES[PERF_EVENTS] = {
+	"cycles",		 "instructions", "llc_misses",	"dtlb_misses",
+	"branch_misses", "node_loads",	 "remote_loads"};
+
+/**
+ * @brief The counters of a single thread.
+ */
+struct perf_slot {
+	/** The system thread which opened the group; zero if none. */
+	long tid;
+	/** The file descriptor of each event, or -1. */
+	int fds[PERF_EVENTS];
+	/** The position of each event within a group reading. */
+	int positions[PERF_EVENTS];
+	/** The first opened event reads the whole group. */
+	int leader;
+} __attribute__((aligned(SLOT_ALIGNMENT)));
+
+static struct perf_slot *SLOTS = NULL;
+static size_t SLOTS_COUNT = 0;
+/** A bit mask of the events available in the main thread. */
+static unsigned int AVAILABLE = 0;
+/** Why no event is available; only written by perf_init(). */
+static char ERROR[128] = "";
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+
+/** @brief Fill in the attributes for one of our events. */
+static void perf_attr(struct perf_event_attr *attr, size_t event) {
+	static const struct {
+		uint32_t type;
+		uint64_t config;
+	} EVENTS[PERF_EVENTS] = {
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+		{PERF_TYPE_HW_CACHE,
+		 PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+		{PERF_TYPE_HW_CACHE,
+		 PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+		// Loads served by main memory; the misses are served by a remote node.
+		{PERF_TYPE_HW_CACHE,
+		 PERF_COUNT_HW_CACHE_NODE | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			 (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16)},
+		{PERF_TYPE_HW_CACHE,
+		 PERF_COUNT_HW_CACHE_NODE | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}};
+
+	memset(attr, 0, sizeof(*attr));
+	attr->size = sizeof(*attr);
+	attr->type = EVENTS[event].type;
+	attr->config = EVENTS[event].config;
+	attr->read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+						PERF_FORMAT_TOTAL_TIME_RUNNING;
+	// Only count user space, which is allowed with a paranoia level of two.
+	attr->exclude_kernel = 1;
+	attr->exclude_hv = 1;
+}
+
+/**
+ * @brief Open a group of counters for the calling thread.
+ *
+ * @param slot - The slot to open the group in.
+ * @param mask - The events to try.
+ * @param errnum - (output parameter) The error of the first event that failed
+ * before any other was opened; may be NULL.
+ * @returns a bit mask of the opened events.
+ */
+static unsigned int perf_open(struct perf_slot *slot, unsigned int mask,
+							  int *errnum) {
+	unsigned int opened = 0;
+	int count = 0;
+
+	slot->leader = -1;
+	for (size_t k = 0; k < PERF_EVENTS; k++) {
+		slot->fds[k] = -1;
+		if (!(mask & (1u << k))) continue;
+
+		struct perf_event_attr attr;
+		perf_attr(&attr, k);
+
+		int fd = syscall(SYS_perf_event_open, &attr, 0, -1, slot->leader, 0);
+		if (fd < 0) {
+			if (!opened && errnum && !*errnum) {
+				*errnum = errno;
+			}
+			continue;
+		}
+
+		if (slot->leader < 0) slot->leader = fd;
+		slot->fds[k] = fd;
+		slot->positions[k] = count++;
+		opened |= 1u << k;
+	}
+
+	slot->tid = syscall(SYS_gettid);
+	return opened;
+}
+
+/** @brief Close the group of a slot. */
+static void perf_close(struct perf_slot *slot) {
+	for (size_t k = 0; k < PERF_EVENTS; k++) {
+		if (slot->fds[k] >= 0) close(slot->fds[k]);
+		slot->fds[k] = -1;
+	}
+	slot->leader = -1;
+	slot->tid = 0;
+}
+
+#else
+
+static unsigned int perf_open(struct perf_slot *slot, unsigned int mask,
+							  int *errnum) {
+	(void)mask;
+	for (size_t k = 0; k < PERF_EVENTS; k++) {
+		slot->fds[k] = -1;
+	}
+	slot->leader = -1;
+	slot->tid = 0;
+	if (errnum) *errnum = ENOSYS;
+	return 0;
+}
+
+static void perf_close(struct perf_slot *slot) {
+	(void)slot;
+}
+
+#endif
+
+/** @brief Explain why no event could be opened. */
+static void perf_explain(int errnum) {
+	const char *reason = strerror(errnum);
+	if (errnum == EACCES || errnum == EPERM) {
+		reason = "not permitted; see /proc/sys/kernel/perf_event_paranoid";
+	} else if (errnum == ENOENT || errnum == EOPNOTSUPP || errnum == ENODEV) {
+		reason = "not supported by this machine";
+	} else if (errnum == ENOSYS) {
+		reason = "not supported on this platform";
+	}
+	snprintf(ERROR, sizeof(ERROR), "%s", reason);
+}
+
+/**
+ * @brief Allocate the per-thread slots and probe the available events.
+ *
+ * @param threads - The maximum number of threads used.
+ */
+void perf_init(size_t threads) {
+	if (!(FLAGS & F_PERF)) return;
+	if (threads == 0) threads = 1;
+
+	SLOTS = slots_new(threads, sizeof(*SLOTS));
+	SLOTS_COUNT = threads;
+	for (size_t t = 0; t < threads; t++) {
+		for (size_t k = 0; k < PERF_EVENTS; k++) {
+			SLOTS[t].fds[k] = -1;
+		}
+		SLOTS[t].leader = -1;
+	}
+
+	// Only the main thread explains a failure; the others stay silent.
+	int errnum = 0;
+	AVAILABLE = perf_open(&SLOTS[0], (1u << PERF_EVENTS) - 1, &errnum);
+	if (!AVAILABLE) {
+		perf_explain(errnum);
+		warnx("Hardware performance counters are not available: %s.", ERROR);
+	}
+}
+
+/** @brief Close all counters and free the slots. */
+void perf_free(void) {
+	for (size_t t = 0; t < SLOTS_COUNT; t++) {
+		perf_close(&SLOTS[t]);
+	}
+	free(SLOTS);
+	SLOTS = NULL;
+	SLOTS_COUNT = 0;
+}
+
+/**
+ * @brief Read the counters of the calling thread.
+ *
+ * If counters are unavailable, all values are zero.
+ *
+ * @param sample - The reading to fill.
+ */
+void perf_read(struct perf_sample *sample) {
+	memset(sample, 0, sizeof(*sample));
+	if (!(FLAGS & F_PERF) || !SLOTS || !AVAILABLE) return;
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+	struct perf_slot *slot = slots_local(SLOTS, SLOTS_COUNT, sizeof(*SLOTS));
+	if (!slot) return;
+
+	long tid = syscall(SYS_gettid);
+	if (slot->tid != tid) {
+		perf_close(slot);
+		perf_open(slot, AVAILABLE, NULL);
+	}
+	if (slot->leader < 0) return;
+
+	// nr, time enabled, time running, and the values
+	uint64_t buffer[3 + PERF_EVENTS];
+	ssize_t got = read(slot->leader, buffer, sizeof(buffer));
+	if (got < (ssize_t)(3 * sizeof(uint64_t)) || buffer[2] == 0) return;
+
+	// Extrapolate, if the kernel had to multiplex the counters.
+	double scale = (double)buffer[1] / (double)buffer[2];
+	for (size_t k = 0; k < PERF_EVENTS; k++) {
+		if (slot->fds[k] < 0 || (uint64_t)slot->positions[k] >= buffer[0]) {
+			continue;
+		}
+		sample->values[k] = buffer[3 + slot->positions[k]] * scale;
+	}
+#endif
+}
+
+/**
+ * @brief Add the difference of two readings to a set of sums.
+ *
+ * @param sums - The accumulated values of all events.
+ * @param start - The reading at the beginning.
+ * @param stop - The reading at the end.
+ */
+void perf_accumulate(uint64_t *sums, const struct perf_sample *start,
+					 const struct perf_sample *stop) {
+	for (size_t k = 0; k < PERF_EVENTS; k++) {
+		// Scaled readings are estimates and may decrease slightly.
+		if (stop->values[k] > start->values[k]) {
+			sums[k] += stop->values[k] - start->values[k];
+		}
+	}
+}
+
+/** @brief The name of an event. */
+const char *perf_event_name(size_t event) {
+	return event < PERF_EVENTS ? EVENT_NAMES[event] : NULL;
+}
+
+/** @brief Check whether an event could be opened. */
+int perf_event_available(size_t event) {
+	return event < PERF_EVENTS && (AVAILABLE & (1u << event));
+}
+
+/**
+ * @brief Explain why counters are unavailable.
+ *
+ * @returns the error message, or NULL if at least one event is available.
+ */
+const char *perf_error(void) {
+	return AVAILABLE ? NULL : ERROR;
+}
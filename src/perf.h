@@ -0,0 +1,41 @@
+/**
+ * @file
+ * @brief Hardware performance counters
+ *
+ * On Linux, `--perf-counters` opens a group of hardware counters for every
+ * thread via `perf_event_open(2)`. The statistics module reads them at the
+ * beginning and end of each phase and accumulates the differences. If the
+ * counters cannot be opened, e.g. because of `perf_event_paranoid` or in a
+ * virtual machine, all values stay zero and the reason is reported instead.
+ */
+#ifndef _PERF_H_
+#define _PERF_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** The number of hardware events per group. */
+#define PERF_EVENTS 7
+
+/** The loads served by the memory of any node, and those of a remote one. */
+#define PERF_NODE_LOADS 5
+#define PERF_REMOTE_LOADS 6
+
+/**
+ * @brief A reading of all counters of the calling thread.
+ */
+struct perf_sample {
+	/** The counter values, scaled if the group was multiplexed. */
+	uint64_t values[PERF_EVENTS];
+};
+
+void perf_init(size_t threads);
+void perf_free(void);
+void perf_read(struct perf_sample *);
+void perf_accumulate(uint64_t *sums, const struct perf_sample *start,
+					 const struct perf_sample *stop);
+const char *perf_event_name(size_t event);
+int perf_event_available(size_t event);
+const char *perf_error(void);
+
+#endif // _PERF_H_
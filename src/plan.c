@@ -0,0 +1,394 @@
+/**
+ * @file
+ * @brief Predict the resources of a run
+ *
+ * The memory prediction mirrors the allocations of andi, see esa_memory(). The
+ * runtime is predicted from a simple cost model: building an index takes a
+ * constant time for the cache plus a time linear in the length of the subject,
+ * and matching takes a time linear in the length of the query. The three
+ * constants are calibrated on this machine by indexing and comparing two
+ * random sequences of different lengths with a divergence of one percent.
+ * Thus the runtime is only a rough estimate; repetitive or very divergent
+ * inputs take longer.
+ *
+ * Like andi, the plan only compares the first of identical sequences and only
+ * the windows of `--sample`. The shared indexes of `--index` are not covered.
+ */
+#define _GNU_SOURCE
+#include "plan.h"
+#include "esa.h"
+#include "global.h"
+#include "model.h"
+#include "process.h"
+#include "sequence.h"
+#include <compat-stdlib.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** The divergence of the calibration sequences. */
+#define PLAN_DIVERGENCE 0.01
+
+/**
+ * @brief A sequence as it would be read.
+ */
+struct plan_sequence {
+	size_t length;
+	/** The hash of the residues, as in seq_duplicates(). */
+	uint64_t hash;
+};
+
+/**
+ * @brief All sequences as they would be read.
+ */
+struct plan_lengths {
+	struct plan_sequence *data;
+	size_t capacity, size;
+};
+
+/** @brief Append a sequence; an empty one is refused, as andi does. */
+static void plan_lengths_push(struct plan_lengths *pl, size_t length,
+							  uint64_t hash, const char *name) {
+	if (length == 0) {
+		errx(1, "The sequence %s is empty.", name);
+	}
+
+	if (pl->size == pl->capacity) {
+		size_t capacity = pl->capacity ? pl->capacity * 2 : 64;
+		struct plan_sequence *ptr =
+			reallocarray(pl->data, capacity, sizeof(*ptr));
+		CHECK_MALLOC(ptr);
+
+		pl->data = ptr;
+		pl->capacity = capacity;
+	}
+
+	pl->data[pl->size++] = (struct plan_sequence){length, hash};
+}
+
+/** @brief Add a residue to a hash, as in seq_duplicates(). */
+static uint64_t plan_hash(uint64_t hash, char c) {
+	return (hash ^ (unsigned char)c) * 0x100000001b3ULL;
+}
+
+/**
+ * @brief Scan a FASTA file for the lengths of its sequences.
+ *
+ * Only the nucleotides kept by normalize() are counted and hashed; no sequence
+ * is stored. In join mode, all sequences of the file are counted as one,
+ * including the separators.
+ *
+ * @param file_name - The file to scan.
+ * @param pl - (output parameter) The found sequences.
+ */
+static void plan_scan(const char *file_name, struct plan_lengths *pl) {
+	int file_descriptor =
+		strcmp(file_name, "-") ? open(file_name, O_RDONLY) : STDIN_FILENO;
+
+	if (file_descriptor < 0) {
+		soft_err("%s", file_name);
+		return;
+	}
+
+	char buffer[1 << 16];
+	int in_header = 0, at_line_start = 1;
+	size_t records = 0, length = 0;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	// The name is the first word of the header; it is only used for errors. A
+	// joined sequence is named after the file.
+	char name[256] = "";
+	size_t name_length = 0;
+	int in_name = 0;
+
+	while (1) {
+		ssize_t count = read(file_descriptor, buffer, sizeof(buffer));
+		if (count < 0) {
+			soft_err("%s", file_name);
+			break;
+		}
+		if (count == 0) break;
+
+		for (ssize_t k = 0; k < count; k++) {
+			char c = buffer[k];
+			if (at_line_start && c == '>') {
+				if (records && !(FLAGS & F_JOIN)) {
+					plan_lengths_push(pl, length, hash, name);
+					length = 0;
+					hash = 0xcbf29ce484222325ULL;
+				} else if (records) {
+					// The joined sequences are separated by a `!`.
+					length++;
+					hash = plan_hash(hash, '!');
+				}
+				records++;
+				in_header = 1;
+				in_name = !(FLAGS & F_JOIN);
+				name_length = 0;
+			} else if (c == '\n') {
+				in_header = 0;
+				in_name = 0;
+			} else if (in_header) {
+				if (c == ' ' || c == '\t' || c == '\r') in_name = 0;
+				if (in_name && name_length + 1 < sizeof(name)) {
+					name[name_length++] = c;
+					name[name_length] = '\0';
+				}
+			} else {
+				switch (c) {
+					case 'A':
+					case 'C':
+					case 'G':
+					case 'T':
+					case 'a':
+					case 'c':
+					case 'g':
+					case 't':
+						length++;
+						hash = plan_hash(hash, c & ~0x20);
+				}
+			}
+			at_line_start = c == '\n';
+		}
+	}
+
+	if (records) {
+		plan_lengths_push(pl, length, hash,
+						  FLAGS & F_JOIN ? file_name : name);
+	}
+
+	if (file_descriptor != STDIN_FILENO) {
+		close(file_descriptor);
+	}
+}
+
+/** @brief Read the wall clock in seconds. */
+static double plan_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Time building an index of a random sequence and matching a mutated
+ * copy against it.
+ *
+ * @param rng - The random number generator.
+ * @param length - The length of the sequences.
+ * @param index_time - (output parameter) The time to build the index.
+ * @param match_time - (output parameter) The time to compare the copy.
+ */
+static void plan_measure(gsl_rng *rng, size_t length, double *index_time,
+						 double *match_time) {
+	static const char ACGT[4] = {'A', 'C', 'G', 'T'};
+
+	char *subject_str = malloc(length + 1);
+	char *query_str = malloc(length + 1);
+	CHECK_MALLOC(subject_str);
+	CHECK_MALLOC(query_str);
+
+	for (size_t k = 0; k < length; k++) {
+		size_t base = gsl_rng_uniform_int(rng, 4);
+		subject_str[k] = query_str[k] = ACGT[base];
+		if (gsl_rng_uniform(rng) < PLAN_DIVERGENCE) {
+			// substitute by one of the other three nucleotides
+			query_str[k] = ACGT[(base + 1 + gsl_rng_uniform_int(rng, 3)) % 4];
+		}
+	}
+	subject_str[length] = query_str[length] = '\0';
+
+	seq_t S, Q;
+	seq_init(&S, subject_str, "subject");
+	seq_init(&Q, query_str, "query");
+	free(subject_str);
+	free(query_str);
+
+	seq_subject subject;
+	esa_s E;
+
+	double begin = plan_now();
+	if (seq_subject_init(&subject, &S) || esa_init(&E, &subject)) {
+		errx(1, "Failed to create an index for calibration.");
+	}
+	*index_time = plan_now() - begin;
+
+	struct dist_info info;
+	begin = plan_now();
+	dist_anchor(&E, Q.S, Q.len, subject.threshold, &info);
+	*match_time = plan_now() - begin;
+
+	esa_free(&E);
+	seq_subject_free(&subject);
+	seq_free(&S);
+	seq_free(&Q);
+}
+
+/** @brief Order sequences by descending length, then by hash. */
+static int compare_lengths(const void *a, const void *b) {
+	const struct plan_sequence *sa = a, *sb = b;
+	if (sa->length != sb->length) return sa->length < sb->length ? 1 : -1;
+	return (sa->hash > sb->hash) - (sa->hash < sb->hash);
+}
+
+/** @brief The number of nucleotides of a query that are matched. */
+static size_t plan_matched(size_t length) {
+	size_t sampled = SAMPLE_WINDOWS * SAMPLE_LENGTH;
+	return SAMPLE_WINDOWS && sampled < length ? sampled : length;
+}
+
+/** @brief The peak memory of a subject, its strand and index. */
+static size_t plan_index_memory(size_t length) {
+	size_t RSlen = 2 * length + 1;
+	return RSlen + 1 + esa_memory(RSlen);
+}
+
+/**
+ * @brief Predict the memory and runtime of comparing the given files.
+ *
+ * The prediction is printed as JSON to stdout.
+ *
+ * @param file_names - The input files.
+ * @returns the exit status.
+ */
+int plan(struct string_vector *file_names) {
+	if (FLAGS & (F_GENERALIZED | F_PACKED)) {
+		errx(1, "The plan only covers separate indexes. Please omit --index.");
+	}
+
+	struct plan_lengths pl = {};
+
+	for (size_t i = 0; i < string_vector_size(file_names); i++) {
+		plan_scan(string_vector_at(file_names, i), &pl);
+	}
+
+	size_t n = pl.size;
+	if (n < 2) {
+		errx(1,
+			 "I am truly sorry, but with less than two sequences (%zu given) "
+			 "there is nothing to compare.",
+			 n);
+	}
+
+	qsort(pl.data, n, sizeof(*pl.data), compare_lengths);
+
+	// Only the first of identical sequences is indexed and compared. They
+	// are neighbours after sorting; keep the distinct ones in front.
+	size_t total_length = 0, sequences_memory = 0, distinct = 0;
+	for (size_t i = 0; i < n; i++) {
+		total_length += pl.data[i].length;
+		sequences_memory += pl.data[i].length + 1;
+
+		if (distinct && pl.data[distinct - 1].length == pl.data[i].length &&
+			pl.data[distinct - 1].hash == pl.data[i].hash) {
+			continue;
+		}
+		pl.data[distinct++] = pl.data[i];
+	}
+
+	// Calibrate the cost model with two sizes; fit a constant and a linear
+	// term for the index and a linear term for the matching.
+	gsl_rng *rng = gsl_rng_alloc(gsl_rng_default);
+	if (!rng) {
+		err(1, "RNG allocation failed.");
+	}
+	gsl_rng_set(rng, 1);
+
+	const size_t SMALL = 1 << 16, LARGE = 1 << 19;
+	double small_index, small_match, large_index, large_match;
+	plan_measure(rng, SMALL, &small_index, &small_match);
+	plan_measure(rng, LARGE, &large_index, &large_match);
+	gsl_rng_free(rng);
+
+	double index_per_base =
+		(large_index - small_index) / (2.0 * (LARGE - SMALL));
+	if (index_per_base < 0) index_per_base = large_index / (2.0 * LARGE);
+	double index_constant = large_index - index_per_base * 2.0 * LARGE;
+	if (index_constant < 0) index_constant = 0;
+	double match_per_base = large_match / LARGE;
+
+	size_t threads = THREADS > 0 ? THREADS : 1;
+	size_t fast_threads = threads < distinct ? threads : distinct;
+
+	// In fast mode every thread holds one index; the largest subjects may be
+	// processed at the same time.
+	size_t largest_index = plan_index_memory(pl.data[0].length);
+	size_t fast_indices = 0;
+	for (size_t i = 0; i < fast_threads; i++) {
+		fast_indices += plan_index_memory(pl.data[i].length);
+	}
+
+	size_t matrix_memory = n * n * sizeof(struct model);
+	if (SAMPLE_WINDOWS) {
+		// the widths of the intervals
+		matrix_memory += n * n * sizeof(double);
+	}
+	size_t output_memory = n * n * sizeof(double);
+	if (BOOTSTRAP) {
+		output_memory += n * n * sizeof(struct model);
+	}
+
+	size_t fast_memory =
+		sequences_memory + matrix_memory +
+		(fast_indices > output_memory ? fast_indices : output_memory);
+	size_t low_memory =
+		sequences_memory + matrix_memory +
+		(largest_index > output_memory ? largest_index : output_memory);
+
+	size_t matched_length = 0;
+	for (size_t i = 0; i < distinct; i++) {
+		matched_length += plan_matched(pl.data[i].length);
+	}
+
+	// Sum up the work per distinct subject.
+	double index_work = 0.0, match_work = 0.0, longest_subject = 0.0;
+	for (size_t i = 0; i < distinct; i++) {
+		size_t length = pl.data[i].length;
+		double index = index_constant + index_per_base * (2 * length + 1);
+		double match =
+			match_per_base * (matched_length - plan_matched(length));
+		index_work += index;
+		match_work += match;
+		if (index + match > longest_subject) {
+			longest_subject = index + match;
+		}
+	}
+
+	double fast_runtime = (index_work + match_work) / fast_threads;
+	if (longest_subject > fast_runtime) fast_runtime = longest_subject;
+	double low_memory_runtime = index_work + match_work / threads;
+
+	printf("{\n");
+	printf("\t\"sequences\": %zu,\n", n);
+	printf("\t\"distinct\": %zu,\n", distinct);
+	printf("\t\"total_length\": %zu,\n", total_length);
+	printf("\t\"max_length\": %zu,\n", pl.data[0].length);
+	printf("\t\"threads\": %zu,\n", threads);
+	printf("\t\"mode\": \"%s\",\n",
+		   FLAGS & F_LOW_MEMORY ? "low-memory" : "fast");
+	printf("\t\"memory\": {\n");
+	printf("\t\t\"sequences\": %zu,\n", sequences_memory);
+	printf("\t\t\"index_per_thread\": %zu,\n", largest_index);
+	printf("\t\t\"matrix\": %zu,\n", matrix_memory);
+	printf("\t\t\"output\": %zu,\n", output_memory);
+	printf("\t\t\"fast\": %zu,\n", fast_memory);
+	printf("\t\t\"low_memory\": %zu\n", low_memory);
+	printf("\t},\n");
+	printf("\t\"runtime\": {\n");
+	printf("\t\t\"index\": %.3f,\n", index_work);
+	printf("\t\t\"match\": %.3f,\n", match_work);
+	printf("\t\t\"fast\": %.3f,\n", fast_runtime);
+	printf("\t\t\"low_memory\": %.3f\n", low_memory_runtime);
+	printf("\t},\n");
+	printf("\t\"calibration\": {\n");
+	printf("\t\t\"index_seconds\": %.6g,\n", index_constant);
+	printf("\t\t\"index_seconds_per_base\": %.6g,\n", index_per_base);
+	printf("\t\t\"match_seconds_per_base\": %.6g\n", match_per_base);
+	printf("\t}\n");
+	printf("}\n");
+
+	free(pl.data);
+
+	return FLAGS & F_SOFT_ERROR ? EXIT_FAILURE : EXIT_SUCCESS;
+}
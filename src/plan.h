@@ -0,0 +1,16 @@
+/**
+ * @file
+ * @brief Predict the resources of a run
+ *
+ * With `--plan` the input files are only scanned for the lengths of the
+ * sequences. From these, the memory of both parallelization modes and the
+ * runtime are predicted and printed as JSON, without comparing anything.
+ */
+#ifndef _PLAN_H_
+#define _PLAN_H_
+
+#include "io.h"
+
+int plan(struct string_vector *file_names);
+
+#endif // _PLAN_H_
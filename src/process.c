@@ -5,15 +5,25 @@
  * @brief This file contains various distance methods.
  */
 #include "process.h"
+#include "counters.h"
 #include "esa.h"
 #include "global.h"
 #include "io.h"
 #include "model.h"
+#include "multi.h"
+#include "numa.h"
+#include "pairs.h"
+#include "profile.h"
+#include "progress.h"
 #include "sequence.h"
+#include "sketch.h"
+#include "stats.h"
+#include "trace.h"
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -22,6 +32,12 @@
 int calculate_bootstrap(const struct model *M, const seq_t *sequences,
 						size_t n);
 
+/**
+ * A diagonal walk is abandoned once there is more than about one mismatch per
+ * this many nucleotides. Unrelated sequences mismatch at three in four.
+ */
+#define WALK_DENSITY 8
+
 typedef _Bool bool;
 #define false 0
 #define true !false
@@ -46,18 +62,45 @@ struct context {
 	const char *query;
 	size_t query_length;
 	size_t threshold;
+	/** The number of lookups in the ESA so far. */
+	size_t lookups;
+	/** The end of the subject in the ESA. */
+	size_t end;
+	/** Positions of the subject before this are on the reverse strand. */
+	size_t border;
+	/** The model; it determines how matching nucleotides are counted. */
+	int kind;
 };
 
 /**
  * @brief Compute the length of the longest common prefix of two strings.
  *
+ * The strings are compared a word at a time. The first differing byte is then
+ * the lowest set byte of the exclusive or of both words.
+ *
  * @param S - One string.
  * @param Q - Another string.
- * @param remaining - The length of one of the strings.
+ * @param remaining - The number of characters that are safe to read from both
+ * strings.
  * @returns the length of the lcp.
  */
 static inline size_t lcp(const char *S, const char *Q, size_t remaining) {
 	size_t length = 0;
+
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	while (length + sizeof(uint64_t) <= remaining) {
+		uint64_t s, q;
+		memcpy(&s, S + length, sizeof(s));
+		memcpy(&q, Q + length, sizeof(q));
+
+		uint64_t diff = s ^ q;
+		if (diff) {
+			return length + (__builtin_ctzll(diff) >> 3);
+		}
+		length += sizeof(uint64_t);
+	}
+#endif
+
 	while (length < remaining && S[length] == Q[length]) {
 		length++;
 	}
@@ -87,16 +130,93 @@ static inline bool lucky_anchor(const struct context *ctx,
 	size_t gap = this_match->pos_Q - last_match->pos_Q - last_match->length;
 
 	size_t try_pos_S = last_match->pos_S + advance;
-	if (try_pos_S >= (size_t)ctx->C->len || gap > ctx->threshold) {
+	if (try_pos_S >= ctx->end || gap > ctx->threshold) {
+		COUNT(lucky_failures);
 		return false;
 	}
 
+	size_t remaining_Q = ctx->query_length - this_match->pos_Q;
+	size_t remaining_S = ctx->end - try_pos_S;
+
 	this_match->pos_S = try_pos_S;
 	this_match->length =
 		lcp(ctx->query + this_match->pos_Q, ctx->C->S + try_pos_S,
-			ctx->query_length - this_match->pos_Q);
+			remaining_Q < remaining_S ? remaining_Q : remaining_S);
+	COUNT_MATCH_LENGTH(this_match->length);
+
+	if (this_match->length >= ctx->threshold) {
+		COUNT(lucky_successes);
+		return true;
+	}
+
+	COUNT(lucky_failures);
+	return false;
+}
+
+/**
+ * @brief Follow the diagonal of the last two anchors to the next anchor.
+ *
+ * Between closely related sequences, the diagonal of an anchor pair usually
+ * continues for long, interrupted only by substitutions. If two mismatches are
+ * closer than the threshold, a lucky anchor fails and a lookup follows, which
+ * also just finds the short match on the same diagonal. Instead, we keep
+ * walking along the diagonal, mismatch by mismatch, until a match is long
+ * enough for an anchor. The walk is abandoned at a separator, at the end of
+ * either string or if mismatches become too dense for homology. Then the
+ * normal strategy resumes where the walk began.
+ *
+ * @param ctx - Matching context of various variables.
+ * @param last_match - The last anchor; a right anchor.
+ * @param this_match - Input/Output variable for the current match.
+ * @returns true iff the walk ended in an anchor on the same diagonal.
+ */
+static inline bool diagonal_walk(const struct context *ctx,
+								 const struct anchor *last_match,
+								 struct anchor *this_match) {
+	const char *S = ctx->C->S;
+	const char *query = ctx->query;
+	size_t len_S = ctx->end;
+	size_t len_Q = ctx->query_length;
+
+	size_t pos_Q = this_match->pos_Q;
+	size_t pos_S = last_match->pos_S + (pos_Q - last_match->pos_Q);
+	size_t walked = 0;
+	size_t mismatches = 0;
+
+	while (pos_Q < len_Q && pos_S < len_S) {
+		size_t remaining_Q = len_Q - pos_Q;
+		size_t remaining_S = len_S - pos_S;
+		size_t remaining =
+			remaining_Q < remaining_S ? remaining_Q : remaining_S;
+		size_t length = lcp(query + pos_Q, S + pos_S, remaining);
 
-	return this_match->length >= ctx->threshold;
+		if (length >= ctx->threshold) {
+			this_match->pos_Q = pos_Q;
+			this_match->pos_S = pos_S;
+			this_match->length = length;
+			COUNT_MATCH_LENGTH(length);
+			COUNT(walk_successes);
+			return true;
+		}
+
+		pos_Q += length;
+		pos_S += length;
+		if (pos_Q >= len_Q || pos_S >= len_S) break;
+
+		// Separators mark the end of a sequence or strand.
+		char c = S[pos_S];
+		if (c == '#' || c == '!' || query[pos_Q] == '!') break;
+
+		walked += length + 1;
+		mismatches++;
+		if (mismatches > 1 + walked / WALK_DENSITY) break;
+
+		pos_Q++;
+		pos_S++;
+	}
+
+	COUNT(walk_failures);
+	return false;
 }
 
 /**
@@ -110,18 +230,353 @@ static inline bool lucky_anchor(const struct context *ctx,
  * @param this_match - Input/Output variable for the current match.
  * @returns true iff an anchor was found.
  */
-static inline bool anchor(const struct context *ctx,
+static inline bool anchor(struct context *ctx,
 						  const struct anchor *last_match,
 						  struct anchor *this_match) {
 
+	ctx->lookups++;
 	lcp_inter_t inter = get_match_cached(ctx->C, ctx->query + this_match->pos_Q,
 										 ctx->query_length - this_match->pos_Q);
 
 	this_match->pos_S = ctx->C->SA[inter.i];
 	this_match->length = inter.l <= 0 ? 0 : inter.l;
+	COUNT_MATCH_LENGTH(this_match->length);
 	return inter.i == inter.j && this_match->length >= ctx->threshold;
 }
 
+/** @brief Count matching nucleotides, also in the profile. */
+static inline void count_equal(const struct context *ctx, model *ret,
+							   struct profile *profile, size_t pos,
+							   size_t length) {
+	model_count_equal(ret, ctx->query + pos, length, ctx->kind);
+	if (profile) {
+		profile_count_equal(profile, ctx->query, pos, length, ctx->kind);
+	}
+}
+
+/** @brief Count substitutions, also in the profile. */
+static inline void count(model *ret, struct profile *profile,
+						 const char *subject, const char *query, size_t pos,
+						 size_t length) {
+	model_count(ret, subject, query + pos, length);
+	if (profile) {
+		profile_count(profile, subject, query, pos, length);
+	}
+}
+
+/**
+ * @brief The state of a scan of one query against one subject.
+ */
+struct scan {
+	/** The substitutions found so far. */
+	model ret;
+	struct anchor this_match;
+	struct anchor last_match;
+	bool last_was_right_anchor;
+	/** Whether a diagonal walk may replace the next lookup. */
+	bool may_walk;
+	/** The number of anchors found. */
+	size_t anchors;
+};
+
+/**
+ * @brief Start a scan.
+ *
+ * @param sc - (output parameter) The scan.
+ * @param ctx - The context of the scan.
+ * @param begin - The start of the subject in the ESA.
+ */
+static inline void scan_init(struct scan *sc, const struct context *ctx,
+							 size_t begin) {
+	*sc = (struct scan){.ret = {.seq_len = ctx->query_length, .counts = {0}}};
+	sc->last_match.pos_S = begin;
+}
+
+/**
+ * @brief Try to find the next anchor without a lookup.
+ *
+ * Check for lucky anchors and, with `--walk`, walk along the diagonal of an
+ * anchor pair. A failed walk is not retried before the next anchor pair.
+ *
+ * @param ctx - Matching context of various variables.
+ * @param sc - The scan.
+ * @returns true iff the current match is an anchor.
+ */
+static inline bool scan_shortcut(const struct context *ctx, struct scan *sc) {
+	bool found = lucky_anchor(ctx, &sc->last_match, &sc->this_match);
+	if (!found && sc->may_walk) {
+		found = diagonal_walk(ctx, &sc->last_match, &sc->this_match);
+		sc->may_walk = found;
+	}
+	return found;
+}
+
+/**
+ * @brief Account a new anchor and the substitutions since the last one.
+ *
+ * @param ctx - Matching context of various variables.
+ * @param sc - The scan; its current match is the new anchor.
+ * @param profile - (output parameter) Substitutions along the query; may be
+ * NULL.
+ */
+static inline void scan_anchor(const struct context *ctx, struct scan *sc,
+							   struct profile *profile) {
+	const struct anchor *this_match = &sc->this_match;
+	const struct anchor *last_match = &sc->last_match;
+	const char *query = ctx->query;
+	size_t border = ctx->border;
+
+	COUNT(anchors);
+	sc->anchors++;
+
+	size_t end_S = last_match->pos_S + last_match->length;
+	size_t end_Q = last_match->pos_Q + last_match->length;
+	// Check if this can be a right anchor to the last one.
+	if (this_match->pos_S > end_S &&
+		this_match->pos_Q - end_Q == this_match->pos_S - end_S &&
+		(this_match->pos_S < border) == (last_match->pos_S < border)) {
+
+		// classify nucleotides in the left qanchor
+		count_equal(ctx, &sc->ret, profile, last_match->pos_Q,
+					last_match->length);
+
+		// Count the SNPs in between.
+		count(&sc->ret, profile, ctx->C->S + end_S, query, end_Q,
+			  this_match->pos_Q - end_Q);
+		sc->last_was_right_anchor = true;
+	} else {
+		if (sc->last_was_right_anchor) {
+			// If the last was a right anchor, but with the current one,
+			// we cannot extend, then add its length.
+			count_equal(ctx, &sc->ret, profile, last_match->pos_Q,
+						last_match->length);
+		} else if (last_match->length >= ctx->threshold * 2) {
+			// The last anchor wasn't neither a left or right anchor.
+			// But, it was as long as an anchor pair. So still count it.
+			count_equal(ctx, &sc->ret, profile, last_match->pos_Q,
+						last_match->length);
+		}
+
+		sc->last_was_right_anchor = false;
+	}
+
+	// Cache values for later
+	sc->last_match = sc->this_match;
+	sc->may_walk = (FLAGS & F_WALK) && sc->last_was_right_anchor;
+}
+
+/**
+ * @brief Complete a scan that has reached the end of the query.
+ *
+ * @param ctx - Matching context of various variables.
+ * @param sc - The scan.
+ * @param profile - (output parameter) Substitutions along the query; may be
+ * NULL.
+ * @returns A matrix with estimates of base substitutions.
+ */
+static inline model scan_finish(const struct context *ctx, struct scan *sc,
+								struct profile *profile) {
+	const struct anchor *last_match = &sc->last_match;
+	size_t query_length = ctx->query_length;
+
+	// Very special case: The sequences are identical
+	if (last_match->length >= query_length) {
+		count_equal(ctx, &sc->ret, profile, 0, query_length);
+		return sc->ret;
+	}
+
+	// We might miss a few nucleotides if the last anchor was also a right
+	// anchor. The logic is the same as in scan_anchor().
+	if (sc->last_was_right_anchor) {
+		count_equal(ctx, &sc->ret, profile, last_match->pos_Q,
+					last_match->length);
+	} else if (last_match->length >= ctx->threshold * 2) {
+		count_equal(ctx, &sc->ret, profile, last_match->pos_Q,
+					last_match->length);
+	}
+
+	return sc->ret;
+}
+
+/**
+ * @brief Scan a query for anchors and count the substitutions between them.
+ *
+ * @param C - The enhanced suffix array of the subject.
+ * @param query - The query string.
+ * @param query_length - The length of the query string.
+ * @param threshold - Minimal length for an anchor.
+ * @param kind - The model; see model_count_equal().
+ * @param info - (output parameter) Diagnostics of the scan; may be NULL.
+ * @param profile - (output parameter) Substitutions along the query; may be
+ * NULL.
+ * @returns A matrix with estimates of base substitutions.
+ */
+static model anchor_scan(const esa_s *C, const char *query, size_t query_length,
+						 size_t threshold, int kind, struct dist_info *info,
+						 struct profile *profile) {
+	size_t len = C->len;
+	struct context ctx = {C, query, query_length, threshold, 0, len, len / 2,
+						  kind};
+	struct scan sc;
+	scan_init(&sc, &ctx, 0);
+
+	// Iterate over the complete query.
+	while (sc.this_match.pos_Q < query_length) {
+		// Fall back to normal strategy.
+		if (scan_shortcut(&ctx, &sc) ||
+			anchor(&ctx, &sc.last_match, &sc.this_match)) {
+			// We have reached a new anchor.
+			scan_anchor(&ctx, &sc, profile);
+		}
+
+		// Advance
+		sc.this_match.pos_Q += sc.this_match.length + 1;
+	}
+
+	if (info) {
+		info->lookups += ctx.lookups;
+		info->anchors += sc.anchors;
+	}
+
+	return scan_finish(&ctx, &sc, profile);
+}
+
+/** @brief A small pseudo random number generator; splitmix64. */
+static inline uint64_t sample_next(uint64_t *state) {
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * @brief Compare only a random sample of windows of the query.
+ *
+ * The query is split into ::SAMPLE_WINDOWS strata of equal length and a window
+ * of ::SAMPLE_LENGTH nucleotides at a random position within each stratum is
+ * scanned for anchors. The substitution counts of all windows are extrapolated
+ * to the whole query. Leaving out one window at a time yields the jackknife
+ * variance of the distance. The positions only depend on the lengths of the
+ * sequences, so that the results are reproducible.
+ *
+ * @param C - The enhanced suffix array of the subject.
+ * @param query - The query string.
+ * @param query_length - The length of the query string.
+ * @param threshold - Minimal length for an anchor.
+ * @param kind - The model; see model_count_equal().
+ * @param info - (output parameter) Diagnostics of the scans; may be NULL.
+ * @returns The extrapolated matrix of substitutions.
+ */
+static model sample_scan(const esa_s *C, const char *query,
+						 size_t query_length, size_t threshold, int kind,
+						 struct dist_info *info) {
+	size_t windows = SAMPLE_WINDOWS;
+	size_t length = SAMPLE_LENGTH;
+	size_t stratum = query_length / windows;
+
+	model *samples = malloc(windows * sizeof(*samples));
+	CHECK_MALLOC(samples);
+
+	uint64_t state = (uint64_t)query_length << 32 ^ (uint64_t)C->len;
+	model total = {.seq_len = 0, .counts = {0}};
+	for (size_t k = 0; k < windows; k++) {
+		size_t offset =
+			k * stratum + sample_next(&state) % (stratum - length + 1);
+		samples[k] =
+			anchor_scan(C, query + offset, length, threshold, kind, info, NULL);
+		total = model_average(&total, &samples[k]);
+	}
+
+	// Jackknife: estimate the distance without each window in turn.
+	double *estimates = malloc(windows * sizeof(*estimates));
+	CHECK_MALLOC(estimates);
+
+	double mean = 0.0;
+	for (size_t k = 0; k < windows; k++) {
+		model rest = total;
+		rest.seq_len -= samples[k].seq_len;
+		for (size_t m = 0; m < MUTCOUNTS; m++) {
+			rest.counts[m] -= samples[k].counts[m];
+		}
+		estimates[k] = model_estimate(&rest, kind);
+		mean += estimates[k];
+	}
+	mean /= windows;
+
+	double squares = 0.0;
+	for (size_t k = 0; k < windows; k++) {
+		squares += (estimates[k] - mean) * (estimates[k] - mean);
+	}
+	if (info) {
+		info->variance = squares * (windows - 1) / windows;
+	}
+
+	free(estimates);
+	free(samples);
+
+	double scale = (double)query_length / (double)(windows * length);
+	model ret = {.seq_len = query_length, .counts = {0}};
+	for (size_t m = 0; m < MUTCOUNTS; m++) {
+		ret.counts[m] = (unsigned int)lround(total.counts[m] * scale);
+	}
+
+	return ret;
+}
+
+/** The number of windows sampled before a comparison with --min-coverage. */
+#define PROBE_WINDOWS 16
+
+/** The length of a sampled window relative to the query. */
+#define PROBE_FRACTION 256
+
+/** Shorter windows are not sampled, as the anchors would not fit. */
+#define PROBE_MIN_LENGTH 1000
+
+/**
+ * @brief Predict whether the coverage of a comparison ends below
+ * ::MIN_COVERAGE.
+ *
+ * A few short windows, evenly spread over the query, are scanned for anchors.
+ * The comparison is only worth completing if the upper confidence bound of
+ * their mean coverage reaches the minimum. This costs about six percent of a
+ * full comparison.
+ *
+ * @param C - The enhanced suffix array of the subject.
+ * @param query - The query string.
+ * @param query_length - The length of the query string.
+ * @param threshold - Minimal length for an anchor.
+ * @param kind - The model; see model_count_equal().
+ * @param info - (output parameter) Diagnostics of the scans; may be NULL.
+ * @returns true iff the coverage is predicted to be too low.
+ */
+static bool probe_low_coverage(const esa_s *C, const char *query,
+							   size_t query_length, size_t threshold, int kind,
+							   struct dist_info *info) {
+	size_t window = query_length / PROBE_FRACTION;
+	if (window < PROBE_MIN_LENGTH) {
+		return false;
+	}
+
+	double sum = 0.0, sum_squares = 0.0;
+	for (size_t k = 0; k < PROBE_WINDOWS; k++) {
+		size_t center = (2 * k + 1) * (query_length / (2 * PROBE_WINDOWS));
+		model datum = anchor_scan(C, query + center - window / 2, window,
+								  threshold, kind, info, NULL);
+
+		double coverage = model_coverage(&datum);
+		sum += coverage;
+		sum_squares += coverage * coverage;
+	}
+
+	// Three standard errors make an unwarranted abort very unlikely.
+	double mean = sum / PROBE_WINDOWS;
+	double variance =
+		(sum_squares - PROBE_WINDOWS * mean * mean) / (PROBE_WINDOWS - 1);
+	double bound = mean + 3 * sqrt(fmax(variance, 0.0) / PROBE_WINDOWS);
+
+	return bound < MIN_COVERAGE;
+}
+
 /**
  * @brief Divergence estimation using the anchor technique.
  *
@@ -131,86 +586,235 @@ static inline bool anchor(const struct context *ctx,
  * substrings that exist in both sequences. Then it manually checks for
  * mutations between those anchors.
  *
+ * With `--min-coverage`, pairs predicted to end below that coverage are
+ * aborted early. They are returned as an empty matrix with `seq_len` zero.
+ * With `--sample`, only a sample of windows of the query is compared, unless
+ * a profile is requested.
+ *
  * @param C - The enhanced suffix array of the subject.
  * @param query - The actual query string.
  * @param query_length - The length of the query string. Needed for speed
  * reasons.
  * @param threshold - Minimal length for an anchor.
+ * @param kind - The model; see model_count_equal().
+ * @param info - (output parameter) Diagnostics of the comparison; may be NULL.
+ * @param profile - (output parameter) The substitutions binned along the
+ * query; may be NULL.
  * @returns A matrix with estimates of base substitutions.
  */
+model dist_anchor_profile(const esa_s *C, const char *query,
+						  size_t query_length, size_t threshold, int kind,
+						  struct dist_info *info, struct profile *profile) {
+	if (info) {
+		*info = (struct dist_info){0};
+	}
+
+	if (MIN_COVERAGE > 0.0 &&
+		probe_low_coverage(C, query, query_length, threshold, kind, info)) {
+		if (info) {
+			info->aborted = true;
+		}
+		return (model){.seq_len = 0};
+	}
+
+	// Sampling pays off only if the windows cover a part of the query.
+	if (!profile && SAMPLE_WINDOWS &&
+		SAMPLE_WINDOWS * SAMPLE_LENGTH < query_length) {
+		return sample_scan(C, query, query_length, threshold, kind, info);
+	}
+
+	return anchor_scan(C, query, query_length, threshold, kind, info, profile);
+}
+
+/**
+ * @brief Divergence estimation using the anchor technique.
+ *
+ * See dist_anchor_profile(); with the global ::MODEL and without a profile.
+ */
 model dist_anchor(const esa_s *C, const char *query, size_t query_length,
-				  size_t threshold) {
-	struct model ret = {.seq_len = query_length, .counts = {0}};
+				  size_t threshold, struct dist_info *info) {
+	return dist_anchor_profile(C, query, query_length, threshold, MODEL, info,
+							   NULL);
+}
 
-	struct anchor this_match = {0};
-	struct anchor last_match = {0};
-	bool last_was_right_anchor = false;
-	size_t border = C->len / 2;
+/**
+ * @brief Groups of identical sequences.
+ */
+struct dist_groups {
+	/** For each sequence, the first identical one. */
+	size_t *first;
+	/** For each sequence, the next identical one; SIZE_MAX for the last. */
+	size_t *next;
+	/** The number of groups. */
+	size_t distinct;
+};
 
-	struct context ctx = {C, query, query_length, threshold};
+/**
+ * @brief The pairs of distinct sequences predicted to be related.
+ *
+ * Comparing two sketches is not free, and every driver asks for each pair a
+ * few times. So the prefilter is applied once to every pair, before any index
+ * is built.
+ */
+struct dist_related {
+	/** One bit per ordered pair, row by row; NULL if all pairs are related. */
+	uint64_t *bits;
+	/** For each distinct sequence, the number of related distinct ones. */
+	size_t *counts;
+	size_t n;
+};
 
-	// Iterate over the complete query.
-	while (this_match.pos_Q < query_length) {
+/**
+ * @brief Apply the prefilter to all pairs of distinct sequences.
+ *
+ * The decision is symmetric, so only one half of the pairs is sketched and
+ * mirrored onto the other.
+ *
+ * @param R - (output parameter) The related pairs.
+ * @param pf - The prefilter; NULL to relate all pairs.
+ * @param groups - The groups of identical sequences.
+ * @param n - The number of sequences.
+ */
+static void dist_related_init(struct dist_related *R,
+							  const struct prefilter *pf,
+							  const struct dist_groups *groups, size_t n) {
+	*R = (struct dist_related){.n = n};
+	if (!pf) return;
 
-		// Check for lucky anchors and fall back to normal strategy.
-		if (lucky_anchor(&ctx, &last_match, &this_match) ||
-			anchor(&ctx, &last_match, &this_match)) {
-			// We have reached a new anchor.
+	struct stats_timer timer = stats_begin();
 
-			size_t end_S = last_match.pos_S + last_match.length;
-			size_t end_Q = last_match.pos_Q + last_match.length;
-			// Check if this can be a right anchor to the last one.
-			if (this_match.pos_S > end_S &&
-				this_match.pos_Q - end_Q == this_match.pos_S - end_S &&
-				(this_match.pos_S < border) == (last_match.pos_S < border)) {
-
-				// classify nucleotides in the left qanchor
-				model_count_equal(&ret, query + last_match.pos_Q,
-								  last_match.length);
-
-				// Count the SNPs in between.
-				model_count(&ret, C->S + end_S, query + end_Q,
-							this_match.pos_Q - end_Q);
-				last_was_right_anchor = true;
-			} else {
-				if (last_was_right_anchor) {
-					// If the last was a right anchor, but with the current one,
-					// we cannot extend, then add its length.
-					model_count_equal(&ret, query + last_match.pos_Q,
-									  last_match.length);
-				} else if (last_match.length >= threshold * 2) {
-					// The last anchor wasn't neither a left or right anchor.
-					// But, it was as long as an anchor pair. So still count it.
-					model_count_equal(&ret, query + last_match.pos_Q,
-									  last_match.length);
-				}
+	size_t words = (n * n + 63) / 64;
+	R->bits = calloc(words, sizeof(*R->bits));
+	R->counts = calloc(n, sizeof(*R->counts));
+	CHECK_MALLOC(R->bits);
+	CHECK_MALLOC(R->counts);
+	mem_add(MEM_SKETCHES, words * sizeof(*R->bits) + n * sizeof(*R->counts));
+
+	// Each row is filled by one thread, but neighbouring rows share words.
+#pragma omp parallel for num_threads(THREADS) schedule(dynamic)
+	for (size_t i = 0; i < n; i++) {
+		if (groups->first[i] != i) continue;
 
-				last_was_right_anchor = false;
+		for (size_t j = i + 1; j < n; j++) {
+			if (groups->first[j] != j || !prefilter_related(pf, i, j)) {
+				continue;
 			}
 
-			// Cache values for later
-			last_match = this_match;
+			size_t bit = i * n + j;
+#pragma omp atomic
+			R->bits[bit / 64] |= UINT64_C(1) << (bit % 64);
 		}
+	}
 
-		// Advance
-		this_match.pos_Q += this_match.length + 1;
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = i + 1; j < n; j++) {
+			size_t bit = i * n + j;
+			if (!(R->bits[bit / 64] >> (bit % 64) & 1)) continue;
+
+			size_t mirror = j * n + i;
+			R->bits[mirror / 64] |= UINT64_C(1) << (mirror % 64);
+			R->counts[i]++;
+			R->counts[j]++;
+		}
 	}
 
-	// Very special case: The sequences are identical
-	if (last_match.length >= query_length) {
-		model_count_equal(&ret, query, query_length);
-		return ret;
+	stats_end(PH_SKETCH, &timer);
+}
+
+/** @brief Free the related pairs. */
+static void dist_related_free(struct dist_related *R) {
+	if (R->bits) {
+		mem_sub(MEM_SKETCHES, (R->n * R->n + 63) / 64 * sizeof(*R->bits) +
+								  R->n * sizeof(*R->counts));
 	}
+	free(R->bits);
+	free(R->counts);
+	*R = (struct dist_related){0};
+}
 
-	// We might miss a few nucleotides if the last anchor was also a right
-	// anchor. The logic is the same as a few lines above.
-	if (last_was_right_anchor) {
-		model_count_equal(&ret, query + last_match.pos_Q, last_match.length);
-	} else if (last_match.length >= threshold * 2) {
-		model_count_equal(&ret, query + last_match.pos_Q, last_match.length);
+/**
+ * @brief Whether two distinct sequences should be compared.
+ *
+ * @param R - The related pairs.
+ * @param i - The first sequence of one group.
+ * @param j - The first sequence of the other group.
+ * @returns 1 iff the pair should be compared.
+ */
+static inline int dist_related(const struct dist_related *R, size_t i,
+							   size_t j) {
+	if (!R->bits) return 1;
+
+	size_t bit = i * R->n + j;
+	return R->bits[bit / 64] >> (bit % 64) & 1;
+}
+
+/**
+ * @brief Hand the result of two sequences on for all their copies.
+ *
+ * @param groups - The groups of identical sequences.
+ * @param i - The first sequence of the subject's group.
+ * @param j - The first sequence of the query's group.
+ * @param datum - The result.
+ * @param info - The diagnostics; may be NULL.
+ * @param store - The callback.
+ * @param data - Passed on to the callback.
+ */
+static void dist_store_groups(const struct dist_groups *groups, size_t i,
+							  size_t j, const model *datum,
+							  const struct dist_info *info,
+							  dist_callback store, void *data) {
+	for (size_t a = i; a != SIZE_MAX; a = groups->next[a]) {
+		for (size_t b = j; b != SIZE_MAX; b = groups->next[b]) {
+			store(a, b, datum, info, data);
+		}
 	}
+}
 
-	return ret;
+/**
+ * @brief Hand on all pairs of a subject as missing.
+ *
+ * @param groups - The groups of identical sequences.
+ * @param n - The number of sequences.
+ * @param i - The first sequence of the subject's group.
+ * @param store - The callback.
+ * @param data - Passed on to the callback.
+ */
+static void dist_store_missing(const struct dist_groups *groups, size_t n,
+							   size_t i, dist_callback store, void *data) {
+	const model missing = {.seq_len = 0};
+	for (size_t j = 0; j < n; j++) {
+		if (j != i && groups->first[j] == j) {
+			dist_store_groups(groups, i, j, &missing, NULL, store, data);
+		}
+	}
+	progress_add(groups->distinct - 1, 0);
+}
+
+/**
+ * @brief Report a subject whose index could not be built.
+ *
+ * This is fatal, unless ::F_SOFT_INDEX is set, so that a library user is not
+ * terminated. Then the pairs of the subject are handed on as missing and all
+ * others are still compared.
+ *
+ * @param sequences - The sequences.
+ * @param n - The number of sequences.
+ * @param i - The first sequence of the subject's group.
+ * @param groups - The groups of identical sequences.
+ * @param store - The callback.
+ * @param data - Passed on to the callback.
+ */
+static void dist_index_failed(const seq_t *sequences, size_t n, size_t i,
+							  const struct dist_groups *groups,
+							  dist_callback store, void *data) {
+	if (!(FLAGS & F_SOFT_INDEX)) {
+		errx(1, "Failed to create index for %s.", sequences[i].name);
+	}
+
+#pragma omp critical(dist_index_failed)
+	soft_errx("Failed to create index for %s.", sequences[i].name);
+
+	dist_store_missing(groups, n, i, store, data);
 }
 
 /*
@@ -222,6 +826,563 @@ model dist_anchor(const esa_s *C, const char *query, size_t query_length,
 #undef FAST
 #include "dist_hack.h"
 
+/**
+ * @brief The buffers of one thread for scanning queries against a generalized
+ * index; one entry per subject each.
+ */
+struct multi_buffers {
+	struct context *ctx;
+	struct scan *sc;
+	struct profile *profiles;
+	size_t *lookups;
+	/** The subjects, as a min-heap by their position on the query. */
+	size_t *heap;
+	/** The subjects waiting for a lookup. */
+	size_t *requests;
+	struct multi_match *matches;
+	/** The subjects compared to the current query, and their results. */
+	size_t *active;
+	model *results;
+	struct dist_info *infos;
+};
+
+/**
+ * @brief Allocate the buffers of one thread.
+ *
+ * @param buf - (output parameter) The buffers.
+ * @param size - The maximum number of subjects of an index.
+ * @param print_profile - Whether profiles are recorded.
+ */
+static void multi_buffers_init(struct multi_buffers *buf, size_t size,
+							   int print_profile) {
+	*buf = (struct multi_buffers){
+		.ctx = malloc(size * sizeof(*buf->ctx)),
+		.sc = malloc(size * sizeof(*buf->sc)),
+		.profiles =
+			print_profile ? malloc(size * sizeof(*buf->profiles)) : NULL,
+		.lookups = malloc(size * sizeof(*buf->lookups)),
+		.heap = malloc(size * sizeof(*buf->heap)),
+		.requests = malloc(size * sizeof(*buf->requests)),
+		.matches = malloc(size * sizeof(*buf->matches)),
+		.active = malloc(size * sizeof(*buf->active)),
+		.results = malloc(size * sizeof(*buf->results)),
+		.infos = malloc(size * sizeof(*buf->infos))};
+
+	CHECK_MALLOC(buf->ctx);
+	CHECK_MALLOC(buf->sc);
+	CHECK_MALLOC(buf->lookups);
+	CHECK_MALLOC(buf->heap);
+	CHECK_MALLOC(buf->requests);
+	CHECK_MALLOC(buf->matches);
+	CHECK_MALLOC(buf->active);
+	CHECK_MALLOC(buf->results);
+	CHECK_MALLOC(buf->infos);
+	if (print_profile) {
+		CHECK_MALLOC(buf->profiles);
+	}
+}
+
+/** @brief Free the buffers of one thread. */
+static void multi_buffers_free(struct multi_buffers *buf) {
+	free(buf->ctx);
+	free(buf->sc);
+	free(buf->profiles);
+	free(buf->lookups);
+	free(buf->heap);
+	free(buf->requests);
+	free(buf->matches);
+	free(buf->active);
+	free(buf->results);
+	free(buf->infos);
+}
+
+/** @brief The profile of a subject; NULL without `--profile`. */
+static inline struct profile *multi_profile(struct multi_buffers *buf,
+											size_t s) {
+	return buf->profiles ? &buf->profiles[s] : NULL;
+}
+
+/** @brief Insert a subject into the heap of scans. */
+static void multi_push(size_t *heap, size_t *size, const struct scan *sc,
+					   size_t s) {
+	size_t pos = sc[s].this_match.pos_Q;
+	size_t k = (*size)++;
+	while (k > 0 && sc[heap[(k - 1) / 2]].this_match.pos_Q > pos) {
+		heap[k] = heap[(k - 1) / 2];
+		k = (k - 1) / 2;
+	}
+	heap[k] = s;
+}
+
+/** @brief Remove the subject furthest behind on the query from the heap. */
+static size_t multi_pop(size_t *heap, size_t *size, const struct scan *sc) {
+	size_t top = heap[0];
+	size_t last = heap[--(*size)];
+	size_t pos = sc[last].this_match.pos_Q;
+
+	size_t k = 0;
+	while (2 * k + 1 < *size) {
+		size_t child = 2 * k + 1;
+		if (child + 1 < *size && sc[heap[child + 1]].this_match.pos_Q <
+									 sc[heap[child]].this_match.pos_Q) {
+			child++;
+		}
+		if (sc[heap[child]].this_match.pos_Q >= pos) break;
+		heap[k] = heap[child];
+		k = child;
+	}
+	heap[k] = last;
+	return top;
+}
+
+/**
+ * @brief Compare one query against many subjects of a generalized index.
+ *
+ * The scans of all subjects advance along the query together. Lucky anchors
+ * and diagonal walks proceed per subject, as in anchor_scan(). All subjects
+ * needing a lookup at the same position of the query share it.
+ *
+ * The subjects are taken from `buf->active`; their results are written to
+ * `buf->results` and `buf->infos`.
+ *
+ * @param M - The generalized index.
+ * @param query - The query string.
+ * @param query_length - The length of the query string.
+ * @param count - The number of subjects.
+ * @param buf - The buffers of the calling thread.
+ */
+static void multi_scan(const struct multi_index *M, const char *query,
+					   size_t query_length, size_t count,
+					   struct multi_buffers *buf) {
+	const size_t *active = buf->active;
+	struct context *ctx = buf->ctx;
+	struct scan *sc = buf->sc;
+	size_t *heap = buf->heap;
+	size_t size = 0;
+
+	for (size_t a = 0; a < count; a++) {
+		size_t s = active[a];
+		size_t begin = M->start[s];
+		size_t end = M->start[s + 1] - 1;
+
+		ctx[s] = (struct context){&M->E, query, query_length,
+								  M->threshold[s], 0, end,
+								  begin + (end - begin) / 2, MODEL};
+		scan_init(&sc[s], &ctx[s], begin);
+		buf->lookups[s] = 0;
+		multi_push(heap, &size, sc, s);
+	}
+
+	while (size) {
+		size_t pos = sc[heap[0]].this_match.pos_Q;
+		size_t requests = 0;
+
+		// Advance all scans at this position that need no lookup.
+		while (size && sc[heap[0]].this_match.pos_Q == pos) {
+			size_t s = multi_pop(heap, &size, sc);
+			if (!scan_shortcut(&ctx[s], &sc[s])) {
+				buf->requests[requests++] = s;
+				continue;
+			}
+
+			scan_anchor(&ctx[s], &sc[s], multi_profile(buf, s));
+			sc[s].this_match.pos_Q += sc[s].this_match.length + 1;
+			if (sc[s].this_match.pos_Q < query_length) {
+				multi_push(heap, &size, sc, s);
+			}
+		}
+
+		if (!requests) continue;
+
+		// One lookup for all others.
+		multi_lookup(M, query + pos, query_length - pos, buf->requests,
+					 requests, buf->matches);
+
+		for (size_t k = 0; k < requests; k++) {
+			size_t s = buf->requests[k];
+			struct anchor *this_match = &sc[s].this_match;
+
+			buf->lookups[s]++;
+			this_match->pos_S = buf->matches[k].pos_S;
+			this_match->length = buf->matches[k].length;
+			COUNT_MATCH_LENGTH(this_match->length);
+
+			if (buf->matches[k].count == 1 &&
+				this_match->length >= ctx[s].threshold) {
+				scan_anchor(&ctx[s], &sc[s], multi_profile(buf, s));
+			}
+
+			this_match->pos_Q += this_match->length + 1;
+			if (this_match->pos_Q < query_length) {
+				multi_push(heap, &size, sc, s);
+			}
+		}
+	}
+
+	for (size_t a = 0; a < count; a++) {
+		size_t s = active[a];
+		buf->results[a] = scan_finish(&ctx[s], &sc[s], multi_profile(buf, s));
+		buf->infos[a] = (struct dist_info){.lookups = buf->lookups[s],
+										   .anchors = sc[s].anchors};
+	}
+}
+
+/**
+ * @brief Compare one query against all subjects of a generalized index.
+ *
+ * Pairs rejected by the prefilter are handed to the callback as an empty
+ * result. The query is skipped if it is a subject of the index itself.
+ *
+ * @param M - The generalized index.
+ * @param sequences - The sequences.
+ * @param subjects - The sequence of each subject of the index.
+ * @param j - The query.
+ * @param related - The pairs to compare
+ * @param groups - The groups of identical sequences
+ * @param store - The callback receiving each result
+ * @param data - Passed on to the callback
+ * @param buf - The buffers of the calling thread.
+ */
+static void multi_compare(const struct multi_index *M, const seq_t *sequences,
+							const size_t *subjects, size_t j,
+							const struct dist_related *related,
+							const struct dist_groups *groups,
+							dist_callback store, void *data,
+							struct multi_buffers *buf) {
+	size_t ql = sequences[j].len;
+	size_t count = 0;
+	size_t handled = 0;
+
+	for (size_t s = 0; s < M->n; s++) {
+		if (subjects[s] == j) continue;
+		handled++;
+
+		if (!dist_related(related, subjects[s], j)) {
+			const model missing = {.seq_len = 0};
+			dist_store_groups(groups, subjects[s], j, &missing, NULL, store,
+							  data);
+			continue;
+		}
+
+		buf->active[count++] = s;
+		if (buf->profiles) {
+			profile_init(&buf->profiles[s], ql);
+		}
+	}
+
+	if (!count) {
+		progress_add(handled, 0);
+		return;
+	}
+
+	struct stats_timer timer = stats_begin();
+	multi_scan(M, sequences[j].S, ql, count, buf);
+	double seconds = stats_end(PH_MATCH, &timer);
+	trace_block("match", "compare", sequences[j].name, timer.wall,
+				timer.wall + seconds);
+
+	for (size_t a = 0; a < count; a++) {
+		size_t i = subjects[buf->active[a]];
+		dist_store_groups(groups, i, j, &buf->results[a], &buf->infos[a],
+						  store, data);
+
+		if (buf->profiles) {
+			struct profile *pr = &buf->profiles[buf->active[a]];
+			for (size_t x = i; x != SIZE_MAX; x = groups->next[x]) {
+				for (size_t y = j; y != SIZE_MAX; y = groups->next[y]) {
+					profile_write(pr, sequences[x].name, sequences[y].name);
+				}
+			}
+			profile_free(pr);
+		}
+
+		stats_count_pair(0);
+		pairs_record(i, j, seconds / count, &buf->infos[a]);
+	}
+	counters_flush();
+	progress_add(handled, ql * count);
+}
+
+/**
+ * @brief Compare all sequences with a single generalized index.
+ *
+ * Instead of one index per subject, all distinct sequences are indexed
+ * together. Then each query is scanned once against all subjects. The queries
+ * are distributed over the threads.
+ *
+ * @param sequences - The sequences to compare
+ * @param n - The number of sequences
+ * @param related - The pairs to compare
+ * @param groups - The groups of identical sequences
+ * @param store - The callback receiving each result
+ * @param data - Passed on to the callback
+ */
+static void distMatrixMulti(const seq_t *sequences, size_t n,
+							const struct dist_related *related,
+							const struct dist_groups *groups,
+							dist_callback store, void *data) {
+	size_t distinct = groups->distinct;
+	size_t *subjects = malloc(distinct * sizeof(*subjects));
+	CHECK_MALLOC(subjects);
+
+	for (size_t i = 0, s = 0; i < n; i++) {
+		if (groups->first[i] == i) {
+			subjects[s++] = i;
+		}
+	}
+
+	progress_begin(n, distinct, distinct * distinct - distinct);
+
+	struct multi_index M;
+	double begin = stats_now();
+	if (multi_init(&M, sequences, subjects, distinct)) {
+		const char str[] = {"Failed to create the generalized index. Together, "
+							"the sequences may be too long for it."};
+		if (!(FLAGS & F_SOFT_INDEX)) {
+			errx(1, "%s", str);
+		}
+
+		soft_errx("%s", str);
+		for (size_t s = 0; s < distinct; s++) {
+			dist_store_missing(groups, n, subjects[s], store, data);
+		}
+		progress_end();
+		free(subjects);
+		return;
+	}
+	trace_span("index", "index", "generalized", begin, stats_now());
+
+	int print_profile = FLAGS & F_PROFILE;
+
+#pragma omp parallel num_threads(THREADS) default(none) shared(M)              \
+	firstprivate(stderr, sequences, related, groups, store, data, subjects,    \
+				 distinct, print_profile)
+	{
+		numa_bind();
+		const seq_t *local = numa_sequences(sequences);
+		struct multi_buffers buf;
+		multi_buffers_init(&buf, distinct, print_profile);
+
+#pragma omp for schedule(dynamic)
+		for (size_t q = 0; q < distinct; q++) {
+			multi_compare(&M, local, subjects, subjects[q], related, groups,
+						  store, data, &buf);
+		}
+
+		multi_buffers_free(&buf);
+	}
+
+	progress_end();
+	multi_free(&M);
+	free(subjects);
+}
+
+/**
+ * Subjects are packed into a shared index until their strands exceed this many
+ * characters. Then the index stays small enough for the caches.
+ */
+#define PACK_LENGTH (1 << 17)
+
+/**
+ * @brief Compare all sequences with shared indexes of small subjects.
+ *
+ * Like distMatrix(), but consecutive subjects are packed into one generalized
+ * index until it reaches ::PACK_LENGTH. Each pack then pays the fixed costs of
+ * an index, such as the cache, only once. Every query is scanned against all
+ * subjects of a pack at once. Longer subjects get an index of their own. The
+ * packs are distributed over the threads.
+ *
+ * @param sequences - The sequences to compare
+ * @param n - The number of sequences
+ * @param related - The pairs to compare
+ * @param groups - The groups of identical sequences
+ * @param store - The callback receiving each result
+ * @param data - Passed on to the callback
+ */
+static void distMatrixPacked(const seq_t *sequences, size_t n,
+							 const struct dist_related *related,
+							 const struct dist_groups *groups,
+							 dist_callback store, void *data) {
+	size_t distinct = groups->distinct;
+	size_t *subjects = malloc(distinct * sizeof(*subjects));
+	size_t *packs = malloc((distinct + 1) * sizeof(*packs));
+	CHECK_MALLOC(subjects);
+	CHECK_MALLOC(packs);
+
+	// Pack the subjects in their order; packs[p] is the first of pack p.
+	size_t num_packs = 0;
+	size_t pack_length = PACK_LENGTH;
+	size_t largest = 0;
+	for (size_t i = 0, s = 0; i < n; i++) {
+		if (groups->first[i] != i) continue;
+
+		size_t length = 2 * sequences[i].len + 2;
+		if (pack_length + length > PACK_LENGTH) {
+			packs[num_packs++] = s;
+			pack_length = 0;
+		}
+		pack_length += length;
+		subjects[s++] = i;
+	}
+	packs[num_packs] = distinct;
+
+	for (size_t p = 0; p < num_packs; p++) {
+		size_t size = packs[p + 1] - packs[p];
+		largest = size > largest ? size : largest;
+	}
+
+	int print_profile = FLAGS & F_PROFILE;
+	progress_begin(n, distinct, distinct * distinct - distinct);
+
+#pragma omp parallel num_threads(THREADS) default(none)                        \
+	firstprivate(stderr, sequences, n, related, groups, store, data,           \
+				 subjects, packs, num_packs, largest, distinct, print_profile)
+	{
+		numa_bind();
+		const seq_t *local = numa_sequences(sequences);
+		struct multi_buffers buf;
+		multi_buffers_init(&buf, largest, print_profile);
+
+#pragma omp for schedule(dynamic)
+		for (size_t p = 0; p < num_packs; p++) {
+			const size_t *pack = subjects + packs[p];
+			size_t size = packs[p + 1] - packs[p];
+
+			struct multi_index M;
+			double begin = stats_now();
+			if (multi_init(&M, local, pack, size)) {
+				for (size_t s = 0; s < size; s++) {
+					dist_index_failed(sequences, n, pack[s], groups, store,
+									  data);
+				}
+				continue;
+			}
+			trace_span("index", "index", sequences[pack[0]].name, begin,
+					   stats_now());
+
+			for (size_t q = 0; q < distinct; q++) {
+				multi_compare(&M, local, pack, subjects[q], related, groups,
+							  store, data, &buf);
+			}
+
+			multi_free(&M);
+		}
+
+		multi_buffers_free(&buf);
+	}
+
+	progress_end();
+
+	free(subjects);
+	free(packs);
+}
+
+/**
+ * @brief Compare all sequences against each other.
+ *
+ * Depending on the global flags, the fast, the low-memory, the generalized or
+ * the packed mode is used. The callback is called concurrently for every
+ * ordered pair of distinct sequences. With `--prefilter`, the sequences are
+ * sketched first and unrelated pairs are reported with an empty result.
+ *
+ * Identical sequences are collapsed: only the first of them is indexed and
+ * compared, and copies of a sequence are reported with a distance of zero.
+ * If the index of a subject cannot be built, this is a soft error and its pairs
+ * are reported with an empty result, too.
+ *
+ * @param sequences - The sequences to compare.
+ * @param n - The number of sequences.
+ * @param store - The callback receiving each result.
+ * @param data - Passed on to the callback.
+ * @returns the number of sequences identical to an earlier one.
+ */
+size_t dist_all(const seq_t *sequences, size_t n, dist_callback store,
+				void *data) {
+	struct dist_groups groups;
+	groups.first = malloc(n * sizeof(*groups.first));
+	groups.next = malloc(n * sizeof(*groups.next));
+	CHECK_MALLOC(groups.first);
+	CHECK_MALLOC(groups.next);
+	groups.distinct = seq_duplicates(sequences, n, groups.first);
+
+	// Link the copies in ascending order.
+	for (size_t i = 0; i < n; i++) {
+		groups.next[i] = SIZE_MAX;
+	}
+	for (size_t i = n; i-- > 0;) {
+		if (groups.first[i] != i) {
+			groups.next[i] = groups.next[groups.first[i]];
+			groups.next[groups.first[i]] = i;
+		}
+	}
+
+	// Copies are identical, so all their nucleotides match.
+	const struct dist_info none = {0};
+	for (size_t i = 0; i < n; i++) {
+		if (groups.first[i] != i || groups.next[i] == SIZE_MAX) continue;
+
+		model same = {.seq_len = sequences[i].len, .counts = {0}};
+		model_count_equal(&same, sequences[i].S, sequences[i].len, MODEL);
+		for (size_t a = i; a != SIZE_MAX; a = groups.next[a]) {
+			for (size_t b = i; b != SIZE_MAX; b = groups.next[b]) {
+				if (a != b) store(a, b, &same, &none, data);
+			}
+		}
+	}
+
+	// The sketches are not needed once all pairs are decided.
+	struct dist_related related;
+	if (FLAGS & F_PREFILTER) {
+		struct prefilter prefilter;
+		prefilter_init(&prefilter, sequences, n, PREFILTER_THRESHOLD);
+		dist_related_init(&related, &prefilter, &groups, n);
+		prefilter_free(&prefilter);
+	} else {
+		dist_related_init(&related, NULL, &groups, n);
+	}
+
+	// The main thread builds the shared indexes on the first node.
+	numa_bind();
+	numa_replicate(sequences, n);
+
+	if (FLAGS & F_GENERALIZED) {
+		distMatrixMulti(sequences, n, &related, &groups, store, data);
+	} else if (FLAGS & F_PACKED) {
+		distMatrixPacked(sequences, n, &related, &groups, store, data);
+	} else if (FLAGS & F_LOW_MEMORY) {
+		distMatrixLM(sequences, n, &related, &groups, store, data);
+	} else {
+		distMatrix(sequences, n, &related, &groups, store, data);
+	}
+
+	numa_replicate_free();
+	dist_related_free(&related);
+
+	free(groups.first);
+	free(groups.next);
+	return n - groups.distinct;
+}
+
+/**
+ * @brief The matrix of all comparisons.
+ */
+struct dist_matrix {
+	struct model *M;
+	/** The variances of sampled distances; NULL without `--sample`. */
+	double *V;
+	size_t n;
+};
+
+/** @brief Store a result in the matrix. */
+static void dist_store(size_t subject, size_t query, const struct model *datum,
+					   const struct dist_info *info, void *data) {
+	struct dist_matrix *matrix = data;
+	matrix->M[subject * matrix->n + query] = *datum;
+	if (matrix->V) {
+		matrix->V[subject * matrix->n + query] = info ? info->variance : NAN;
+	}
+}
+
 /**
  * @brief Calculates and prints the distance matrix
  * @param sequences - An array of pointers to the sequences.
@@ -239,34 +1400,65 @@ void calculate_distances(seq_t *sequences, size_t n) {
 
 	M = malloc(n * n * sizeof(*M));
 	if (!M) {
+		int errnum = errno;
+		mem_print(stderr);
+		errno = errnum;
 		err(errno, "Could not allocate enough memory for the comparison "
 				   "matrix. Try using --join or --low-memory.");
 	}
+	mem_add(MEM_MATRIX, n * n * sizeof(*M));
 
 	// compute the distances
-	if (FLAGS & F_LOW_MEMORY) {
-		distMatrixLM(M, sequences, n);
-	} else {
-		distMatrix(M, sequences, n);
+	for (size_t i = 0; i < n; i++) {
+		M(i, i) = (struct model){.seq_len = 9, .counts = {9}};
+	}
+
+	double *V = NULL;
+	if (SAMPLE_WINDOWS) {
+		V = calloc(n * n, sizeof(*V));
+		CHECK_MALLOC(V);
+		mem_add(MEM_MATRIX, n * n * sizeof(*V));
 	}
 
+	struct dist_matrix matrix = {M, V, n};
+	size_t duplicates = dist_all(sequences, n, dist_store, &matrix);
+	if (duplicates) {
+		warnx("%zu of the %zu sequences are identical to an earlier one. Each "
+			  "distinct sequence was compared only once.",
+			  duplicates, n);
+	}
+
+	pairs_finish(M, sequences, n);
+
 	// print the results
+	struct stats_timer timer = stats_begin();
 	print_distances(M, sequences, n, 1);
+	if (V) {
+		print_intervals(M, V, sequences, n);
+	}
 
 	// print additional information.
 	if (FLAGS & F_VERBOSE) {
 		print_coverages(M, n);
 	}
+	stats_end(PH_PRINT, &timer);
 
 	// create new bootstrapped distance matrices
 	if (BOOTSTRAP) {
+		timer = stats_begin();
 		int res = calculate_bootstrap(M, sequences, n);
 		if (res) {
 			soft_errx("Bootstrapping failed.");
 		}
+		stats_end(PH_BOOTSTRAP, &timer);
 	}
 
 	free(M);
+	mem_sub(MEM_MATRIX, n * n * sizeof(*M));
+	if (V) {
+		free(V);
+		mem_sub(MEM_MATRIX, n * n * sizeof(*V));
+	}
 }
 
 /** Yet another hack. */
@@ -295,6 +1487,7 @@ int calculate_bootstrap(const struct model *M, const seq_t *sequences,
 	// B is the new bootstrap matrix
 	struct model *B = malloc(n * n * sizeof(*B));
 	CHECK_MALLOC(B);
+	mem_add(MEM_BOOTSTRAP, n * n * sizeof(*B));
 
 	// Compute a number of new distance matrices
 	while (BOOTSTRAP--) {
@@ -317,5 +1510,6 @@ int calculate_bootstrap(const struct model *M, const seq_t *sequences,
 	}
 
 	free(B);
+	mem_sub(MEM_BOOTSTRAP, n * n * sizeof(*B));
 	return 0;
 }
@@ -6,8 +6,46 @@
 #ifndef _PROCESS_H_
 #define _PROCESS_H_
 
+#include "esa.h"
+#include "model.h"
 #include "sequence.h"
 
+/**
+ * @brief Diagnostics of a single comparison.
+ */
+struct dist_info {
+	/** The number of lookups in the ESA of the subject. */
+	size_t lookups;
+	/** The number of anchors found. */
+	size_t anchors;
+	/** Non-zero iff the comparison was aborted for low coverage. */
+	int aborted;
+	/** With `--sample`, the jackknife variance of the distance; else zero. */
+	double variance;
+};
+
+/**
+ * @brief Receives the result of comparing a query against a subject.
+ *
+ * @param subject - The index of the subject.
+ * @param query - The index of the query.
+ * @param datum - The substitutions found.
+ * @param info - The diagnostics; NULL for pairs skipped by the prefilter.
+ * @param data - The data passed to dist_all().
+ */
+typedef void (*dist_callback)(size_t subject, size_t query,
+							  const struct model *datum,
+							  const struct dist_info *info, void *data);
+
+struct profile;
+
+model dist_anchor(const esa_s *C, const char *query, size_t query_length,
+				  size_t threshold, struct dist_info *info);
+model dist_anchor_profile(const esa_s *C, const char *query,
+						  size_t query_length, size_t threshold, int kind,
+						  struct dist_info *info, struct profile *profile);
+size_t dist_all(const seq_t *sequences, size_t n, dist_callback store,
+				void *data);
 void calculate_distances(seq_t *sequences, size_t n);
 
 #endif
@@ -0,0 +1,159 @@
+/**
+ * @file
+ * @brief Distance profiles along the query
+ *
+ * The profiles of all pairs are written to a single tab-separated file, one
+ * line per window: the names of subject and query, the start and end of the
+ * window on the query (zero-based, end exclusive), the distance and the
+ * coverage. The lines of a pair are consecutive, but the pairs are in no
+ * particular order. Positions refer to the query after non-ACGT characters
+ * were stripped.
+ */
+#include "profile.h"
+#include "global.h"
+#include <errno.h>
+#include <stdio.h>
+
+static FILE *PROFILE = NULL;
+static size_t PROFILE_WINDOW = 0;
+static size_t PROFILE_STEP = 0;
+
+/**
+ * @brief Prepare an empty profile for a query.
+ *
+ * @param pr - (output parameter) The profile.
+ * @param query_length - The length of the query.
+ */
+void profile_init(struct profile *pr, size_t query_length) {
+	size_t step = PROFILE_STEP;
+	size_t count = (query_length + step - 1) / step;
+
+	pr->bins = calloc(count, sizeof(*pr->bins));
+	CHECK_MALLOC(pr->bins);
+	pr->count = count;
+	pr->step = step;
+
+	for (size_t b = 0; b < count; b++) {
+		pr->bins[b].seq_len = step;
+	}
+	if (count) {
+		pr->bins[count - 1].seq_len = query_length - (count - 1) * step;
+	}
+}
+
+/** @brief Free a profile. */
+void profile_free(struct profile *pr) {
+	free(pr->bins);
+	*pr = (struct profile){NULL, 0, 0};
+}
+
+/**
+ * @brief Count a stretch of matching nucleotides.
+ *
+ * @param pr - The profile.
+ * @param query - The query.
+ * @param pos - The start of the stretch on the query.
+ * @param length - The length of the stretch.
+ * @param kind - The model; see model_count_equal().
+ */
+void profile_count_equal(struct profile *pr, const char *query, size_t pos,
+						 size_t length, int kind) {
+	size_t end = pos + length;
+	while (pos < end) {
+		size_t b = pos / pr->step;
+		size_t bin_end = (b + 1) * pr->step;
+		size_t piece = (bin_end < end ? bin_end : end) - pos;
+
+		model_count_equal(&pr->bins[b], query + pos, piece, kind);
+		pos += piece;
+	}
+}
+
+/**
+ * @brief Count the substitutions between an aligned stretch of subject and
+ * query.
+ *
+ * @param pr - The profile.
+ * @param subject - The subject, aligned to `query + pos`.
+ * @param query - The query.
+ * @param pos - The start of the stretch on the query.
+ * @param length - The length of the stretch.
+ */
+void profile_count(struct profile *pr, const char *subject, const char *query,
+				   size_t pos, size_t length) {
+	size_t end = pos + length;
+	size_t done = 0;
+	while (pos < end) {
+		size_t b = pos / pr->step;
+		size_t bin_end = (b + 1) * pr->step;
+		size_t piece = (bin_end < end ? bin_end : end) - pos;
+
+		model_count(&pr->bins[b], subject + done, query + pos, piece);
+		pos += piece;
+		done += piece;
+	}
+}
+
+/**
+ * @brief Open the file for the profiles of all pairs.
+ *
+ * @param file_name - The file.
+ * @param window - The length of a window; a multiple of `step`.
+ * @param step - The distance between the starts of two windows.
+ * @returns 0 iff successful.
+ */
+int profile_open(const char *file_name, size_t window, size_t step) {
+	PROFILE = fopen(file_name, "w");
+	if (!PROFILE) {
+		soft_err("%s", file_name);
+		return 1;
+	}
+
+	PROFILE_WINDOW = window;
+	PROFILE_STEP = step;
+
+	fprintf(PROFILE, "subject\tquery\tstart\tend\tdistance\tcoverage\n");
+	return 0;
+}
+
+/**
+ * @brief Write the windows of one pair.
+ *
+ * This function may be called concurrently; the lines of a pair are not
+ * interleaved with others.
+ *
+ * @param pr - The profile.
+ * @param subject_name - The name of the subject.
+ * @param query_name - The name of the query.
+ */
+void profile_write(const struct profile *pr, const char *subject_name,
+				   const char *query_name) {
+	if (!PROFILE || pr->count == 0) return;
+
+	size_t per_window = PROFILE_WINDOW / pr->step;
+	size_t windows = pr->count > per_window ? pr->count - per_window + 1 : 1;
+
+#pragma omp critical(profile)
+	for (size_t w = 0; w < windows; w++) {
+		model sum = {.seq_len = 0, .counts = {0}};
+		size_t last = w + per_window < pr->count ? w + per_window : pr->count;
+		for (size_t b = w; b < last; b++) {
+			sum = model_average(&sum, &pr->bins[b]);
+		}
+
+		size_t start = w * pr->step;
+		fprintf(PROFILE, "%s\t%s\t%zu\t%zu\t%1.4e\t%1.4e\n", subject_name,
+				query_name, start, start + sum.seq_len,
+				model_estimate(&sum, MODEL), model_coverage(&sum));
+	}
+}
+
+/** @brief Close the file of the profiles. */
+void profile_close(void) {
+	if (!PROFILE) return;
+
+	if (fclose(PROFILE) != 0) {
+		soft_err("Writing the profiles failed");
+	}
+	PROFILE = NULL;
+}
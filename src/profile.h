@@ -0,0 +1,40 @@
+/**
+ * @file
+ * @brief Distance profiles along the query
+ *
+ * To find recombinant regions, the distance of a pair is needed per window of
+ * the query rather than for the whole sequence. With `--window`, every
+ * comparison records its substitutions in bins along the query while it scans.
+ * Sliding windows are sums of consecutive bins. Each pair then yields a
+ * profile from a single index and a single scan.
+ */
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include "model.h"
+#include <stdlib.h>
+
+/**
+ * @brief The substitutions of one comparison, binned along the query.
+ */
+struct profile {
+	/** One matrix per bin; the last bin may be shorter. */
+	model *bins;
+	size_t count;
+	/** The length of a bin; the step between two windows. */
+	size_t step;
+};
+
+void profile_init(struct profile *, size_t query_length);
+void profile_free(struct profile *);
+void profile_count_equal(struct profile *, const char *query, size_t pos,
+						 size_t length, int kind);
+void profile_count(struct profile *, const char *subject, const char *query,
+				   size_t pos, size_t length);
+
+int profile_open(const char *file_name, size_t window, size_t step);
+void profile_write(const struct profile *, const char *subject_name,
+				   const char *query_name);
+void profile_close(void);
+
+#endif // _PROFILE_H_
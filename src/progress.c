@@ -0,0 +1,253 @@
+/**
+ * @file
+ * @brief Progress of the comparisons
+ *
+ * A slot is only ever written by its own thread, while the reporter reads all
+ * of them. Relaxed atomic accesses suffice for that: a sample may miss the
+ * latest pairs, but the next one will count them. The slots are padded to a
+ * cache line each, so that the workers do not slow each other down.
+ */
+#include "progress.h"
+#include "global.h"
+#include "slots.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** The reporter samples the slots this often, in seconds. */
+#define PROGRESS_INTERVAL 1
+
+/**
+ * @brief The progress of a single thread.
+ */
+struct progress_slot {
+	/** The finished pairs, including skipped ones. */
+	size_t pairs;
+	/** The nucleotides of the compared queries. */
+	size_t bases;
+} __attribute__((aligned(SLOT_ALIGNMENT)));
+
+static struct progress_slot *SLOTS = NULL;
+static size_t SLOTS_COUNT = 0;
+
+/** The descriptor for lines of JSON; negative if none. */
+static int FD = -1;
+
+static pthread_t REPORTER;
+static pthread_mutex_t LOCK = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t WAKE = PTHREAD_COND_INITIALIZER;
+/** Whether a comparison is reported, and whether the reporter runs. */
+static int ACTIVE = 0;
+static int RUNNING = 0;
+static int STOP = 0;
+
+static size_t SEQUENCES = 0;
+static size_t DISTINCT = 0;
+static size_t TOTAL = 0;
+static double START = 0.0;
+
+/** @brief The time in seconds since some fixed point. */
+static double progress_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Prepare the slots for all threads.
+ *
+ * Nothing is counted unless the progress is printed (`--progress`) or sent to
+ * a file descriptor.
+ *
+ * @param threads - The maximum number of threads used.
+ * @param fd - The file descriptor for lines of JSON; negative for none.
+ */
+void progress_init(size_t threads, int fd) {
+	if (!(FLAGS & F_PRINT_PROGRESS) && fd < 0) return;
+	if (threads == 0) threads = 1;
+
+	SLOTS = slots_new(threads, sizeof(*SLOTS));
+	SLOTS_COUNT = threads;
+	FD = fd;
+}
+
+/** @brief Stop reporting and free the slots. */
+void progress_free(void) {
+	progress_end();
+	free(SLOTS);
+	SLOTS = NULL;
+	SLOTS_COUNT = 0;
+	FD = -1;
+}
+
+/**
+ * @brief Count finished pairs of the calling thread.
+ *
+ * @param pairs - The number of pairs.
+ * @param bases - The nucleotides of their queries; zero for skipped pairs.
+ */
+void progress_add(size_t pairs, size_t bases) {
+	struct progress_slot *slot =
+		slots_local(SLOTS, SLOTS_COUNT, sizeof(*SLOTS));
+	if (!slot) return;
+
+	// Only this thread writes the slot.
+	__atomic_store_n(&slot->pairs, slot->pairs + pairs, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->bases, slot->bases + bases, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Format a duration as `h:mm:ss`.
+ *
+ * @param buffer - The buffer to write to.
+ * @param size - The size of the buffer.
+ * @param seconds - The duration; negative if unknown.
+ */
+static void progress_duration(char *buffer, size_t size, double seconds) {
+	if (seconds < 0) {
+		snprintf(buffer, size, "-:--:--");
+		return;
+	}
+
+	size_t total = (size_t)(seconds + 0.5);
+	snprintf(buffer, size, "%zu:%02zu:%02zu", total / 3600, total / 60 % 60,
+			 total % 60);
+}
+
+/**
+ * @brief Sum up all slots and report the progress.
+ *
+ * @param done - Whether all pairs are finished.
+ */
+static void progress_report(int done) {
+	size_t pairs = 0, bases = 0;
+	for (size_t t = 0; t < SLOTS_COUNT; t++) {
+		pairs += __atomic_load_n(&SLOTS[t].pairs, __ATOMIC_RELAXED);
+		bases += __atomic_load_n(&SLOTS[t].bases, __ATOMIC_RELAXED);
+	}
+
+	double elapsed = progress_now() - START;
+	double pairs_rate = elapsed > 0 ? pairs / elapsed : 0.0;
+	double bases_rate = elapsed > 0 ? bases / elapsed : 0.0;
+	double percent = TOTAL ? 100.0 * pairs / TOTAL : 100.0;
+
+	// Extrapolate from the average rate so far.
+	double eta = -1.0;
+	if (done) {
+		eta = 0.0;
+	} else if (pairs > 0 && pairs <= TOTAL) {
+		eta = (TOTAL - pairs) / pairs_rate;
+	}
+
+	if (FLAGS & F_PRINT_PROGRESS) {
+		char remaining[32] = "done.";
+		if (!done) {
+			char duration[24];
+			progress_duration(duration, sizeof(duration), eta);
+			snprintf(remaining, sizeof(remaining), "ETA %s", duration);
+		}
+
+		// Copies of a sequence are not compared, so the pairs are those of
+		// the distinct sequences.
+		char sequences[64];
+		if (DISTINCT < SEQUENCES) {
+			snprintf(sequences, sizeof(sequences),
+					 "%zu sequences (%zu distinct)", SEQUENCES, DISTINCT);
+		} else {
+			snprintf(sequences, sizeof(sequences), "%zu sequences", SEQUENCES);
+		}
+
+		fprintf(stderr,
+				"\rComparing %s: %5.1f%% (%zu/%zu), %.0f pairs/s, %.1f Mbp/s, "
+				"%-12s",
+				sequences, percent, pairs, TOTAL, pairs_rate, bases_rate / 1e6,
+				remaining);
+		if (done) fprintf(stderr, "\n");
+	}
+
+	if (FD >= 0) {
+		char eta_str[32] = "null";
+		if (eta >= 0) snprintf(eta_str, sizeof(eta_str), "%.3f", eta);
+
+		dprintf(FD,
+				"{\"sequences\": %zu, \"distinct\": %zu, \"pairs\": %zu, "
+				"\"total\": %zu, \"bases\": %zu, \"elapsed\": %.3f, "
+				"\"pairs_per_second\": %.3f, \"bases_per_second\": %.3f, "
+				"\"eta\": %s, \"done\": %s}\n",
+				SEQUENCES, DISTINCT, pairs, TOTAL, bases, elapsed, pairs_rate,
+				bases_rate, eta_str, done ? "true" : "false");
+	}
+}
+
+/** @brief The reporter thread. */
+static void *progress_reporter(void *arg) {
+	(void)arg;
+
+	pthread_mutex_lock(&LOCK);
+	while (!STOP) {
+		// The condition variable waits on the realtime clock.
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += PROGRESS_INTERVAL;
+
+		while (!STOP) {
+			if (pthread_cond_timedwait(&WAKE, &LOCK, &deadline) != 0) break;
+		}
+		if (STOP) break;
+
+		pthread_mutex_unlock(&LOCK);
+		progress_report(0);
+		pthread_mutex_lock(&LOCK);
+	}
+	pthread_mutex_unlock(&LOCK);
+
+	return NULL;
+}
+
+/**
+ * @brief Start reporting the progress of a comparison.
+ *
+ * @param sequences - The number of sequences compared.
+ * @param distinct - The number of distinct sequences among them.
+ * @param pairs - The number of pairs to finish, among the distinct sequences.
+ */
+void progress_begin(size_t sequences, size_t distinct, size_t pairs) {
+	if (!SLOTS || ACTIVE) return;
+
+	memset(SLOTS, 0, SLOTS_COUNT * sizeof(*SLOTS));
+	SEQUENCES = sequences;
+	DISTINCT = distinct;
+	TOTAL = pairs;
+	START = progress_now();
+	STOP = 0;
+
+	ACTIVE = 1;
+	progress_report(0);
+
+	if (pthread_create(&REPORTER, NULL, progress_reporter, NULL) != 0) {
+		warnx("Failed to start reporting the progress.");
+		return;
+	}
+	RUNNING = 1;
+}
+
+/** @brief Stop the reporter and report the final state. */
+void progress_end(void) {
+	if (!SLOTS || !ACTIVE) return;
+
+	if (RUNNING) {
+		pthread_mutex_lock(&LOCK);
+		STOP = 1;
+		pthread_cond_signal(&WAKE);
+		pthread_mutex_unlock(&LOCK);
+
+		pthread_join(REPORTER, NULL);
+		RUNNING = 0;
+	}
+
+	progress_report(1);
+	ACTIVE = 0;
+}
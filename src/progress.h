@@ -0,0 +1,22 @@
+/**
+ * @file
+ * @brief Progress of the comparisons
+ *
+ * Every thread counts its finished pairs and compared nucleotides in a slot of
+ * its own. A separate reporter thread samples the slots once per second. It
+ * prints a progress line with the rates and the remaining time to stderr, and
+ * optionally a line of JSON per sample to a file descriptor, e.g. for a
+ * workflow manager. The workers never synchronize for the progress.
+ */
+#ifndef _PROGRESS_H_
+#define _PROGRESS_H_
+
+#include <stdlib.h>
+
+void progress_init(size_t threads, int fd);
+void progress_free(void);
+void progress_begin(size_t sequences, size_t distinct, size_t pairs);
+void progress_add(size_t pairs, size_t bases);
+void progress_end(void);
+
+#endif // _PROGRESS_H_
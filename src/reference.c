@@ -0,0 +1,133 @@
+/**
+ * @file
+ * @brief A set of indexed references
+ *
+ * Comparing a query to a reference works just like a pair of the distance
+ * matrix: The query is matched against the index of the reference, and the
+ * reference against an index of the query. Thus a query costs one additional
+ * index, but no matrix of all pairs.
+ */
+#include "reference.h"
+#include "global.h"
+#include "process.h"
+#include <string.h>
+#include <sys/mman.h>
+
+/**
+ * @brief Index all references.
+ *
+ * The indices are built in parallel. Every index that cannot be built is
+ * reported. Then the set is freed again.
+ *
+ * @param rs - The set to initialise.
+ * @param sequences - The references. They have to outlive the set.
+ * @param n - The number of references.
+ * @returns 0 iff all indices were built.
+ */
+int reference_set_init(struct reference_set *rs, const seq_t *sequences,
+					   size_t n) {
+	*rs = (struct reference_set){};
+	rs->data = malloc(n * sizeof(*rs->data));
+	CHECK_MALLOC(rs->data);
+	rs->size = n;
+
+	int failed = 0;
+	size_t i;
+#pragma omp parallel for num_threads(THREADS) schedule(dynamic, 1)
+	for (i = 0; i < n; i++) {
+		struct reference *ref = &rs->data[i];
+		*ref = (struct reference){.seq = &sequences[i]};
+		if (seq_subject_init(&ref->subject, ref->seq) ||
+			esa_init(&ref->E, &ref->subject)) {
+#pragma omp critical(reference_set_init)
+			warnx("Failed to create index for %s.", ref->seq->name);
+#pragma omp atomic write
+			failed = 1;
+		}
+	}
+
+	if (failed) {
+		reference_set_free(rs);
+		return 1;
+	}
+	return 0;
+}
+
+/** @brief Free all indices, or unmap the database. */
+void reference_set_free(struct reference_set *rs) {
+	if (rs->map) {
+		// The sequences and indices point into the mapping.
+		munmap(rs->map, rs->map_size);
+		free(rs->sequences);
+	} else {
+		for (size_t i = 0; i < rs->size; i++) {
+			esa_free(&rs->data[i].E);
+			seq_subject_free(&rs->data[i].subject);
+		}
+	}
+	free(rs->data);
+	*rs = (struct reference_set){};
+}
+
+/**
+ * @brief Compare a query to all references in both directions.
+ *
+ * @param rs - The references.
+ * @param query - The query.
+ * @param forward - (output parameter) The query matched against each
+ * reference; one per reference.
+ * @param backward - (output parameter) Each reference matched against the
+ * query; one per reference.
+ * @returns 0 iff successful.
+ */
+int reference_set_compare(const struct reference_set *rs, const seq_t *query,
+						  struct model *forward, struct model *backward) {
+	seq_subject subject;
+	esa_s E;
+
+	if (seq_subject_init(&subject, query)) {
+		return 1;
+	}
+	if (esa_init(&E, &subject)) {
+		seq_subject_free(&subject);
+		return 1;
+	}
+
+	size_t i, n = rs->size;
+#pragma omp parallel for num_threads(THREADS) schedule(dynamic, 1)
+	for (i = 0; i < n; i++) {
+		const struct reference *ref = &rs->data[i];
+		forward[i] = dist_anchor(&ref->E, query->S, query->len,
+								 ref->subject.threshold, NULL);
+		backward[i] = dist_anchor(&E, ref->seq->S, ref->seq->len,
+								  subject.threshold, NULL);
+	}
+
+	esa_free(&E);
+	seq_subject_free(&subject);
+	return 0;
+}
+
+/**
+ * @brief Print one line per reference.
+ *
+ * Each line holds the names of the query and reference, the distance as
+ * estimated by the global model, and the coverage of the query and the
+ * reference, separated by tabs.
+ *
+ * @param file - The file to print to.
+ * @param rs - The references.
+ * @param query - The query.
+ * @param forward - The query matched against each reference.
+ * @param backward - Each reference matched against the query.
+ */
+void reference_set_print(FILE *file, const struct reference_set *rs,
+						 const seq_t *query, const struct model *forward,
+						 const struct model *backward) {
+	for (size_t i = 0; i < rs->size; i++) {
+		model datum = model_average(&forward[i], &backward[i]);
+		fprintf(file, "%s\t%s\t%1.4e\t%1.4e\t%1.4e\n", query->name,
+				rs->data[i].seq->name, model_estimate(&datum, MODEL),
+				model_coverage(&forward[i]), model_coverage(&backward[i]));
+	}
+}
@@ -0,0 +1,52 @@
+/**
+ * @file
+ * @brief A set of indexed references
+ *
+ * Some workloads compare a few queries against many fixed references. Instead
+ * of the full matrix, the references are indexed once and every query is
+ * compared to all of them in both directions.
+ */
+#ifndef _REFERENCE_H_
+#define _REFERENCE_H_
+
+#include "esa.h"
+#include "model.h"
+#include "sequence.h"
+#include <stdio.h>
+
+/**
+ * @brief A reference with its index.
+ */
+struct reference {
+	/** The reference sequence; not owned. */
+	const seq_t *seq;
+	/** Both strands of the reference. */
+	seq_subject subject;
+	/** The index of both strands. */
+	esa_s E;
+};
+
+/**
+ * @brief All references.
+ */
+struct reference_set {
+	struct reference *data;
+	size_t size;
+	/** The sequences of a database, if mapped; owned. */
+	seq_t *sequences;
+	/** The mapped database, or NULL if the indices were built. */
+	void *map;
+	/** The size of the mapping. */
+	size_t map_size;
+};
+
+int reference_set_init(struct reference_set *, const seq_t *sequences,
+					   size_t n);
+void reference_set_free(struct reference_set *);
+int reference_set_compare(const struct reference_set *, const seq_t *query,
+						  struct model *forward, struct model *backward);
+void reference_set_print(FILE *, const struct reference_set *,
+						 const seq_t *query, const struct model *forward,
+						 const struct model *backward);
+
+#endif // _REFERENCE_H_
@@ -7,16 +7,17 @@
 #include <ctype.h>
 #include <limits.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "global.h"
 #include "sequence.h"
+#include "stats.h"
 #include <compat-stdlib.h>
 
 void normalize(seq_t *S);
 double shustring_cum_prob(size_t x, double g, size_t l);
-size_t min_anchor_length(double p, double g, size_t l);
 
 /** Create a new dynamic array for sequences. */
 int dsa_init(dsa_t *A) {
@@ -117,6 +118,7 @@ seq_t dsa_join(dsa_t *A) {
 
 	// Don't forget the null byte.
 	*next = '\0';
+	mem_add(MEM_SEQUENCES, total);
 
 	joined.S = ptr;
 	joined.len = total - 1; // subtract the null byte
@@ -124,16 +126,234 @@ seq_t dsa_join(dsa_t *A) {
 	return joined;
 }
 
+/** @brief A sequence and the hash of its residues. */
+struct seq_hash {
+	uint64_t hash;
+	size_t index;
+};
+
+static int seq_hash_compare(const void *a, const void *b) {
+	const struct seq_hash *x = a, *y = b;
+	if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+	return (x->index > y->index) - (x->index < y->index);
+}
+
+/**
+ * @brief Find identical sequences.
+ *
+ * The residues of all sequences are hashed (FNV-1a). Sequences with the same
+ * hash are compared in full.
+ *
+ * @param sequences - The normalized sequences.
+ * @param n - The number of sequences.
+ * @param first - (output parameter) For each sequence, the index of the first
+ * identical one; itself if there is none before.
+ * @returns the number of distinct sequences.
+ */
+size_t seq_duplicates(const seq_t *sequences, size_t n, size_t *first) {
+	struct seq_hash *hashes = malloc(n * sizeof(*hashes));
+	CHECK_MALLOC(hashes);
+
+#pragma omp parallel for num_threads(THREADS) schedule(dynamic)
+	for (size_t i = 0; i < n; i++) {
+		uint64_t hash = 0xcbf29ce484222325ULL;
+		const unsigned char *p = (const unsigned char *)sequences[i].S;
+		for (size_t k = 0; k < sequences[i].len; k++) {
+			hash = (hash ^ p[k]) * 0x100000001b3ULL;
+		}
+		hashes[i] = (struct seq_hash){hash, i};
+	}
+
+	qsort(hashes, n, sizeof(*hashes), seq_hash_compare);
+
+	size_t distinct = 0;
+	for (size_t k = 0; k < n; k++) {
+		size_t i = hashes[k].index;
+		first[i] = i;
+
+		// Within a run of equal hashes, the indices are ascending. Usually,
+		// the previous sequence is already identical.
+		for (size_t l = k; l-- > 0 && hashes[l].hash == hashes[k].hash;) {
+			size_t j = first[hashes[l].index];
+			if (sequences[j].len == sequences[i].len &&
+				memcmp(sequences[j].S, sequences[i].S, sequences[i].len) == 0) {
+				first[i] = j;
+				break;
+			}
+		}
+
+		distinct += first[i] == i;
+	}
+
+	free(hashes);
+	return distinct;
+}
+
 /**
  * @brief Frees the memory of a given sequence.
  * @param S - The sequence to free.
  */
 void seq_free(seq_t *S) {
+	if (S->S) mem_sub(MEM_SEQUENCES, S->len + 1);
 	free(S->S);
 	free(S->name);
 	*S = (seq_t){};
 }
 
+/**
+ * @brief Complement a single nucleotide.
+ *
+ * The canonical nucleotides are mapped onto each other by flipping a few bits:
+ * A and T differ by 21, C and G by 4. Bit 1 tells which pair a character
+ * belongs to. Everything smaller than 'A' (i.e. `!`) becomes a `;`.
+ */
+static inline char complement(char c) {
+	return c < 'A' ? ';' /* rosebud */ : c ^ (c & 2 ? 4 : 21);
+}
+
+/**
+ * @brief The portable reverse complement kernel.
+ *
+ * Writes the reverse complement of `str` to `rev` and, if `fwd` is not NULL,
+ * a verbatim copy of `str` to `fwd`. Neither output is null-terminated.
+ *
+ * @param rev - Output buffer for the reverse complement; `len` bytes.
+ * @param fwd - Optional output buffer for the forward strand; `len` bytes.
+ * @param str - The master string.
+ * @param len - The length of the master string.
+ */
+static void revcomp_generic(char *rev, char *fwd, const char *str,
+							size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		rev[i] = complement(str[len - 1 - i]);
+	}
+
+	if (fwd) {
+		memcpy(fwd, str, len);
+	}
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_SIMD_REVCOMP 1
+#include <immintrin.h>
+
+/*
+ * The vectorized kernels below process the master string back to front. Each
+ * block is loaded once, its bytes are reversed via a shuffle and complemented
+ * with the same bit trick as in complement(). Optionally the unmodified block
+ * is stored as part of the forward strand. Thus the whole subject string is
+ * produced in a single pass over the input.
+ */
+
+/** @brief Complement 16 nucleotides at once. See complement(). */
+__attribute__((target("ssse3"))) static inline __m128i
+complement_sse(__m128i c) {
+	// c & 2 ? 4 : 21 == 4 ^ ((c & 2) == 0 ? 17 : 0)
+	__m128i pair = _mm_cmpeq_epi8(_mm_and_si128(c, _mm_set1_epi8(2)),
+								  _mm_setzero_si128());
+	__m128i mask = _mm_xor_si128(_mm_set1_epi8(4),
+								 _mm_and_si128(pair, _mm_set1_epi8(17)));
+	__m128i comp = _mm_xor_si128(c, mask);
+
+	// Replace everything below 'A' by ';'.
+	__m128i special = _mm_cmpgt_epi8(_mm_set1_epi8('A'), c);
+	return _mm_or_si128(_mm_and_si128(special, _mm_set1_epi8(';')),
+						_mm_andnot_si128(special, comp));
+}
+
+/** @brief The SSSE3 reverse complement kernel. See revcomp_generic(). */
+__attribute__((target("ssse3"))) static void
+revcomp_ssse3(char *rev, char *fwd, const char *str, size_t len) {
+	const __m128i reverse =
+		_mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		size_t offset = len - 16 - i;
+		__m128i block = _mm_loadu_si128((const __m128i *)(str + offset));
+
+		if (fwd) {
+			_mm_storeu_si128((__m128i *)(fwd + offset), block);
+		}
+
+		block = complement_sse(_mm_shuffle_epi8(block, reverse));
+		_mm_storeu_si128((__m128i *)(rev + i), block);
+	}
+
+	// The remaining head of the master string.
+	revcomp_generic(rev + i, fwd, str, len - i);
+}
+
+/** @brief Complement 32 nucleotides at once. See complement(). */
+__attribute__((target("avx2"))) static inline __m256i
+complement_avx2(__m256i c) {
+	__m256i pair = _mm256_cmpeq_epi8(_mm256_and_si256(c, _mm256_set1_epi8(2)),
+									 _mm256_setzero_si256());
+	__m256i mask = _mm256_xor_si256(
+		_mm256_set1_epi8(4), _mm256_and_si256(pair, _mm256_set1_epi8(17)));
+	__m256i comp = _mm256_xor_si256(c, mask);
+
+	__m256i special = _mm256_cmpgt_epi8(_mm256_set1_epi8('A'), c);
+	return _mm256_or_si256(_mm256_and_si256(special, _mm256_set1_epi8(';')),
+						   _mm256_andnot_si256(special, comp));
+}
+
+/** @brief The AVX2 reverse complement kernel. See revcomp_generic(). */
+__attribute__((target("avx2"))) static void
+revcomp_avx2(char *rev, char *fwd, const char *str, size_t len) {
+	// vpshufb only shuffles within 128 bit lanes. The lanes are swapped below.
+	const __m256i reverse = _mm256_setr_epi8(
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12,
+		11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		size_t offset = len - 32 - i;
+		__m256i block = _mm256_loadu_si256((const __m256i *)(str + offset));
+
+		if (fwd) {
+			_mm256_storeu_si256((__m256i *)(fwd + offset), block);
+		}
+
+		block = _mm256_shuffle_epi8(block, reverse);
+		block = _mm256_permute4x64_epi64(block, 0x4e);
+		block = complement_avx2(block);
+		_mm256_storeu_si256((__m256i *)(rev + i), block);
+	}
+
+	revcomp_ssse3(rev + i, fwd, str, len - i);
+}
+
+#endif // HAVE_SIMD_REVCOMP
+
+/**
+ * @brief Compute the reverse complement and optionally copy the forward strand.
+ *
+ * This function dispatches to the fastest kernel supported by the CPU at
+ * runtime.
+ *
+ * @param rev - Output buffer for the reverse complement; `len` bytes.
+ * @param fwd - Optional output buffer for the forward strand; `len` bytes.
+ * @param str - The master string.
+ * @param len - The length of the master string.
+ */
+static void revcomp_dispatch(char *rev, char *fwd, const char *str,
+							 size_t len) {
+#ifdef HAVE_SIMD_REVCOMP
+	if (__builtin_cpu_supports("avx2")) {
+		revcomp_avx2(rev, fwd, str, len);
+		return;
+	}
+
+	if (__builtin_cpu_supports("ssse3")) {
+		revcomp_ssse3(rev, fwd, str, len);
+		return;
+	}
+#endif
+
+	revcomp_generic(rev, fwd, str, len);
+}
+
 /**
  * @brief Compute the reverse complement.
  * @param str The master string.
@@ -145,29 +365,19 @@ char *revcomp(const char *str, size_t len) {
 	char *rev = malloc(len + 1);
 	CHECK_MALLOC(rev);
 
-	char *r = rev;
-	const char *s = &str[len - 1];
+	revcomp_dispatch(rev, NULL, str, len);
 	rev[len] = '\0';
 
-	do {
-		char c = *s--;
-		char d;
-
-		if (c < 'A') {
-			d = ';'; // rosebud
-		} else {
-			d = c ^= c & 2 ? 4 : 21;
-		}
-
-		*r++ = d;
-	} while (--len);
-
 	return rev;
 }
 
 /**
  * @brief This function concatenates the reverse complement to a given master
  * string. A `#` sign is used as a separator.
+ *
+ * The result is allocated once and filled in a single pass over the master
+ * string.
+ *
  * @param s The master string.
  * @param len Its length.
  * @return The newly concatenated string.
@@ -175,15 +385,12 @@ char *revcomp(const char *str, size_t len) {
 char *catcomp(char *s, size_t len) {
 	if (!s) return NULL;
 
-	char *rev = revcomp(s, len);
-
-	char *temp = realloc(rev, 2 * len + 2);
-	CHECK_MALLOC(temp);
+	char *rev = malloc(2 * len + 2);
+	CHECK_MALLOC(rev);
 
-	rev = temp;
+	revcomp_dispatch(rev, rev + len + 1, s, len);
 	rev[len] = '#';
-
-	memcpy(rev + len + 1, s, len + 1);
+	rev[2 * len + 1] = '\0';
 
 	return rev;
 }
@@ -212,6 +419,7 @@ int seq_subject_init(seq_subject *S, const seq_t *base) {
 	S->RS = catcomp(base->S, base->len);
 	if (!S->RS) return 1;
 	S->RSlen = 2 * base->len + 1;
+	mem_add(MEM_RS, S->RSlen + 1);
 
 	S->threshold = min_anchor_length(ANCHOR_P_VALUE, S->gc, S->RSlen);
 
@@ -221,6 +429,7 @@ int seq_subject_init(seq_subject *S, const seq_t *base) {
 /** @brief Frees some memory unused for when a sequence is only used as query.
  */
 void seq_subject_free(seq_subject *S) {
+	if (S->RS) mem_sub(MEM_RS, S->RSlen + 1);
 	free(S->RS);
 	S->RS = NULL;
 	S->RSlen = 0;
@@ -241,11 +450,14 @@ int seq_init(seq_t *S, const char *seq, const char *name) {
 	CHECK_MALLOC(S->S);
 	CHECK_MALLOC(S->name);
 
+	struct stats_timer timer = stats_begin();
 	normalize(S);
+	stats_end(PH_NORMALIZE, &timer);
 
 	// recalculate the length because `normalize` might have stripped some
 	// characters.
 	S->len = strlen(S->S);
+	mem_add(MEM_SEQUENCES, S->len + 1);
 
 	return 0;
 }
@@ -47,6 +47,7 @@ typedef struct seq_subject {
 void seq_free(seq_t *S);
 int seq_subject_init(seq_subject *S, const seq_t *);
 void seq_subject_free(seq_subject *S);
+size_t min_anchor_length(double p, double g, size_t l);
 int seq_init(seq_t *S, const char *seq, const char *name);
 
 /**
@@ -65,4 +66,6 @@ seq_t *dsa_data(dsa_t *A);
 
 seq_t dsa_join(dsa_t *dsa);
 
+size_t seq_duplicates(const seq_t *sequences, size_t n, size_t *first);
+
 #endif
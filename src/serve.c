@@ -0,0 +1,358 @@
+/**
+ * @file
+ * @brief A resident server for queries against preloaded references
+ *
+ * A request is a stream of FASTA records. The client signals its end by
+ * shutting down its side of the connection. Every record is a query; in join
+ * mode all records of a request form a single query named after the first
+ * record. For each query the server prints one line per reference, as done by
+ * reference_set_print(), and closes the connection. A failed request is
+ * answered with a single line starting with `error`.
+ *
+ * Requests are handled one after another. Each comparison is parallelized over
+ * the references. Thus, a client that neither sends nor receives would block
+ * all others. A connection is therefore dropped after ::SERVE_TIMEOUT seconds
+ * without progress.
+ */
+#define _GNU_SOURCE
+#include "serve.h"
+#include "global.h"
+#include "model.h"
+#include "reference.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pfasta.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/** The time in seconds a read or write on a connection may block. */
+#define SERVE_TIMEOUT 10
+
+/** Set by a signal to stop the server. */
+static volatile sig_atomic_t STOP = 0;
+
+/** @brief Stop accepting new requests. */
+static void serve_stop(int signum) {
+	(void)signum;
+	STOP = 1;
+}
+
+/**
+ * @brief Fill in the address of a socket.
+ *
+ * @param address - (output parameter) The address.
+ * @param socket_path - The path of the socket.
+ * @returns 0 iff the path fits into the address.
+ */
+static int serve_address(struct sockaddr_un *address, const char *socket_path) {
+	memset(address, 0, sizeof(*address));
+	address->sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(address->sun_path)) {
+		warnx("The socket path '%s' is too long.", socket_path);
+		return 1;
+	}
+	strcpy(address->sun_path, socket_path);
+	return 0;
+}
+
+/** @brief Describe why reading a request failed. */
+static void serve_read_error(const struct pfasta_parser *pp, char *error,
+							 size_t error_size) {
+	if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		snprintf(error, error_size, "no data for %d seconds", SERVE_TIMEOUT);
+	} else {
+		snprintf(error, error_size, "%s", pp->errstr);
+	}
+}
+
+/**
+ * @brief Read the queries of a request.
+ *
+ * @param connection - The connection to read from.
+ * @param queries - (output parameter) The queries.
+ * @param error - (output parameter) A description of the failure.
+ * @param error_size - The size of the error buffer.
+ * @returns 0 iff successful.
+ */
+static int serve_read(int connection, dsa_t *queries, char *error,
+					  size_t error_size) {
+	// Tell a timeout apart from other failures.
+	errno = 0;
+	struct pfasta_parser pp = pfasta_init(connection);
+	if (pp.errstr) {
+		serve_read_error(&pp, error, error_size);
+		pfasta_free(&pp);
+		return 1;
+	}
+
+	while (!pp.done) {
+		errno = 0;
+		struct pfasta_record pr = pfasta_read(&pp);
+		if (pp.errstr) {
+			serve_read_error(&pp, error, error_size);
+			pfasta_free(&pp);
+			return 1;
+		}
+
+		seq_t top;
+		if (seq_init(&top, pr.sequence, pr.name) == 0) {
+			dsa_push(queries, top);
+		}
+		pfasta_record_free(&pr);
+	}
+	pfasta_free(&pp);
+
+	if (dsa_size(queries) == 0) {
+		snprintf(error, error_size, "no query given");
+		return 1;
+	}
+
+	if (FLAGS & F_JOIN && dsa_size(queries) > 1) {
+		char *name = strdup(dsa_data(queries)[0].name);
+		CHECK_MALLOC(name);
+
+		seq_t joined = dsa_join(queries);
+		joined.name = name;
+		dsa_free(queries);
+		dsa_init(queries);
+		dsa_push(queries, joined);
+	}
+
+	const size_t LENGTH_LIMIT = (INT_MAX - 1) / 2;
+	for (size_t i = 0; i < dsa_size(queries); i++) {
+		const seq_t *query = &dsa_data(queries)[i];
+		if (query->len == 0 || query->len > LENGTH_LIMIT) {
+			snprintf(error, error_size, "the length of %s is not supported",
+					 query->name);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Answer a single request.
+ *
+ * @param connection - The connected client.
+ * @param rs - The references.
+ */
+static void serve_request(int connection, const struct reference_set *rs) {
+	int out_descriptor = dup(connection);
+	FILE *out = out_descriptor < 0 ? NULL : fdopen(out_descriptor, "w");
+	if (!out) {
+		warn("Failed to answer a request");
+		if (out_descriptor >= 0) close(out_descriptor);
+		return;
+	}
+
+	dsa_t queries;
+	dsa_init(&queries);
+
+	char error[256];
+	if (serve_read(connection, &queries, error, sizeof(error))) {
+		fprintf(out, "error\t%s\n", error);
+		goto done;
+	}
+
+	struct model *forward = malloc(rs->size * sizeof(*forward));
+	struct model *backward = malloc(rs->size * sizeof(*backward));
+	CHECK_MALLOC(forward);
+	CHECK_MALLOC(backward);
+
+	for (size_t i = 0; i < dsa_size(&queries); i++) {
+		const seq_t *query = &dsa_data(&queries)[i];
+		if (reference_set_compare(rs, query, forward, backward)) {
+			fprintf(out, "error\tfailed to create index for %s\n",
+					query->name);
+			break;
+		}
+		reference_set_print(out, rs, query, forward, backward);
+	}
+
+	free(forward);
+	free(backward);
+
+done:
+	if (fclose(out) != 0 && FLAGS & F_VERBOSE) {
+		warn("Failed to answer a request");
+	}
+	dsa_free(&queries);
+}
+
+/**
+ * @brief Answer requests until interrupted.
+ *
+ * @param socket_path - The path of the Unix domain socket to listen on.
+ * @param rs - The indexed references.
+ * @returns the exit status.
+ */
+int serve(const char *socket_path, const struct reference_set *rs) {
+	struct sockaddr_un address;
+	if (serve_address(&address, socket_path)) {
+		return EXIT_FAILURE;
+	}
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		err(1, "%s", socket_path);
+	}
+
+	// Replace the socket of a previous server, but nothing else.
+	struct stat st;
+	if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		unlink(socket_path);
+	}
+
+	if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+		listen(listener, 16) != 0) {
+		err(1, "%s", socket_path);
+	}
+
+	// Interrupt accept() on a signal, so the socket can be removed.
+	struct sigaction action = {.sa_handler = serve_stop};
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	// A client which hangs up early must not kill the server.
+	signal(SIGPIPE, SIG_IGN);
+
+	if (FLAGS & F_VERBOSE) {
+		fprintf(stderr, "Serving %zu references on %s.\n", rs->size,
+				socket_path);
+	}
+
+	while (!STOP) {
+		int connection = accept(listener, NULL, NULL);
+		if (connection < 0) {
+			if (errno != EINTR && errno != ECONNABORTED) {
+				soft_err("%s", socket_path);
+				break;
+			}
+			continue;
+		}
+
+		// A stalled client must not block the server.
+		struct timeval timeout = {.tv_sec = SERVE_TIMEOUT};
+		if (setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+					   sizeof(timeout)) != 0 ||
+			setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+					   sizeof(timeout)) != 0) {
+			warn("Failed to limit the time of a request");
+		}
+
+		serve_request(connection, rs);
+		close(connection);
+	}
+
+	close(listener);
+	unlink(socket_path);
+
+	return FLAGS & F_SOFT_ERROR ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Write a whole buffer.
+ *
+ * @returns 0 iff successful.
+ */
+static int write_all(int file_descriptor, const char *buffer, size_t count) {
+	while (count > 0) {
+		ssize_t written = write(file_descriptor, buffer, count);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return 1;
+		}
+		buffer += written;
+		count -= written;
+	}
+	return 0;
+}
+
+/**
+ * @brief Send files to a server and print its answer.
+ *
+ * The files are sent as they are; the server parses them.
+ *
+ * @param socket_path - The socket of the server.
+ * @param file_names - The query files.
+ * @returns the exit status.
+ */
+int serve_client(const char *socket_path, struct string_vector *file_names) {
+	struct sockaddr_un address;
+	if (serve_address(&address, socket_path)) {
+		return EXIT_FAILURE;
+	}
+
+	int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (connection < 0 ||
+		connect(connection, (struct sockaddr *)&address, sizeof(address))) {
+		err(1, "%s", socket_path);
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	char buffer[1 << 16];
+	for (size_t i = 0; i < string_vector_size(file_names); i++) {
+		const char *file_name = string_vector_at(file_names, i);
+		int file_descriptor = strcmp(file_name, "-")
+								  ? open(file_name, O_RDONLY)
+								  : STDIN_FILENO;
+		if (file_descriptor < 0) {
+			soft_err("%s", file_name);
+			continue;
+		}
+
+		ssize_t count;
+		while ((count = read(file_descriptor, buffer, sizeof(buffer))) > 0) {
+			if (write_all(connection, buffer, count)) {
+				err(1, "%s", socket_path);
+			}
+		}
+		if (count < 0) {
+			soft_err("%s", file_name);
+		}
+
+		if (file_descriptor != STDIN_FILENO) {
+			close(file_descriptor);
+		}
+	}
+
+	// Signal the end of the request.
+	shutdown(connection, SHUT_WR);
+
+	// Copy the answer and watch out for errors at the start of a line. A line
+	// may be split between two reads, so the matched prefix is carried over.
+	const char marker[] = "error\t";
+	const size_t marker_length = sizeof(marker) - 1;
+	size_t matched = 0; // SIZE_MAX once the line cannot match anymore
+	ssize_t count;
+	while ((count = read(connection, buffer, sizeof(buffer))) > 0) {
+		for (ssize_t k = 0; k < count; k++) {
+			if (buffer[k] == '\n') {
+				matched = 0;
+			} else if (matched < marker_length) {
+				matched = buffer[k] == marker[matched] ? matched + 1 : SIZE_MAX;
+				if (matched == marker_length) {
+					FLAGS |= F_SOFT_ERROR;
+				}
+			}
+		}
+		if (write_all(STDOUT_FILENO, buffer, count)) {
+			err(1, "stdout");
+		}
+	}
+	if (count < 0) {
+		err(1, "%s", socket_path);
+	}
+
+	close(connection);
+	return FLAGS & F_SOFT_ERROR ? EXIT_FAILURE : EXIT_SUCCESS;
+}
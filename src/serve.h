@@ -0,0 +1,19 @@
+/**
+ * @file
+ * @brief A resident server for queries against preloaded references
+ *
+ * With `andi serve` the references are read and indexed only once. Then
+ * queries are answered over a Unix domain socket until the server is
+ * interrupted. `andi client` sends query files to a running server and prints
+ * the answer.
+ */
+#ifndef _SERVE_H_
+#define _SERVE_H_
+
+#include "io.h"
+#include "reference.h"
+
+int serve(const char *socket_path, const struct reference_set *rs);
+int serve_client(const char *socket_path, struct string_vector *file_names);
+
+#endif // _SERVE_H_
@@ -0,0 +1,251 @@
+/**
+ * @file
+ * @brief Sketches to predict unrelated pairs
+ *
+ * A k-mer is hashed in its canonical form, so that both strands of a sequence
+ * yield the same sketch. Only hashes below `UINT64_MAX / SKETCH_SCALE` are
+ * kept. The containment of one sketch in another estimates the fraction of
+ * k-mers the query shares with the subject. With a divergence of d, about
+ * (1-d)^k of the k-mers are shared. Unrelated genomes share only those k-mers
+ * that occur in the subject by chance.
+ *
+ * Near the threshold, only a handful of hashes are shared, so the containment
+ * is noisy. Hence, a pair is only skipped if its shared hashes are
+ * significantly fewer than expected at the threshold. Sketches too small for
+ * such a test never skip a pair.
+ */
+#include "sketch.h"
+#include "global.h"
+#include "stats.h"
+#include <math.h>
+#include <string.h>
+
+/** The probability of skipping a pair exactly at the threshold. */
+#define SKETCH_ALPHA 0.001
+
+/** Above this mean, the Poisson distribution is approximated as normal. */
+#define SKETCH_POISSON_MAX 100
+
+/** @brief Mix the bits of a k-mer; the finalizer of MurmurHash3. */
+static inline uint64_t sketch_hash(uint64_t key) {
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+static int sketch_compare(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief Compute the sketch of a sequence.
+ *
+ * @param sk - (output parameter) The sketch.
+ * @param S - The sequence. Characters other than ACGT end a k-mer.
+ */
+void sketch_init(struct sketch *sk, const seq_t *S) {
+	const uint64_t mask = (1ULL << (2 * SKETCH_K)) - 1;
+	const uint64_t bound = UINT64_MAX / SKETCH_SCALE;
+
+	size_t capacity = 2 * (S->len / SKETCH_SCALE) + 16;
+	uint64_t *hashes = malloc(capacity * sizeof(*hashes));
+	CHECK_MALLOC(hashes);
+	size_t size = 0;
+
+	uint64_t forward = 0, reverse = 0;
+	size_t valid = 0;
+	for (size_t i = 0; i < S->len; i++) {
+		uint64_t c;
+		switch (S->S[i]) {
+			case 'A': c = 0; break;
+			case 'C': c = 1; break;
+			case 'G': c = 2; break;
+			case 'T': c = 3; break;
+			default: valid = 0; continue;
+		}
+
+		forward = ((forward << 2) | c) & mask;
+		reverse = (reverse >> 2) | ((3 - c) << (2 * (SKETCH_K - 1)));
+		if (++valid < SKETCH_K) continue;
+
+		uint64_t hash =
+			sketch_hash(forward < reverse ? forward : reverse);
+		if (hash > bound) continue;
+
+		if (size == capacity) {
+			capacity = capacity / 2 * 3;
+			uint64_t *ptr = realloc(hashes, capacity * sizeof(*hashes));
+			CHECK_MALLOC(ptr);
+			hashes = ptr;
+		}
+		hashes[size++] = hash;
+	}
+
+	qsort(hashes, size, sizeof(*hashes), sketch_compare);
+
+	size_t unique = 0;
+	for (size_t i = 0; i < size; i++) {
+		if (unique == 0 || hashes[unique - 1] != hashes[i]) {
+			hashes[unique++] = hashes[i];
+		}
+	}
+
+	sk->hashes = hashes;
+	sk->size = unique;
+}
+
+/** @brief Free a sketch. */
+void sketch_free(struct sketch *sk) {
+	free(sk->hashes);
+	*sk = (struct sketch){NULL, 0};
+}
+
+/** @brief Count the hashes two sketches share. */
+static size_t sketch_shared(const struct sketch *a, const struct sketch *b) {
+	size_t shared = 0;
+	size_t i = 0, j = 0;
+	while (i < a->size && j < b->size) {
+		if (a->hashes[i] < b->hashes[j]) {
+			i++;
+		} else if (a->hashes[i] > b->hashes[j]) {
+			j++;
+		} else {
+			shared++;
+			i++;
+			j++;
+		}
+	}
+
+	return shared;
+}
+
+/**
+ * @brief Estimate which fraction of the query is contained in the subject.
+ *
+ * @param query - The sketch of the query.
+ * @param subject - The sketch of the subject.
+ * @returns the containment; 0 for an empty query.
+ */
+double sketch_containment(const struct sketch *query,
+						  const struct sketch *subject) {
+	if (query->size == 0) return 0.0;
+
+	return (double)sketch_shared(query, subject) / (double)query->size;
+}
+
+/**
+ * @brief Sketch all sequences of a comparison.
+ *
+ * @param pf - (output parameter) The prefilter.
+ * @param sequences - The sequences.
+ * @param n - The number of sequences.
+ * @param threshold - The minimum containment of a pair to be compared.
+ */
+void prefilter_init(struct prefilter *pf, const seq_t *sequences, size_t n,
+					double threshold) {
+	struct stats_timer timer = stats_begin();
+
+	pf->sketches = malloc(n * sizeof(*pf->sketches));
+	CHECK_MALLOC(pf->sketches);
+	pf->n = n;
+	pf->threshold = threshold;
+
+#pragma omp parallel for num_threads(THREADS) schedule(dynamic)
+	for (size_t i = 0; i < n; i++) {
+		sketch_init(&pf->sketches[i], &sequences[i]);
+	}
+
+	size_t bytes = n * sizeof(*pf->sketches);
+	for (size_t i = 0; i < n; i++) {
+		bytes += pf->sketches[i].size * sizeof(uint64_t);
+	}
+	mem_add(MEM_SKETCHES, bytes);
+
+	stats_end(PH_SKETCH, &timer);
+}
+
+/** @brief Free all sketches of a prefilter. */
+void prefilter_free(struct prefilter *pf) {
+	size_t bytes = pf->n * sizeof(*pf->sketches);
+	for (size_t i = 0; i < pf->n; i++) {
+		bytes += pf->sketches[i].size * sizeof(uint64_t);
+		sketch_free(&pf->sketches[i]);
+	}
+	mem_sub(MEM_SKETCHES, bytes);
+
+	free(pf->sketches);
+	pf->sketches = NULL;
+	pf->n = 0;
+}
+
+/**
+ * @brief The probability of at most `x` events with Poisson mean `mu`.
+ */
+static double sketch_poisson_cdf(size_t x, double mu) {
+	if (mu > SKETCH_POISSON_MAX) {
+		return 0.5 * erfc((mu - x - 0.5) / sqrt(2 * mu));
+	}
+
+	double term = exp(-mu);
+	double sum = term;
+	for (size_t i = 1; i <= x; i++) {
+		term *= mu / i;
+		sum += term;
+	}
+	return sum;
+}
+
+/**
+ * @brief Test whether a query shares significantly fewer hashes with a subject
+ * than expected at the threshold.
+ *
+ * The subject contains about `size * SKETCH_SCALE` of the `4^k / 2` canonical
+ * k-mers. Any k-mer of the query is found in the subject by chance with that
+ * ratio, and the homologous ones on top of it.
+ *
+ * @param query - The sketch of the query.
+ * @param subject - The sketch of the subject.
+ * @param threshold - The containment of homologous k-mers.
+ * @returns 1 iff the query is significantly less contained.
+ */
+static int sketch_below(const struct sketch *query,
+						const struct sketch *subject, double threshold) {
+	double chance = (double)subject->size * SKETCH_SCALE /
+					(double)(1ULL << (2 * SKETCH_K - 1));
+	if (chance > 1.0) chance = 1.0;
+
+	double expected = chance + (1.0 - chance) * threshold;
+	double mean = expected * query->size;
+	size_t shared = sketch_shared(query, subject);
+	if (shared >= mean) return 0;
+
+	return sketch_poisson_cdf(shared, mean) < SKETCH_ALPHA;
+}
+
+/**
+ * @brief Predict whether two sequences share enough homology to be compared.
+ *
+ * The decision is symmetric, so that both directions of a pair are either
+ * compared or skipped. A pair is skipped only if both sequences share
+ * significantly fewer hashes than expected at the threshold. So sketches too
+ * small to tell never skip a pair.
+ *
+ * @param pf - The prefilter; may be NULL.
+ * @param i - The index of one sequence.
+ * @param j - The index of the other sequence.
+ * @returns 1 iff the pair should be compared.
+ */
+int prefilter_related(const struct prefilter *pf, size_t i, size_t j) {
+	if (!pf) return 1;
+
+	const struct sketch *a = &pf->sketches[i];
+	const struct sketch *b = &pf->sketches[j];
+
+	return !sketch_below(a, b, pf->threshold) ||
+		   !sketch_below(b, a, pf->threshold);
+}
@@ -0,0 +1,62 @@
+/**
+ * @file
+ * @brief Sketches to predict unrelated pairs
+ *
+ * Comparing two sequences without any homology costs just as much as comparing
+ * two closely related ones, only to yield a nan or a meaningless distance.
+ * With `--prefilter` every sequence is reduced to a small sketch of its k-mers
+ * right after it is loaded. If neither sketch of a pair is contained in the
+ * other to the given degree, the comparison is skipped and the distance is
+ * reported as missing.
+ */
+#ifndef _SKETCH_H_
+#define _SKETCH_H_
+
+#include "sequence.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * The length of the sketched k-mers. Shorter k-mers survive more substitutions,
+ * but longer ones are less often shared by chance. Seventeen balances both for
+ * genomes of a few megabases at the reach of andi.
+ */
+#define SKETCH_K 17
+
+/** On average, one in this many k-mers is part of a sketch. */
+#define SKETCH_SCALE 100
+
+/**
+ * @brief The sketch of a sequence.
+ *
+ * The sketch contains the hashes of all canonical k-mers below a fixed bound
+ * (FracMinHash), sorted and without duplicates. Because the bound is the same
+ * for all sequences, sketches of different sizes are still comparable.
+ */
+struct sketch {
+	uint64_t *hashes;
+	size_t size;
+};
+
+void sketch_init(struct sketch *, const seq_t *S);
+void sketch_free(struct sketch *);
+double sketch_containment(const struct sketch *query,
+						  const struct sketch *subject);
+
+/**
+ * @brief The sketches of all sequences of a comparison.
+ */
+struct prefilter {
+	struct sketch *sketches;
+	size_t n;
+	/** Pairs significantly below this containment in both directions are
+	 * skipped. */
+	double threshold;
+};
+
+void prefilter_init(struct prefilter *, const seq_t *sequences, size_t n,
+					double threshold);
+void prefilter_free(struct prefilter *);
+int prefilter_related(const struct prefilter *, size_t i, size_t j);
+
+#endif // _SKETCH_H_
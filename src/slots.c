@@ -0,0 +1,58 @@
+/**
+ * @file
+ * @brief Per-thread slots
+ *
+ * See slots.h. The type of a slot has to be declared with
+ * `__attribute__((aligned(SLOT_ALIGNMENT)))`, so that its size is a multiple of
+ * a cache line.
+ */
+#include "slots.h"
+#include "global.h"
+#include <errno.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * @brief Allocate zeroed slots, aligned to a cache line.
+ *
+ * @param count - The number of slots; usually the number of threads.
+ * @param size - The size of a single slot.
+ * @returns the slots. Free them with free().
+ */
+void *slots_new(size_t count, size_t size) {
+	void *ptr = NULL;
+	if (posix_memalign(&ptr, SLOT_ALIGNMENT, count * size) != 0) {
+		ptr = NULL;
+	}
+	CHECK_MALLOC(ptr);
+	memset(ptr, 0, count * size);
+
+	return ptr;
+}
+
+/** @brief The number of the calling OpenMP thread. */
+size_t slots_thread(void) {
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+/**
+ * @brief Get the slot of the calling thread.
+ *
+ * @param slots - The slots; may be NULL.
+ * @param count - The number of slots.
+ * @param size - The size of a single slot.
+ * @returns the slot, or NULL if there are no slots or the thread has none.
+ */
+void *slots_local(void *slots, size_t count, size_t size) {
+	size_t t = slots_thread();
+	if (!slots || t >= count) return NULL;
+
+	return (char *)slots + t * size;
+}
@@ -0,0 +1,23 @@
+/**
+ * @file
+ * @brief Per-thread slots
+ *
+ * Several modules gather data per thread, such as the statistics, the trace or
+ * the progress. Each thread owns a slot, which only it writes, and the slots
+ * are padded to a cache line, so that threads do not slow each other down. The
+ * slot of a thread is found by its OpenMP thread number. A thread beyond the
+ * number of slots gets none, instead of sharing the slot of another thread.
+ */
+#ifndef _SLOTS_H_
+#define _SLOTS_H_
+
+#include <stdlib.h>
+
+/** The alignment of every slot; the size of a cache line. */
+#define SLOT_ALIGNMENT 64
+
+void *slots_new(size_t count, size_t size);
+size_t slots_thread(void);
+void *slots_local(void *slots, size_t count, size_t size);
+
+#endif // _SLOTS_H_
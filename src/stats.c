@@ -0,0 +1,348 @@
+/**
+ * @file
+ * @brief Run time statistics
+ *
+ * This file implements a simple instrumentation layer to find out where the
+ * time of a run goes. Each thread owns a slot with accumulated wall clock and
+ * CPU times per phase. The slots are padded to a cache line, so threads do not
+ * interfere with each other. At the end of a run all slots are written as JSON
+ * via stats_write().
+ */
+#define _GNU_SOURCE
+#include "stats.h"
+#include "counters.h"
+#include "global.h"
+#include "numa.h"
+#include "slots.h"
+#include "trace.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/** @brief The names of the phases as used in the JSON output. */
+static const char *PHASE_NAMES[PH_COUNT] = {
+	"parse", "normalize", "sketch", "SA",	 "LCP",	  "CLD",
+	"FVC",	 "cache",	  "match",	"print", "bootstrap"};
+
+/**
+ * @brief The statistics gathered by a single thread.
+ */
+struct stats_thread {
+	/** Accumulated wall clock time per phase. */
+	double wall[PH_COUNT];
+	/** Accumulated CPU time per phase. */
+	double cpu[PH_COUNT];
+	/** The number of subjects indexed by this thread. */
+	size_t subjects;
+	/** The number of pairs compared by this thread. */
+	size_t pairs;
+	/** The number of those aborted for low coverage. */
+	size_t aborted;
+	/** Accumulated hardware counters per phase. */
+	uint64_t perf[PH_COUNT][PERF_EVENTS];
+} __attribute__((aligned(SLOT_ALIGNMENT)));
+
+static struct stats_thread *STATS = NULL;
+static size_t STATS_THREADS = 0;
+static struct stats_timer STATS_START;
+static double STATS_START_PROCESS_CPU;
+
+/** @brief Read a clock and convert it to seconds. */
+static double read_clock(clockid_t clock) {
+	struct timespec ts;
+	if (clock_gettime(clock, &ts) != 0) {
+		return 0.0;
+	}
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/** @brief The flags which require the timers to run. */
+#define STATS_TIMING (F_STATS | F_PAIR_STATS | F_TRACE)
+
+/** @brief Get the slot of the calling thread; NULL if it has none. */
+static struct stats_thread *stats_local(void) {
+	return slots_local(STATS, STATS_THREADS, sizeof(*STATS));
+}
+
+/**
+ * @brief Allocate the per-thread slots and start the clock.
+ *
+ * @param threads - The maximum number of threads used.
+ */
+void stats_init(size_t threads) {
+	if (!(FLAGS & F_STATS)) return;
+	if (threads == 0) threads = 1;
+
+	STATS = slots_new(threads, sizeof(*STATS));
+	STATS_THREADS = threads;
+	STATS_START = stats_begin();
+	STATS_START_PROCESS_CPU = read_clock(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+/** @brief Free the per-thread slots. */
+void stats_free(void) {
+	free(STATS);
+	STATS = NULL;
+	STATS_THREADS = 0;
+}
+
+/**
+ * @brief Start timing a phase.
+ *
+ * @returns the current wall clock and thread CPU time.
+ */
+struct stats_timer stats_begin(void) {
+	if (!(FLAGS & STATS_TIMING)) {
+		return (struct stats_timer){0.0, 0.0};
+	}
+
+	struct stats_timer timer = {read_clock(CLOCK_MONOTONIC),
+								read_clock(CLOCK_THREAD_CPUTIME_ID)};
+	if (FLAGS & F_PERF) {
+		perf_read(&timer.perf);
+	}
+
+	return timer;
+}
+
+/**
+ * @brief Read the wall clock.
+ *
+ * @returns the current wall clock time in seconds or zero, if no timing was
+ * requested.
+ */
+double stats_now(void) {
+	if (!(FLAGS & STATS_TIMING)) return 0.0;
+
+	return read_clock(CLOCK_MONOTONIC);
+}
+
+/**
+ * @brief Stop timing a phase and add the elapsed time to the calling thread.
+ *
+ * @param phase - The phase to account the time to.
+ * @param start - The value returned by stats_begin().
+ * @returns the elapsed wall clock time in seconds.
+ */
+double stats_end(enum stats_phase phase, const struct stats_timer *start) {
+	if (!(FLAGS & STATS_TIMING)) return 0.0;
+
+	struct stats_timer stop = stats_begin();
+	double elapsed = stop.wall - start->wall;
+
+	// Comparisons are traced as blocks by the caller.
+	if (FLAGS & F_TRACE && phase != PH_MATCH) {
+		trace_span("phase", PHASE_NAMES[phase], NULL, start->wall, stop.wall);
+	}
+
+	struct stats_thread *local = FLAGS & F_STATS ? stats_local() : NULL;
+	if (local) {
+		local->wall[phase] += elapsed;
+		local->cpu[phase] += stop.cpu - start->cpu;
+		if (FLAGS & F_PERF) {
+			perf_accumulate(local->perf[phase], &start->perf, &stop.perf);
+		}
+	}
+
+	return elapsed;
+}
+
+/**
+ * @brief Get the wall clock time accumulated for a phase.
+ *
+ * @param phase - The phase.
+ * @returns the time in seconds, summed over all threads.
+ */
+double stats_wall(enum stats_phase phase) {
+	double wall = 0.0;
+	for (size_t t = 0; t < STATS_THREADS; t++) {
+		wall += STATS[t].wall[phase];
+	}
+	return wall;
+}
+
+/** @brief Count a subject indexed by the calling thread. */
+void stats_count_subject(void) {
+	struct stats_thread *local = stats_local();
+	if (!(FLAGS & F_STATS) || !local) return;
+	local->subjects++;
+}
+
+/**
+ * @brief Count a pair compared by the calling thread.
+ *
+ * @param aborted - Non-zero iff the comparison was aborted for low coverage.
+ */
+void stats_count_pair(int aborted) {
+	struct stats_thread *local = stats_local();
+	if (!(FLAGS & F_STATS) || !local) return;
+	local->pairs++;
+	local->aborted += aborted != 0;
+}
+
+/** @brief Print the phases of one slot as a JSON object. */
+static void stats_write_phases(FILE *file, const double *wall,
+							   const double *cpu, const char *indent) {
+	fprintf(file, "{\n");
+	for (int phase = 0; phase < PH_COUNT; phase++) {
+		fprintf(file, "%s\t\"%s\": {\"wall\": %.6f, \"cpu\": %.6f}%s\n", indent,
+				PHASE_NAMES[phase], wall[phase], cpu[phase],
+				phase + 1 < PH_COUNT ? "," : "");
+	}
+	fprintf(file, "%s}", indent);
+}
+
+/** @brief Print one set of hardware counters as a JSON object. */
+static void stats_write_counters(FILE *file, const uint64_t *values) {
+	fprintf(file, "{");
+	for (size_t k = 0; k < PERF_EVENTS; k++) {
+		fprintf(file, "%s\"%s\": ", k ? ", " : "", perf_event_name(k));
+		if (perf_event_available(k)) {
+			fprintf(file, "%" PRIu64, values[k]);
+		} else {
+			fprintf(file, "null");
+		}
+	}
+	fprintf(file, "}");
+}
+
+/**
+ * @brief Print the hardware counters of all phases as a JSON object.
+ *
+ * Besides the individual phases, the construction of the index is summed up.
+ */
+static void stats_write_perf(FILE *file, uint64_t perf[][PERF_EVENTS]) {
+	const char *error = perf_error();
+	if (error) {
+		fprintf(file, "{\"available\": false, \"error\": \"%s\"}", error);
+		return;
+	}
+
+	uint64_t index[PERF_EVENTS] = {0};
+	for (int phase = PH_SA; phase <= PH_CACHE; phase++) {
+		for (size_t k = 0; k < PERF_EVENTS; k++) {
+			index[k] += perf[phase][k];
+		}
+	}
+
+	fprintf(file, "{\n\t\t\"available\": true,\n");
+	fprintf(file, "\t\t\"index\": ");
+	stats_write_counters(file, index);
+	fprintf(file, ",\n\t\t\"phases\": {\n");
+	for (int phase = 0; phase < PH_COUNT; phase++) {
+		fprintf(file, "\t\t\t\"%s\": ", PHASE_NAMES[phase]);
+		stats_write_counters(file, perf[phase]);
+		fprintf(file, "%s\n", phase + 1 < PH_COUNT ? "," : "");
+	}
+	fprintf(file, "\t\t}\n\t}");
+}
+
+/**
+ * @brief Write all gathered statistics as JSON.
+ *
+ * @param file_name - The file to write to.
+ * @param n - The number of sequences.
+ * @returns 0 iff successful.
+ */
+int stats_write(const char *file_name, size_t n) {
+	if (!(FLAGS & F_STATS) || !STATS || !file_name) return 1;
+
+	struct stats_timer stop = stats_begin();
+	double process_cpu = read_clock(CLOCK_PROCESS_CPUTIME_ID);
+
+	FILE *file = fopen(file_name, "w");
+	if (!file) {
+		soft_err("%s", file_name);
+		return 1;
+	}
+
+	// Sum up all threads.
+	struct stats_thread total = {};
+	for (size_t t = 0; t < STATS_THREADS; t++) {
+		for (int phase = 0; phase < PH_COUNT; phase++) {
+			total.wall[phase] += STATS[t].wall[phase];
+			total.cpu[phase] += STATS[t].cpu[phase];
+		}
+		for (int phase = 0; phase < PH_COUNT; phase++) {
+			for (size_t k = 0; k < PERF_EVENTS; k++) {
+				total.perf[phase][k] += STATS[t].perf[phase][k];
+			}
+		}
+		total.subjects += STATS[t].subjects;
+		total.pairs += STATS[t].pairs;
+		total.aborted += STATS[t].aborted;
+	}
+
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"version\": \"%s\",\n", VERSION);
+	fprintf(file, "\t\"mode\": \"%s\",\n",
+			FLAGS & F_GENERALIZED  ? "generalized"
+			: FLAGS & F_PACKED     ? "packed"
+			: FLAGS & F_LOW_MEMORY ? "low-memory"
+								   : "fast");
+	fprintf(file, "\t\"threads\": %zu,\n", STATS_THREADS);
+	fprintf(file, "\t\"sequences\": %zu,\n", n);
+	fprintf(file, "\t\"subjects\": %zu,\n", total.subjects);
+	fprintf(file, "\t\"pairs\": %zu,\n", total.pairs);
+	fprintf(file, "\t\"aborted\": %zu,\n", total.aborted);
+	fprintf(file, "\t\"wall\": %.6f,\n", stop.wall - STATS_START.wall);
+	fprintf(file, "\t\"cpu\": %.6f,\n", process_cpu - STATS_START_PROCESS_CPU);
+
+	fprintf(file, "\t\"phases\": ");
+	stats_write_phases(file, total.wall, total.cpu, "\t");
+	fprintf(file, ",\n");
+
+	fprintf(file, "\t\"per_thread\": [\n");
+	for (size_t t = 0; t < STATS_THREADS; t++) {
+		const struct stats_thread *local = &STATS[t];
+		fprintf(file, "\t\t{\n");
+		fprintf(file, "\t\t\t\"thread\": %zu,\n", t);
+		fprintf(file, "\t\t\t\"subjects\": %zu,\n", local->subjects);
+		fprintf(file, "\t\t\t\"pairs\": %zu,\n", local->pairs);
+		fprintf(file, "\t\t\t\"phases\": ");
+		stats_write_phases(file, local->wall, local->cpu, "\t\t\t");
+		fprintf(file, "\n\t\t}%s\n", t + 1 < STATS_THREADS ? "," : "");
+	}
+	fprintf(file, "\t],\n");
+
+	fprintf(file, "\t\"memory\": ");
+	mem_write_json(file, "\t");
+
+#ifdef ENABLE_COUNTERS
+	fprintf(file, ",\n\t\"counters\": ");
+	counters_write_json(file, "\t");
+#endif
+
+	if (FLAGS & F_NUMA) {
+		// Node loads are served locally, unless they miss the node.
+		uint64_t loads[2] = {0, 0};
+		int counted = FLAGS & F_PERF && !perf_error() &&
+					  perf_event_available(PERF_NODE_LOADS) &&
+					  perf_event_available(PERF_REMOTE_LOADS);
+		for (int phase = 0; counted && phase < PH_COUNT; phase++) {
+			uint64_t all = total.perf[phase][PERF_NODE_LOADS];
+			uint64_t remote = total.perf[phase][PERF_REMOTE_LOADS];
+			loads[0] += all > remote ? all - remote : 0;
+			loads[1] += remote;
+		}
+
+		fprintf(file, ",\n\t\"numa\": ");
+		numa_write_json(file, "\t", counted ? loads : NULL);
+	}
+
+	if (FLAGS & F_PERF) {
+		fprintf(file, ",\n\t\"perf\": ");
+		stats_write_perf(file, total.perf);
+	}
+
+	fprintf(file, "\n}\n");
+
+	if (fclose(file) != 0) {
+		soft_err("%s", file_name);
+		return 1;
+	}
+
+	return 0;
+}
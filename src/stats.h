@@ -0,0 +1,68 @@
+/**
+ * @file
+ * @brief This header contains the declarations for run time statistics.
+ *
+ * The statistics are collected per thread and phase. They are only gathered
+ * if the `F_STATS` flag is set; otherwise all functions return immediately.
+ * The timers are also active with `F_PAIR_STATS`, so individual comparisons
+ * can be timed, and with `F_TRACE`, which records every timed phase as a span.
+ * With `F_PERF` also the hardware counters are accumulated per phase.
+ */
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include "perf.h"
+#include <stdlib.h>
+
+/**
+ * @brief The distinct phases of a run.
+ */
+enum stats_phase {
+	/** Parsing the FASTA files. */
+	PH_PARSE,
+	/** Stripping non-ACGT characters from sequences. */
+	PH_NORMALIZE,
+	/** Sketching the sequences for the prefilter. */
+	PH_SKETCH,
+	/** Suffix array construction. */
+	PH_SA,
+	/** LCP array construction. */
+	PH_LCP,
+	/** Child array construction. */
+	PH_CLD,
+	/** FVC array construction. */
+	PH_FVC,
+	/** Filling the lcp-interval cache. */
+	PH_CACHE,
+	/** Anchor search in dist_anchor(). */
+	PH_MATCH,
+	/** Printing the distance (and coverage) matrix. */
+	PH_PRINT,
+	/** Computing and printing bootstrap matrices. */
+	PH_BOOTSTRAP,
+	PH_COUNT
+};
+
+/**
+ * @brief A point in time as seen by the calling thread.
+ */
+struct stats_timer {
+	/** Wall clock time in seconds. */
+	double wall;
+	/** CPU time of the calling thread in seconds. */
+	double cpu;
+	/** Hardware counters of the calling thread, if requested. */
+	struct perf_sample perf;
+};
+
+void stats_init(size_t threads);
+void stats_free(void);
+struct stats_timer stats_begin(void);
+double stats_now(void);
+double stats_end(enum stats_phase, const struct stats_timer *);
+double stats_wall(enum stats_phase);
+void stats_count_subject(void);
+void stats_count_pair(int aborted);
+int stats_write(const char *file_name, size_t n);
+
+#endif // _STATS_H_
@@ -0,0 +1,225 @@
+/**
+ * @file
+ * @brief Timeline of worker activity
+ *
+ * Each thread appends its spans to a private, growing buffer. Comparisons are
+ * far too numerous to be recorded individually. Instead, consecutive
+ * comparisons of one thread against the same subject are merged into a single
+ * block via trace_block(). The timestamps are taken from stats_now() and thus
+ * share the clock with the statistics.
+ *
+ * All strings passed to this module are stored as pointers. They have to stay
+ * valid until trace_write() is called.
+ */
+#include "trace.h"
+#include "global.h"
+#include "slots.h"
+#include "stats.h"
+#include <compat-stdlib.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief A single span on the timeline.
+ */
+struct trace_event {
+	/** The category, e.g. "index". */
+	const char *cat;
+	/** The name of the span. */
+	const char *name;
+	/** An optional argument, such as the name of a file or subject. */
+	const char *arg;
+	/** The number of merged spans. */
+	size_t count;
+	/** Begin and end in seconds. */
+	double begin, end;
+};
+
+/**
+ * @brief The events recorded by a single thread.
+ */
+struct trace_slot {
+	struct trace_event *data;
+	size_t capacity, size;
+} __attribute__((aligned(SLOT_ALIGNMENT)));
+
+static struct trace_slot *SLOTS = NULL;
+static size_t SLOTS_COUNT = 0;
+static double TRACE_START = 0.0;
+
+/**
+ * @brief Allocate the per-thread buffers and set the origin of the timeline.
+ *
+ * @param threads - The maximum number of threads used.
+ */
+void trace_init(size_t threads) {
+	if (!(FLAGS & F_TRACE)) return;
+	if (threads == 0) threads = 1;
+
+	SLOTS = slots_new(threads, sizeof(*SLOTS));
+	SLOTS_COUNT = threads;
+	TRACE_START = stats_now();
+}
+
+/** @brief Free all buffers. */
+void trace_free(void) {
+	for (size_t t = 0; t < SLOTS_COUNT; t++) {
+		free(SLOTS[t].data);
+	}
+	free(SLOTS);
+	SLOTS = NULL;
+	SLOTS_COUNT = 0;
+}
+
+/** @brief Get the buffer of the calling thread; NULL if it has none. */
+static struct trace_slot *trace_local(void) {
+	return slots_local(SLOTS, SLOTS_COUNT, sizeof(*SLOTS));
+}
+
+/** @brief Append an event to the buffer of the calling thread. */
+static void trace_push(struct trace_slot *slot, struct trace_event event) {
+	if (slot->size == slot->capacity) {
+		size_t capacity = slot->capacity ? (slot->capacity / 2) * 3 : 64;
+		struct trace_event *ptr =
+			reallocarray(slot->data, capacity, sizeof(*ptr));
+		CHECK_MALLOC(ptr);
+
+		slot->data = ptr;
+		slot->capacity = capacity;
+	}
+
+	slot->data[slot->size++] = event;
+}
+
+/**
+ * @brief Record a span.
+ *
+ * @param cat - The category.
+ * @param name - The name of the span.
+ * @param arg - An optional argument; may be NULL.
+ * @param begin - The start as returned by stats_now().
+ * @param end - The end as returned by stats_now().
+ */
+void trace_span(const char *cat, const char *name, const char *arg,
+				double begin, double end) {
+	struct trace_slot *slot = trace_local();
+	if (!(FLAGS & F_TRACE) || !slot) return;
+
+	trace_push(slot, (struct trace_event){cat, name, arg, 1,
+										  begin - TRACE_START,
+										  end - TRACE_START});
+}
+
+/**
+ * @brief Record a span, merging it with the previous one of the same kind.
+ *
+ * If the last span of the calling thread has the same category, name and
+ * argument, it is extended to `end`. Otherwise a new span is started.
+ *
+ * @param cat - The category.
+ * @param name - The name of the span.
+ * @param arg - An optional argument; may be NULL.
+ * @param begin - The start as returned by stats_now().
+ * @param end - The end as returned by stats_now().
+ */
+void trace_block(const char *cat, const char *name, const char *arg,
+				 double begin, double end) {
+	struct trace_slot *slot = trace_local();
+	if (!(FLAGS & F_TRACE) || !slot) return;
+
+	if (slot->size) {
+		struct trace_event *last = &slot->data[slot->size - 1];
+		if (last->cat == cat && last->name == name && last->arg == arg) {
+			last->end = end - TRACE_START;
+			last->count++;
+			return;
+		}
+	}
+
+	trace_push(slot, (struct trace_event){cat, name, arg, 1,
+										  begin - TRACE_START,
+										  end - TRACE_START});
+}
+
+/** @brief Print a string with JSON escapes. */
+static void print_json_string(FILE *file, const char *str) {
+	fputc('"', file);
+	for (; *str; str++) {
+		unsigned char c = *str;
+		if (c == '"' || c == '\\') {
+			fprintf(file, "\\%c", c);
+		} else if (c < 0x20) {
+			fprintf(file, "\\u%04x", c);
+		} else {
+			fputc(c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+/**
+ * @brief Write the timeline in the Chrome trace event format.
+ *
+ * @param file_name - The file to write to.
+ * @returns 0 iff successful.
+ */
+int trace_write(const char *file_name) {
+	if (!(FLAGS & F_TRACE) || !SLOTS || !file_name) return 1;
+
+	FILE *file = fopen(file_name, "w");
+	if (!file) {
+		soft_err("%s", file_name);
+		return 1;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+	const char *separator = "";
+	for (size_t t = 0; t < SLOTS_COUNT; t++) {
+		fprintf(file,
+				"%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+				"\"tid\": %zu, \"args\": {\"name\": \"%s %zu\"}}",
+				separator, t, t ? "worker" : "main", t);
+		separator = ",\n";
+	}
+
+	for (size_t t = 0; t < SLOTS_COUNT; t++) {
+		const struct trace_slot *slot = &SLOTS[t];
+		for (size_t k = 0; k < slot->size; k++) {
+			const struct trace_event *event = &slot->data[k];
+
+			fprintf(file, "%s{\"name\": ", separator);
+			print_json_string(file, event->name);
+			fprintf(file,
+					", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, "
+					"\"dur\": %.3f, \"pid\": 1, \"tid\": %zu",
+					event->cat, event->begin * 1e6,
+					(event->end - event->begin) * 1e6, t);
+
+			if (event->arg || event->count > 1) {
+				fprintf(file, ", \"args\": {");
+				if (event->arg) {
+					fprintf(file, "\"input\": ");
+					print_json_string(file, event->arg);
+				}
+				if (event->count > 1) {
+					fprintf(file, "%s\"count\": %zu", event->arg ? ", " : "",
+							event->count);
+				}
+				fprintf(file, "}");
+			}
+
+			fprintf(file, "}");
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+
+	if (fclose(file) != 0) {
+		soft_err("%s", file_name);
+		return 1;
+	}
+
+	return 0;
+}
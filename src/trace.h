@@ -0,0 +1,22 @@
+/**
+ * @file
+ * @brief Timeline of worker activity
+ *
+ * With `--trace=FILE` every thread records spans of its activity. At the end
+ * of a run they are written in the Chrome trace event format, which can be
+ * viewed with `chrome://tracing` or https://ui.perfetto.dev.
+ */
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdlib.h>
+
+void trace_init(size_t threads);
+void trace_free(void);
+void trace_span(const char *cat, const char *name, const char *arg,
+				double begin, double end);
+void trace_block(const char *cat, const char *name, const char *arg,
+				 double begin, double end);
+int trace_write(const char *file_name);
+
+#endif // _TRACE_H_
@@ -0,0 +1,397 @@
+/**
+ * @file
+ * @brief Microbenchmarks for the kernels of andi.
+ *
+ * Every benchmark is repeated a number of times. The minimum and median wall
+ * time per repetition are printed as JSON, together with a rate of processed
+ * units (nucleotides or lookups) per second. The names of the benchmarks are
+ * stable, so results of different commits can be compared.
+ *
+ * Usage: benchmark [-l LENGTH] [-r REPETITIONS] > bench.json
+ *
+ * Usually, it is run via `make bench`.
+ */
+#include "esa.h"
+#include "global.h"
+#include "io.h"
+#include "model.h"
+#include "process.h"
+#include "sequence.h"
+#include "stats.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+int FLAGS = F_NONE;
+int THREADS = 1;
+long unsigned int BOOTSTRAP = 0;
+double ANCHOR_P_VALUE = 0.025;
+gsl_rng *RNG = NULL;
+int MODEL = M_JC;
+double PREFILTER_THRESHOLD = 0.005;
+double MIN_COVERAGE = 0.0;
+size_t SAMPLE_WINDOWS = 0;
+size_t SAMPLE_LENGTH = 10000;
+
+char *revcomp(const char *str, size_t len);
+
+/** The length of the sequences. */
+static size_t LENGTH = 1 << 20;
+/** The number of repetitions per benchmark. */
+static size_t REPS = 5;
+/** The number of lookups for get_match_cached(). */
+static const size_t LOOKUPS = 1 << 16;
+
+static const char *SEPARATOR = "";
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int compare_double(const void *a, const void *b) {
+	double da = *(const double *)a, db = *(const double *)b;
+	return (da > db) - (da < db);
+}
+
+/** @brief Print the result of one benchmark. */
+static void report(const char *name, size_t size, double *times) {
+	qsort(times, REPS, sizeof(double), compare_double);
+	double median = times[REPS / 2];
+
+	printf("%s\t\t{\"name\": \"%s\", \"size\": %zu, \"min\": %.6f, "
+		   "\"median\": %.6f, \"rate\": %.4g}",
+		   SEPARATOR, name, size, times[0], median,
+		   median > 0 ? size / median : 0.0);
+	SEPARATOR = ",\n";
+	fflush(stdout);
+}
+
+static char *random_seq(size_t len) {
+	static const char ACGT[4] = {'A', 'C', 'G', 'T'};
+	char *S = malloc(len + 1);
+	CHECK_MALLOC(S);
+
+	for (size_t k = 0; k < len; k++) {
+		S[k] = ACGT[gsl_rng_uniform_int(RNG, 4)];
+	}
+	S[len] = '\0';
+	return S;
+}
+
+/** @brief Copy a sequence with substitutions at the given rate. */
+static char *mutate(const char *S, size_t len, double divergence) {
+	static const char *OTHERS[4] = {"CGT", "AGT", "ACT", "ACG"};
+	char *Q = strdup(S);
+	CHECK_MALLOC(Q);
+
+	for (size_t k = 0; k < len; k++) {
+		if (gsl_rng_uniform(RNG) < divergence) {
+			size_t base = strchr("ACGT", S[k]) - "ACGT";
+			Q[k] = OTHERS[base][gsl_rng_uniform_int(RNG, 3)];
+		}
+	}
+	return Q;
+}
+
+/** @brief Create a sequence of slightly mutated copies of one unit. */
+static char *repetitive_seq(size_t len, size_t unit_length) {
+	char *unit = random_seq(unit_length);
+	char *S = malloc(len + 1);
+	CHECK_MALLOC(S);
+
+	for (size_t k = 0; k < len; k += unit_length) {
+		char *copy = mutate(unit, unit_length, 0.01);
+		size_t chunk = len - k < unit_length ? len - k : unit_length;
+		memcpy(S + k, copy, chunk);
+		free(copy);
+	}
+	S[len] = '\0';
+
+	free(unit);
+	return S;
+}
+
+/** @brief Time esa_init() as a whole and its steps via the statistics. */
+static void bench_esa(void) {
+	static const enum stats_phase STEPS[] = {PH_SA, PH_LCP, PH_CLD, PH_FVC,
+											 PH_CACHE};
+	static const char *NAMES[] = {"esa_init/SA", "esa_init/LCP",
+								  "esa_init/CLD", "esa_init/FVC",
+								  "esa_init/cache"};
+	const size_t STEP_COUNT = sizeof(STEPS) / sizeof(STEPS[0]);
+
+	char *str = random_seq(LENGTH);
+	seq_t S;
+	seq_init(&S, str, "subject");
+	free(str);
+
+	double total[REPS], steps[STEP_COUNT][REPS];
+	size_t size = 0;
+
+	for (size_t r = 0; r < REPS; r++) {
+		seq_subject subject;
+		esa_s E;
+		seq_subject_init(&subject, &S);
+
+		double before[STEP_COUNT];
+		for (size_t k = 0; k < STEP_COUNT; k++) {
+			before[k] = stats_wall(STEPS[k]);
+		}
+
+		double begin = now();
+		if (esa_init(&E, &subject)) {
+			errx(1, "Failed to create index.");
+		}
+		total[r] = now() - begin;
+
+		for (size_t k = 0; k < STEP_COUNT; k++) {
+			steps[k][r] = stats_wall(STEPS[k]) - before[k];
+		}
+
+		size = subject.RSlen;
+		esa_free(&E);
+		seq_subject_free(&subject);
+	}
+
+	report("esa_init", size, total);
+	for (size_t k = 0; k < STEP_COUNT; k++) {
+		report(NAMES[k], size, steps[k]);
+	}
+
+	seq_free(&S);
+}
+
+/** @brief Time lookups of evenly spaced suffixes of a query. */
+static void bench_get_match(const char *name, const char *subject_str,
+							const char *query) {
+	seq_t S;
+	seq_init(&S, subject_str, "subject");
+
+	seq_subject subject;
+	esa_s E;
+	if (seq_subject_init(&subject, &S) || esa_init(&E, &subject)) {
+		errx(1, "Failed to create index.");
+	}
+
+	size_t step = LENGTH / LOOKUPS ? LENGTH / LOOKUPS : 1;
+	double times[REPS];
+	size_t lookups = 0;
+	volatile saidx_t sink = 0;
+
+	for (size_t r = 0; r < REPS; r++) {
+		lookups = 0;
+		double begin = now();
+		for (size_t pos = 0; pos < LENGTH; pos += step, lookups++) {
+			lcp_inter_t inter =
+				get_match_cached(&E, query + pos, LENGTH - pos);
+			sink += inter.l;
+		}
+		times[r] = now() - begin;
+	}
+	(void)sink;
+
+	report(name, lookups, times);
+
+	esa_free(&E);
+	seq_subject_free(&subject);
+	seq_free(&S);
+}
+
+/**
+ * @brief Time dist_anchor() at a given divergence.
+ *
+ * @param divergence - The divergence of the query.
+ * @param suffix - Appended to the name of the benchmark.
+ */
+static void bench_dist_anchor(double divergence, const char *suffix) {
+	char *str = random_seq(LENGTH);
+	char *query = mutate(str, LENGTH, divergence);
+
+	seq_t S;
+	seq_init(&S, str, "subject");
+	free(str);
+
+	seq_subject subject;
+	esa_s E;
+	if (seq_subject_init(&subject, &S) || esa_init(&E, &subject)) {
+		errx(1, "Failed to create index.");
+	}
+
+	double times[REPS];
+	for (size_t r = 0; r < REPS; r++) {
+		struct dist_info info;
+		double begin = now();
+		dist_anchor(&E, query, LENGTH, subject.threshold, &info);
+		times[r] = now() - begin;
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "dist_anchor/%g%s", divergence, suffix);
+	report(name, LENGTH, times);
+
+	esa_free(&E);
+	seq_subject_free(&subject);
+	seq_free(&S);
+	free(query);
+}
+
+static void bench_model_count(void) {
+	char *S = random_seq(LENGTH);
+	char *Q = mutate(S, LENGTH, 0.01);
+
+	double times[REPS];
+	for (size_t r = 0; r < REPS; r++) {
+		model M = {};
+		double begin = now();
+		model_count(&M, S, Q, LENGTH);
+		times[r] = now() - begin;
+	}
+
+	report("model_count", LENGTH, times);
+	free(S);
+	free(Q);
+}
+
+static void bench_revcomp(void) {
+	char *S = random_seq(LENGTH);
+
+	double times[REPS];
+	for (size_t r = 0; r < REPS; r++) {
+		double begin = now();
+		char *R = revcomp(S, LENGTH);
+		times[r] = now() - begin;
+		free(R);
+	}
+
+	report("revcomp", LENGTH, times);
+	free(S);
+}
+
+/** @brief Time reading a FASTA file of 16 records with wrapped lines. */
+static void bench_read_fasta(void) {
+	char file_name[] = "/tmp/andi-bench-XXXXXX";
+	int fd = mkstemp(file_name);
+	if (fd < 0) {
+		err(1, "mkstemp");
+	}
+
+	FILE *file = fdopen(fd, "w");
+	if (!file) {
+		err(1, "%s", file_name);
+	}
+
+	const size_t RECORDS = 16;
+	for (size_t i = 0; i < RECORDS; i++) {
+		char *S = random_seq(LENGTH / RECORDS);
+		fprintf(file, ">record%zu\n", i);
+		for (size_t k = 0; k < LENGTH / RECORDS; k += 70) {
+			fprintf(file, "%.70s\n", S + k);
+		}
+		free(S);
+	}
+	fclose(file);
+
+	double total[REPS], parse[REPS], normalize[REPS];
+	for (size_t r = 0; r < REPS; r++) {
+		dsa_t dsa;
+		dsa_init(&dsa);
+
+		double parse_before = stats_wall(PH_PARSE);
+		double normalize_before = stats_wall(PH_NORMALIZE);
+		double begin = now();
+		read_fasta(file_name, &dsa);
+		total[r] = now() - begin;
+		parse[r] = stats_wall(PH_PARSE) - parse_before;
+		normalize[r] = stats_wall(PH_NORMALIZE) - normalize_before;
+
+		dsa_free(&dsa);
+	}
+
+	report("read_fasta", LENGTH, total);
+	report("read_fasta/parse", LENGTH, parse);
+	report("read_fasta/normalize", LENGTH, normalize);
+
+	unlink(file_name);
+}
+
+int main(int argc, char *argv[]) {
+	int c;
+	while ((c = getopt(argc, argv, "l:r:")) != -1) {
+		switch (c) {
+			case 'l': LENGTH = strtoul(optarg, NULL, 10); break;
+			case 'r': REPS = strtoul(optarg, NULL, 10); break;
+			default:
+				fprintf(stderr, "Usage: %s [-l LENGTH] [-r REPETITIONS]\n",
+						argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if (LENGTH < 1000 || REPS == 0) {
+		errx(1, "The length must be at least 1000 and repetitions positive.");
+	}
+
+	RNG = gsl_rng_alloc(gsl_rng_default);
+	if (!RNG) {
+		err(1, "RNG allocation failed.");
+	}
+	gsl_rng_set(RNG, 1729);
+
+	// The steps of esa_init() are timed by the statistics module.
+	FLAGS |= F_STATS;
+	stats_init(1);
+
+	printf("{\n");
+	printf("\t\"version\": \"%s\",\n", VERSION);
+	printf("\t\"length\": %zu,\n", LENGTH);
+	printf("\t\"reps\": %zu,\n", REPS);
+	printf("\t\"benchmarks\": [\n");
+
+	bench_esa();
+
+	char *subject = random_seq(LENGTH);
+	char *query = random_seq(LENGTH);
+	bench_get_match("get_match_cached/random", subject, query);
+
+	// The lookups jump around the index; huge pages save most TLB misses.
+	mem_set_pages(MEM_PAGES_THP);
+	bench_get_match("get_match_cached/random/thp", subject, query);
+	mem_set_pages(MEM_PAGES_DEFAULT);
+	free(subject);
+	free(query);
+
+	// A query from the same repeat family makes for long matches.
+	subject = repetitive_seq(LENGTH, 1000);
+	query = mutate(subject, LENGTH, 0.01);
+	bench_get_match("get_match_cached/repetitive", subject, query);
+	free(subject);
+	free(query);
+
+	const double DIVERGENCES[] = {0.001, 0.01, 0.05, 0.1};
+	for (size_t k = 0; k < sizeof(DIVERGENCES) / sizeof(DIVERGENCES[0]); k++) {
+		bench_dist_anchor(DIVERGENCES[k], "");
+	}
+
+	mem_set_pages(MEM_PAGES_THP);
+	bench_dist_anchor(0.1, "/thp");
+	mem_set_pages(MEM_PAGES_DEFAULT);
+
+	// Close relatives profit most from walking along the diagonal.
+	FLAGS |= F_WALK;
+	bench_dist_anchor(0.01, "/walk");
+	FLAGS &= ~F_WALK;
+
+	bench_model_count();
+	bench_revcomp();
+	bench_read_fasta();
+
+	printf("\n\t]\n}\n");
+
+	stats_free();
+	gsl_rng_free(RNG);
+	return EXIT_SUCCESS;
+}
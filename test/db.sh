@@ -0,0 +1,48 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+# The first sequence is the reference, the second one the query
+./test/test_fasta -s $SEED -l 10000 > db.fasta
+awk '/^>/{n++} n == 1' db.fasta > db_ref.fasta
+awk '/^>/{n++} n == 2' db.fasta > db_query.fasta
+
+# A query must give the same answer as a server of the database
+./src/andi db build --db=db.db db_ref.fasta || exit 1
+./src/andi db query --db=db.db db_query.fasta > db.out || exit 1
+test "$(wc -l < db.out)" -eq 1 || exit 1
+test "$(cut -f2 db.out)" = "S0" || exit 1
+./src/andi db query --db=db_ref.fasta db_query.fasta 2> /dev/null && exit 1
+
+./src/andi serve --socket=db.sock --db=db.db &
+SERVER=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	test -S db.sock && break
+	sleep 1
+done
+./src/andi client --socket=db.sock db_query.fasta > db_serve.out
+STATUS=$?
+kill $SERVER
+wait $SERVER
+test $STATUS -eq 0 || exit 1
+cmp db.out db_serve.out || exit 1
+
+# The significance of the database wins over a different -p, with a warning
+./src/andi db query --db=db.db -p 0.025 db_query.fasta 2> db.err |
+	cmp - db.out || exit 1
+test ! -s db.err || exit 1
+./src/andi db query --db=db.db -p 0.01 db_query.fasta 2> db.err |
+	cmp - db.out || exit 1
+grep -q 'Ignoring -p 0.01' db.err || exit 1
+
+# Queries against a database are always compared completely
+./src/andi db query --db=db.db --sample=4,1000 --min-coverage=0.5 \
+	db_query.fasta 2> db.err | cmp - db.out || exit 1
+grep -q 'Ignoring them' db.err || exit 1
+
+rm -f db.fasta db_ref.fasta db_query.fasta db.db db.out db_serve.out db.err
@@ -0,0 +1,21 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+# A copy must get the same row as its original
+./test/test_fasta -s $SEED -l 10000 -d 0.01 > dup.fasta
+awk '/^>/{n++} n == 2' dup.fasta | sed 's/^>S1.*/>copy/' >> dup.fasta
+./src/andi dup.fasta > dup.out 2> dup.err || exit 1
+grep -q '1 of the 3 sequences are identical' dup.err || exit 1
+test "$(awk '$1 == "S1" {$1 = ""; print}' dup.out)" = "$(awk '$1 == "copy" {$1 = ""; print}' dup.out)" || exit 1
+
+# The shared indexes collapse copies just the same
+./src/andi dup.fasta --index=generalized 2> /dev/null | cmp - dup.out || exit 1
+./src/andi dup.fasta --index=packed 2> /dev/null | cmp - dup.out || exit 1
+
+rm -f dup.fasta dup.out dup.err
@@ -0,0 +1,16 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+# Huge pages must not change the distances; hugetlb may be unavailable
+./test/test_fasta -s $SEED -l 20000 -d 0.01 -d 0.05 > huge_pages.fasta
+./src/andi huge_pages.fasta -m raw > huge_pages.out || exit 1
+./src/andi huge_pages.fasta -m raw --huge-pages=thp | cmp - huge_pages.out || exit 1
+./src/andi huge_pages.fasta -m raw --huge-pages=hugetlb 2> /dev/null | cmp - huge_pages.out || exit 1
+
+rm -f huge_pages.fasta huge_pages.out
@@ -0,0 +1,16 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+# The shared indexes must yield the same distances as separate ones
+./test/test_fasta -s $SEED -l 20000 -d 0.01 -d 0.05 > index.fasta
+./src/andi index.fasta -m raw > index.out || exit 1
+./src/andi index.fasta -m raw --index=generalized | cmp - index.out || exit 1
+./src/andi index.fasta -m raw --index=packed | cmp - index.out || exit 1
+
+rm -f index.fasta index.out
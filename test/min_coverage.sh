@@ -0,0 +1,31 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+SEED2=0
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+	SEED2=$((SEED + 2))
+fi
+
+# Only the comparisons of unrelated sequences are aborted
+./test/test_fasta -s $SEED -l 300000 -d 0.01 > coverage.fasta
+./test/test_fasta -s $SEED2 -l 300000 -d 0.01 | sed 's/^>/>u/' >> coverage.fasta
+./src/andi coverage.fasta --min-coverage=0.2 --stats=coverage.json > coverage.out 2> /dev/null || exit 1
+test "$(grep -o nan coverage.out | wc -l)" -eq 8 || exit 1
+grep -q '"aborted": 8,' coverage.json || exit 1
+
+# If only one direction is aborted, the pair is still reported as missing
+./test/test_fasta -s $SEED -l 100000 -L 100000 -d 0.01 > related.fasta
+./test/test_fasta -s $SEED2 -l 700000 -L 700000 | head -n 2 > unrelated.fasta
+(
+	echo ">short"; sed -n 2p related.fasta
+	echo ">long"; sed -n 4p related.fasta | tr -d '\n'; sed -n 2p unrelated.fasta
+) > coverage.fasta
+./src/andi coverage.fasta --min-coverage=0.5 --stats=coverage.json > coverage.out 2> coverage.err || exit 1
+grep -q '"aborted": 1,' coverage.json || exit 1
+test "$(grep -o nan coverage.out | wc -l)" -eq 2 || exit 1
+grep -q 'For 1 pairs' coverage.err || exit 1
+
+rm -f coverage.fasta coverage.out coverage.json coverage.err related.fasta unrelated.fasta
@@ -0,0 +1,55 @@
+#!/bin/sh -f
+
+./src/andi --help > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+# A fake topology of two nodes, both with all processors we may run on.
+ROOT=$(pwd)/numa_sysfs
+CPUS=$(awk '/^Cpus_allowed_list/ {print $2}' /proc/self/status 2> /dev/null)
+CPUS=${CPUS:-0}
+rm -rf "$ROOT"
+for node in 0 1; do
+	mkdir -p "$ROOT/devices/system/node/node$node"
+	echo "$CPUS" > "$ROOT/devices/system/node/node$node/cpulist"
+done
+
+./test/test_fasta -s $SEED -l 20000 -d 0.05 > numa.fasta
+./src/andi numa.fasta > numa.out || exit 1
+
+# Two threads are needed for two nodes, but andi refuses more threads than
+# processors. With one, the topology is read but a single node is used.
+THREADS=2
+NODES="0, 1"
+if test "$(nproc)" -lt 2; then
+	THREADS=1
+	NODES="0"
+fi
+
+for mode in bind replicate; do
+	for lm in "" "-l"; do
+		ANDI_SYSFS_ROOT="$ROOT" ./src/andi numa.fasta --numa=$mode -t $THREADS \
+			$lm --stats=numa.json 2> numa.err | cmp - numa.out || exit 1
+		grep -q 'NUMA' numa.err && exit 1
+		grep -q "\"nodes\": \[$NODES\]" numa.json || exit 1
+		grep -q "\"thread_nodes\": \[$NODES\]" numa.json || exit 1
+		grep -q "\"mode\": \"$mode\"" numa.json || exit 1
+		grep -q '"loads": null' numa.json || exit 1
+	done
+done
+
+# Only with two nodes the sequences are copied, once per node, and in the
+# low-memory mode the index of every subject to the second node.
+if test $THREADS -eq 2; then
+	grep -q '"replicated_sequences": [1-9]' numa.json || exit 1
+	grep -q '"replicated_indexes": 2,' numa.json || exit 1
+fi
+
+# Without a topology, NUMA awareness stays off.
+ANDI_SYSFS_ROOT="$ROOT/none" ./src/andi numa.fasta --numa 2>&1 > /dev/null |
+	grep -q 'no NUMA node' || exit 1
+
+rm -rf "$ROOT" numa.fasta numa.out numa.json numa.err
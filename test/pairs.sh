@@ -0,0 +1,31 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+./test/test_fasta -s $SEED -l 10000 > pairs.fasta
+./src/andi pairs.fasta > pairs_plain.out || exit 1
+
+# Test the per-pair diagnostics; a header of 24 bytes and two records
+./src/andi pairs.fasta --slow-pairs=1 --pair-dump=pairs.bin > pairs.out 2> pairs.err
+cmp pairs_plain.out pairs.out || exit 1
+grep -q 'slowest' pairs.err || exit 1
+test "$(wc -c < pairs.bin)" -eq 88 || exit 1
+
+# A failure to write the dump is reported, but does not change the distances
+if test -w /dev/full; then
+	./src/andi pairs.fasta --pair-dump=/dev/full > pairs.out 2> pairs.err && exit 1
+	cmp pairs_plain.out pairs.out || exit 1
+	grep -q '/dev/full' pairs.err || exit 1
+fi
+
+# Other commands ignore the options and write no dump
+./src/andi db build --db=pairs.db --pair-dump=pairs_db.bin pairs.fasta 2> pairs.err || exit 1
+grep -q 'Ignoring --slow-pairs and --pair-dump' pairs.err || exit 1
+test -e pairs_db.bin && exit 1
+
+rm -f pairs.fasta pairs_plain.out pairs.out pairs.err pairs.bin pairs.db
@@ -0,0 +1,28 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+./test/test_fasta -s $SEED -l 10000 > plan.fasta
+
+# Test the prediction of resources
+./src/andi plan.fasta --plan > plan.json || exit 1
+grep -q '"sequences": 2,' plan.json || exit 1
+grep -q '"low_memory": [1-9]' plan.json || exit 1
+
+# Identical sequences are only compared once, empty ones are refused
+awk '/^>/{n++} n == 2' plan.fasta | sed 's/^>S1.*/>copy/' >> plan.fasta
+./src/andi plan.fasta --plan > plan.json || exit 1
+grep -q '"sequences": 3,' plan.json || exit 1
+grep -q '"distinct": 2,' plan.json || exit 1
+printf '>empty\nNNNN\n' > plan_empty.fasta
+./src/andi plan.fasta plan_empty.fasta --plan 2>&1 > /dev/null | grep -q 'empty' || exit 1
+
+# The shared indexes are not covered
+./src/andi plan.fasta --plan --index=packed > /dev/null 2>&1 && exit 1
+
+rm -f plan.fasta plan_empty.fasta plan.json
@@ -0,0 +1,26 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+SEED2=0
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+	SEED2=$((SEED + 2))
+fi
+
+# Only the pairs of unrelated sequences are skipped
+./test/test_fasta -s $SEED -l 100000 -d 0.01 > prefilter.fasta
+./test/test_fasta -s $SEED2 -l 100000 -d 0.01 | sed 's/^>/>u/' >> prefilter.fasta
+./src/andi prefilter.fasta --prefilter=0.01 > prefilter.out 2> prefilter.err || exit 1
+test "$(grep -o nan prefilter.out | wc -l)" -eq 8 || exit 1
+grep -q 'For 4 pairs' prefilter.err || exit 1
+./src/andi prefilter.fasta --prefilter=0.99 > prefilter.out 2> /dev/null || exit 1
+test "$(grep -o nan prefilter.out | wc -l)" -eq 12 || exit 1
+
+# Distant, but well covered pairs must still be compared by default
+./test/test_fasta -s $SEED -l 1000000 -d 0.2 > prefilter.fasta
+./src/andi prefilter.fasta --prefilter > prefilter.out || exit 1
+grep -q nan prefilter.out && exit 1
+
+rm -f prefilter.fasta prefilter.out prefilter.err
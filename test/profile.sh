@@ -0,0 +1,22 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+# Both directions get 19 overlapping windows
+./test/test_fasta -s $SEED -l 100000 -d 0.01 > profile.fasta
+./src/andi profile.fasta --profile=profile.tsv --window=10000,5000 > profile.out || exit 1
+test "$(wc -l < profile.tsv)" -eq 39 || exit 1
+test "$(awk '$1 == "S1" && $2 == "S0"' profile.tsv | wc -l)" -eq 19 || exit 1
+awk 'NR > 1 && ($4 - $3 != 10000 || $5 > 0.05)' profile.tsv | grep -q . && exit 1
+
+# Profiles need whole queries; sampling is ignored, and so are its intervals
+./src/andi profile.fasta --profile=profile.tsv --window=10000,5000 --sample=5 > profile_sample.out 2> profile.err || exit 1
+grep -q 'Ignoring --sample' profile.err || exit 1
+cmp profile.out profile_sample.out || exit 1
+
+rm -f profile.fasta profile.out profile.tsv profile_sample.out profile.err
@@ -0,0 +1,22 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+# The progress is sent as lines of JSON, the last one marks the end
+./test/test_fasta -s $SEED -l 20000 -d 0.01 -d 0.05 > progress.fasta
+./src/andi progress.fasta -m raw > progress.out || exit 1
+./src/andi progress.fasta -m raw --progress-fd=3 3> progress.jsonl | cmp - progress.out || exit 1
+tail -n 1 progress.jsonl | grep -q '"done": true' || exit 1
+
+# A copy counts as a sequence, but its pairs are not compared again
+awk '/^>/ {n++} n == 1' progress.fasta | sed 's/^>S0/>S9/' |
+	cat progress.fasta - > progress2.fasta
+./src/andi progress2.fasta -m raw --progress-fd=3 3> progress.jsonl > /dev/null || exit 1
+tail -n 1 progress.jsonl | grep -q '"sequences": 4, "distinct": 3, "pairs": 6, "total": 6' || exit 1
+
+rm -f progress.fasta progress2.fasta progress.out progress.jsonl
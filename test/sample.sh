@@ -0,0 +1,19 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+# The exact distance must lie near the interval of the sampled one
+./test/test_fasta -s $SEED -l 200000 -d 0.02 > sample.fasta
+./src/andi sample.fasta -m raw > sample_exact.out || exit 1
+./src/andi sample.fasta -m raw --sample=20,2000 > sample.out || exit 1
+test "$(grep -c '^2$' sample.out)" -eq 3 || exit 1
+awk 'NR == FNR && FNR == 2 {exact = $3} NR != FNR && /^S0 / {n++; if (n == 2) lower = $3; if (n == 3) upper = $3}
+	END {w = upper - lower; exit !(w > 0 && lower - w <= exact && exact <= upper + w)}' \
+	sample_exact.out sample.out > /dev/null || exit 1
+
+rm -f sample.fasta sample.out sample_exact.out
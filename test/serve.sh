@@ -0,0 +1,44 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+# The first sequence is the reference, the second one the query
+./test/test_fasta -s $SEED -l 10000 > serve.fasta
+awk '/^>/{n++} n == 1' serve.fasta > serve_ref.fasta
+awk '/^>/{n++} n == 2' serve.fasta > serve_query.fasta
+
+./src/andi serve --socket=serve.sock serve_ref.fasta &
+SERVER=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	test -S serve.sock && break
+	sleep 1
+done
+
+# A client that sends nothing must not block the others. It is dropped after
+# the timeout of ten seconds, long before it would send the end of its request.
+sleep 20 | ./src/andi client --socket=serve.sock - > serve_stalled.out &
+STALLED=$!
+sleep 1
+
+./src/andi client --socket=serve.sock serve_query.fasta > serve.out
+STATUS=$?
+kill -0 $STALLED 2> /dev/null
+WAITING=$?
+wait $STALLED
+STALLED_STATUS=$?
+kill $SERVER
+wait $SERVER
+test $STATUS -eq 0 || exit 1
+test $WAITING -eq 0 || exit 1
+test "$(wc -l < serve.out)" -eq 1 || exit 1
+test "$(cut -f2 serve.out)" = "S0" || exit 1
+test ! -e serve.sock || exit 1
+test $STALLED_STATUS -ne 0 || exit 1
+grep -q '^error' serve_stalled.out || exit 1
+
+rm -f serve.fasta serve_ref.fasta serve_query.fasta serve.out serve_stalled.out
@@ -0,0 +1,25 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+./test/test_fasta -s $SEED -l 10000 > stats.fasta
+./src/andi stats.fasta > stats_plain.out || exit 1
+
+# Test the statistics output
+./src/andi stats.fasta --stats=stats.json > stats.out
+cmp stats_plain.out stats.out || exit 1
+grep -q '"pairs": 2,' stats.json || exit 1
+grep -q '"match": {"wall":' stats.json || exit 1
+grep -q '"SA": {"current": 0, "peak": [1-9]' stats.json || exit 1
+
+# The hardware counters may not be permitted, but must not break the run
+./src/andi stats.fasta --stats=stats.json --perf-counters > stats.out 2> /dev/null
+cmp stats_plain.out stats.out || exit 1
+grep -q '"perf": {' stats.json || exit 1
+
+rm -f stats.fasta stats_plain.out stats.out stats.json
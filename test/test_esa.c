@@ -8,8 +8,6 @@ int FLAGS = F_NONE;
 int THREADS = 1;
 double ANCHOR_P_VALUE = 0.025;
 
-extern const int CACHE_LENGTH;
-
 char code3char( ssize_t code){
 	switch( code & 0x7){
 		case 0: return 'A';
@@ -94,6 +92,62 @@ void setup2( esa_fixture *ef, gconstpointer test_data){
 	g_assert( check == 0);
 }
 
+/* The only G and C of this sequence occur in front of the separator. Thus the
+ * lcp-interval of "GCC" ends past the "!". */
+void setup3( esa_fixture *ef, gconstpointer test_data){
+	ef->C = malloc( sizeof(esa_s));
+	ef->S = malloc( sizeof(seq_t));
+
+	g_assert( ef->C != NULL);
+	g_assert( ef->S != NULL);
+
+	const char *seq = {
+		"TAATTATATTTAAATATTTAATTAT"
+		"GCCG!"
+		"ATTTATAATTAATATTTATTAAATA"
+		"GCCG!"
+		"TTATAAATTTATATTAATTTATAAT"
+	};
+
+	g_assert( seq_init( ef->S, seq, "S0" ) == 0);
+	seq_subject_init( &ef->subject, ef->S);
+	g_assert( ef->subject.RS != NULL);
+	int check = esa_init( ef->C, &ef->subject);
+	g_assert( check == 0);
+}
+
+/* The same contigs, joined as in the join mode. This is the index which the
+ * separate mode builds of the joined subject. */
+void setup4( esa_fixture *ef, gconstpointer test_data){
+	ef->C = malloc( sizeof(esa_s));
+	ef->S = malloc( sizeof(seq_t));
+
+	g_assert( ef->C != NULL);
+	g_assert( ef->S != NULL);
+
+	const char *contigs[] = {
+		"TAATTATATTTAAATATTTAATTATGCCG",
+		"ATTTATAATTAATATTTATTAAATAGCCG",
+		"TTATAAATTTATATTAATTTATAAT"
+	};
+
+	dsa_t dsa;
+	dsa_init( &dsa);
+	for( size_t k = 0; k < 3; k++){
+		seq_t contig;
+		g_assert( seq_init( &contig, contigs[k], "S0") == 0);
+		dsa_push( &dsa, contig);
+	}
+	*ef->S = dsa_join( &dsa);
+	dsa_free( &dsa);
+	g_assert( ef->S->len == 85);
+
+	seq_subject_init( &ef->subject, ef->S);
+	g_assert( ef->subject.RS != NULL);
+	int check = esa_init( ef->C, &ef->subject);
+	g_assert( check == 0);
+}
+
 void teardown( esa_fixture *ef, gconstpointer test_data){
 	esa_free(ef->C);
 	free(ef->C);
@@ -169,6 +223,16 @@ void normq_cached( esa_fixture *ef, gconstpointer test_data){
 	assert_equal_lcp( &a, &b);
 }
 
+void separator_cached( esa_fixture *ef, gconstpointer test_data){
+	esa_s *C = ef->C;
+
+	// The match must end before the separator, not at the end of the interval.
+	lcp_inter_t a = get_match_cached(C, "GCCGAAAAAA", 10);
+	g_assert_cmpint( a.l, ==, 4);
+	assert_equal_cache_nocache(C, "GCCGAAAAAA", 10);
+	assert_equal_cache_nocache(C, "GCCGT", 5);
+}
+
 size_t MAX_DEPTH = 11;
 
 void prefix_dfs( esa_s *C, char *str, size_t depth);
@@ -199,6 +263,10 @@ int main(int argc, char *argv[])
 	g_test_add("/esa/sample cache 2", esa_fixture, NULL, setup2, normq_cached, teardown);
 	g_test_add("/esa/full cache", esa_fixture, NULL, setup, prefix, teardown);
 	g_test_add("/esa/full cache 2", esa_fixture, NULL, setup2, prefix, teardown);
+	g_test_add("/esa/separator cache", esa_fixture, NULL, setup3, separator_cached, teardown);
+	g_test_add("/esa/full cache 3", esa_fixture, NULL, setup3, prefix, teardown);
+	g_test_add("/esa/join separator cache", esa_fixture, NULL, setup4, separator_cached, teardown);
+	g_test_add("/esa/full cache 4", esa_fixture, NULL, setup4, prefix, teardown);
 
 	
 	return g_test_run();
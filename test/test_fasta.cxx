@@ -1,18 +1,62 @@
 /**
  * This program can create genome sequences with a specific distance.
+ *
+ * With --genomes it instead creates a whole collection of genomes, which are
+ * related by a random phylogeny. Along the branches, substitutions, indels and
+ * rearrangements accumulate. The root contains repeat families, genomes differ
+ * in size and may carry plasmids. The collection is generated in parallel and
+ * each genome is written as soon as it is finished.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
 #include <iostream>
 #include <random>
 #include <functional>
+#include <sstream>
 #include <string>
+#include <vector>
 #include <getopt.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace std;
 
 void usage();
 void print_seq( unsigned, unsigned, int, int, double);
 
+/**
+ * The parameters of a collection.
+ */
+struct collection_options {
+	unsigned genomes = 0;
+	int length = 1000;
+	int line_length = 70;
+	unsigned seed = 0;
+	/** Write each genome to its own file in this directory; else stdout. */
+	string out_dir;
+	/** Write the phylogeny in Newick format to this file. */
+	string tree_file;
+	/** The maximum substitutions per site from the root to a genome. */
+	double depth = 0.05;
+	/** The number of indel events per substitution. */
+	double indels = 0.1;
+	/** The expected number of rearrangements from the root to a genome. */
+	double rearrangements = 2;
+	/** The fraction of the root covered by repeats. */
+	double repeats = 0.02;
+	/** The number of distinct plasmids; each genome carries about half. */
+	unsigned plasmids = 0;
+	/** The relative standard deviation of the genome sizes. */
+	double size_sd = 0.1;
+	int threads = 0;
+};
+
+int make_collection( const collection_options &);
+
 int main(int argc, char *argv[]){
 
 	random_device rd{};
@@ -23,9 +67,40 @@ int main(int argc, char *argv[]){
 
 	auto seqs = vector<double>{0};
 
-	int check;
-	while((check = getopt(argc, argv, "s:l:L:d:r")) != -1){
+	auto co = collection_options{};
+
+	struct option long_options[] = {
+		{"genomes", required_argument, NULL, 0},
+		{"out", required_argument, NULL, 0},
+		{"tree", required_argument, NULL, 0},
+		{"depth", required_argument, NULL, 0},
+		{"indels", required_argument, NULL, 0},
+		{"rearrangements", required_argument, NULL, 0},
+		{"repeats", required_argument, NULL, 0},
+		{"plasmids", required_argument, NULL, 0},
+		{"size-sd", required_argument, NULL, 0},
+		{"threads", required_argument, NULL, 0},
+		{0, 0, 0, 0}
+	};
+
+	int check, option_index = 0;
+	while((check = getopt_long(argc, argv, "s:l:L:d:r", long_options, &option_index)) != -1){
 		switch(check) {
+			case 0:
+				{
+					auto name = string(long_options[option_index].name);
+					if( name == "genomes") co.genomes = stoul(optarg);
+					if( name == "out") co.out_dir = optarg;
+					if( name == "tree") co.tree_file = optarg;
+					if( name == "depth") co.depth = stod(optarg);
+					if( name == "indels") co.indels = stod(optarg);
+					if( name == "rearrangements") co.rearrangements = stod(optarg);
+					if( name == "repeats") co.repeats = stod(optarg);
+					if( name == "plasmids") co.plasmids = stoul(optarg);
+					if( name == "size-sd") co.size_sd = stod(optarg);
+					if( name == "threads") co.threads = stoi(optarg);
+					break;
+				}
 			case 's':
 				{
 					seed = static_cast<unsigned int>(stol(optarg));
@@ -43,6 +118,13 @@ int main(int argc, char *argv[]){
 		}
 	}
 
+	if( co.genomes){
+		co.length = length;
+		co.line_length = line_length;
+		co.seed = seed;
+		return make_collection(co);
+	}
+
 	if( seqs.size() < 2){
 		seqs.push_back(0.1);
 	}
@@ -121,6 +203,357 @@ void print_seq( unsigned base_seed, unsigned mut_seed, int length, int line_leng
 void usage(){
 	const static char *str = {
 		"usage: test_fasta [-l length] [-d dist...] [-L line length] [-s seed] [-r raw]\n"
+		"       test_fasta --genomes=N [-l length] [-L line length] [-s seed]\n"
+		"           [--out=DIR] [--tree=FILE] [--depth=FLOAT] [--indels=FLOAT]\n"
+		"           [--rearrangements=FLOAT] [--repeats=FLOAT] [--plasmids=N]\n"
+		"           [--size-sd=FLOAT] [--threads=N]\n"
 	};
 	cerr << str;
 }
+
+/**
+ * A node of the phylogeny. The root has no parent; leaves have no children.
+ */
+struct tree_node {
+	int parent = -1;
+	int children[2] = {-1, -1};
+	/** The length of the branch to the parent in substitutions per site. */
+	double branch = 0;
+	double depth = 0;
+	/** The name of a leaf. */
+	string name;
+};
+
+/**
+ * The shared state of a collection while it is generated.
+ */
+struct collection {
+	const collection_options &co;
+	vector<tree_node> nodes;
+	vector<string> plasmids;
+};
+
+/** Every branch and genome gets its own random engine, independent of the
+ * order in which they are processed. */
+static mt19937 make_rng( unsigned seed, int id, int purpose = 0){
+	seed_seq seq{seed, unsigned(id), unsigned(purpose)};
+	return mt19937{seq};
+}
+
+static char complement( char c){
+	switch(c){
+		case 'A': return 'T';
+		case 'C': return 'G';
+		case 'G': return 'C';
+		case 'T': return 'A';
+		default: return c;
+	}
+}
+
+static string random_string( mt19937 &rng, size_t length){
+	auto base_dist = uniform_int_distribution<int>{0,3};
+	auto str = string(length, 'A');
+	for( auto& c : str){
+		c = ACGT[base_dist(rng)];
+	}
+	return str;
+}
+
+/**
+ * Create a random phylogeny via a Yule process and scale it to the requested
+ * depth.
+ */
+static vector<tree_node> make_tree( const collection_options &co, mt19937 &rng){
+	auto nodes = vector<tree_node>(1);
+	auto leaves = vector<int>{0};
+	auto branch_dist = exponential_distribution<double>{1.0};
+
+	while( leaves.size() < co.genomes){
+		auto pick = uniform_int_distribution<size_t>(0, leaves.size() - 1)(rng);
+		int parent = leaves[pick];
+
+		for( int k = 0; k < 2; k++){
+			auto child = tree_node{};
+			child.parent = parent;
+			child.branch = branch_dist(rng);
+			nodes[parent].children[k] = nodes.size();
+			nodes.push_back(child);
+		}
+
+		leaves[pick] = nodes[parent].children[0];
+		leaves.push_back(nodes[parent].children[1]);
+	}
+
+	// parents always precede their children
+	double max_depth = 0;
+	for( auto& node : nodes){
+		if( node.parent >= 0){
+			node.depth = nodes[node.parent].depth + node.branch;
+		}
+		max_depth = max(max_depth, node.depth);
+	}
+
+	double scale = max_depth > 0 ? co.depth / max_depth : 0;
+	for( auto& node : nodes){
+		node.branch *= scale;
+		node.depth *= scale;
+	}
+
+	auto width = to_string(co.genomes).size();
+	for( auto i = 0u; i < leaves.size(); i++){
+		auto number = to_string(i);
+		nodes[leaves[i]].name = "G" + string(width - number.size(), '0') + number;
+	}
+
+	return nodes;
+}
+
+static void write_newick( ostream &os, const vector<tree_node> &nodes, int id){
+	const auto& node = nodes[id];
+	if( node.children[0] >= 0){
+		os << "(";
+		write_newick(os, nodes, node.children[0]);
+		os << ",";
+		write_newick(os, nodes, node.children[1]);
+		os << ")";
+	} else {
+		os << node.name;
+	}
+	if( node.parent >= 0){
+		os << ":" << node.branch;
+	}
+}
+
+/**
+ * Evolve a sequence along a branch of the given length. Substitutions follow
+ * the Jukes-Cantor model. Indels of geometric length happen at a rate relative
+ * to the substitutions. Finally, segments are inverted or transposed.
+ */
+static string evolve( const string &parent, double branch, const collection_options &co, mt19937 &rng){
+	double subst = 0.75 - 0.75 * exp(-(4.0/3.0) * branch);
+	double indel = co.indels * branch;
+	double events = min(subst + indel, 0.99);
+
+	if( events <= 0 || parent.empty()){
+		return parent;
+	}
+
+	auto child = string{};
+	child.reserve(parent.size() + parent.size() / 64 + 16);
+
+	auto gap = geometric_distribution<size_t>{events};
+	auto coin = uniform_real_distribution<double>{0,1};
+	auto indel_length = geometric_distribution<size_t>{0.3};
+	auto mut_acgt = uniform_int_distribution<int>{0,2};
+
+	for( size_t i = 0; i < parent.size(); ){
+		auto skip = gap(rng);
+		if( skip >= parent.size() - i){
+			child.append(parent, i, string::npos);
+			break;
+		}
+
+		child.append(parent, i, skip);
+		i += skip;
+
+		if( coin(rng) * events < subst){
+			auto c = parent[i++];
+			auto idx = mut_acgt(rng);
+			switch(c){
+				case 'A': c = NO_A[idx]; break;
+				case 'C': c = NO_C[idx]; break;
+				case 'G': c = NO_G[idx]; break;
+				case 'T': c = NO_T[idx]; break;
+			}
+			child += c;
+		} else {
+			auto len = min<size_t>(1 + indel_length(rng), 100);
+			if( coin(rng) < 0.5){
+				child += random_string(rng, len);
+			} else {
+				i += min(len, parent.size() - i);
+			}
+		}
+	}
+
+	// rearrangements are spread over the depth of the tree
+	if( co.depth > 0 && co.rearrangements > 0 && child.size() > 100){
+		auto count = poisson_distribution<int>{co.rearrangements * branch / co.depth}(rng);
+		for( int k = 0; k < count; k++){
+			auto size = child.size();
+			auto len = uniform_int_distribution<size_t>(1, size / 20)(rng);
+			auto from = uniform_int_distribution<size_t>(0, size - len)(rng);
+			auto begin = child.begin() + from;
+
+			if( coin(rng) < 0.5){
+				// inversion
+				reverse(begin, begin + len);
+				transform(begin, begin + len, begin, complement);
+			} else {
+				// transposition
+				auto to = uniform_int_distribution<size_t>(0, size - len)(rng);
+				if( to > from){
+					rotate(begin, begin + len, child.begin() + to + len);
+				} else {
+					rotate(child.begin() + to, begin, begin + len);
+				}
+			}
+		}
+	}
+
+	return child;
+}
+
+/**
+ * Create the sequence at the root. Parts of it are covered by slightly
+ * diverged copies of a few repeat families.
+ */
+static string make_root( const collection_options &co, mt19937 &rng){
+	auto root = random_string(rng, co.length);
+
+	auto covered = size_t(co.repeats * co.length);
+	if( covered == 0){
+		return root;
+	}
+
+	auto families = vector<string>{};
+	auto unit_length = uniform_int_distribution<size_t>(300, 3000);
+	for( int k = 0; k < 8; k++){
+		families.push_back(random_string(rng, min<size_t>(unit_length(rng), root.size())));
+	}
+
+	auto copy_options = co;
+	copy_options.indels = 0;
+	copy_options.rearrangements = 0;
+
+	auto pick = uniform_int_distribution<size_t>(0, families.size() - 1);
+	for( size_t done = 0; done < covered; ){
+		auto copy = evolve(families[pick(rng)], 0.02, copy_options, rng);
+		auto at = uniform_int_distribution<size_t>(0, root.size() - copy.size())(rng);
+		root.replace(at, copy.size(), copy);
+		done += copy.size();
+	}
+
+	return root;
+}
+
+static void write_record( ostream &os, const string &name, const string &seq, int line_length){
+	os << ">" << name << "\n";
+	for( size_t i = 0; i < seq.size(); i += line_length){
+		os.write(seq.data() + i, min<size_t>(line_length, seq.size() - i));
+		os << "\n";
+	}
+}
+
+/**
+ * Finish a genome: change its size, add plasmids and write it out.
+ */
+static void finish_genome( const collection &coll, int id, string genome){
+	const auto& co = coll.co;
+	const auto& node = coll.nodes[id];
+	auto rng = make_rng(co.seed, id, 1);
+
+	auto factor = normal_distribution<double>{1.0, co.size_sd}(rng);
+	factor = max(0.5, min(2.0, factor));
+
+	// Genes are lost or gained in a few chunks.
+	const int CHUNKS = 10;
+	auto change = size_t(fabs(factor - 1.0) * genome.size() / CHUNKS);
+	for( int k = 0; k < CHUNKS && change > 0 && change < genome.size(); k++){
+		auto at = uniform_int_distribution<size_t>(0, genome.size() - change)(rng);
+		if( factor < 1.0){
+			genome.erase(at, change);
+		} else {
+			genome.insert(at, random_string(rng, change));
+		}
+	}
+
+	auto os = ostringstream{};
+	write_record(os, node.name, genome, co.line_length);
+	genome = string{};
+
+	auto coin = uniform_real_distribution<double>{0,1};
+	for( auto k = 0u; k < coll.plasmids.size(); k++){
+		if( coin(rng) < 0.5){
+			auto plasmid = evolve(coll.plasmids[k], node.depth, co, rng);
+			write_record(os, node.name + "_p" + to_string(k), plasmid, co.line_length);
+		}
+	}
+
+	if( co.out_dir.empty()){
+#pragma omp critical(output)
+		cout << os.str() << flush;
+	} else {
+		auto file = ofstream(co.out_dir + "/" + node.name + ".fasta");
+		file << os.str();
+		if( !file){
+#pragma omp critical(output)
+			cerr << "test_fasta: could not write " << node.name << endl;
+		}
+	}
+}
+
+/** Generate the sequences of a subtree, depth first. */
+static void descend( const collection &coll, int id, const string &seq){
+	const auto& node = coll.nodes[id];
+	if( node.children[0] < 0){
+		finish_genome(coll, id, seq);
+		return;
+	}
+
+	for( auto child : node.children){
+		auto rng = make_rng(coll.co.seed, child);
+		descend(coll, child, evolve(seq, coll.nodes[child].branch, coll.co, rng));
+	}
+}
+
+int make_collection( const collection_options &co){
+	auto rng = make_rng(co.seed, -1);
+	auto coll = collection{co, make_tree(co, rng), {}};
+
+	if( !co.tree_file.empty()){
+		auto file = ofstream(co.tree_file);
+		write_newick(file, coll.nodes, 0);
+		file << ";" << endl;
+	}
+
+	// Plasmids are much smaller than the chromosome.
+	auto plasmid_length = uniform_int_distribution<size_t>(co.length / 100 + 1, co.length / 20 + 1);
+	for( auto k = 0u; k < co.plasmids; k++){
+		coll.plasmids.push_back(random_string(rng, plasmid_length(rng)));
+	}
+
+	int threads = 1;
+#ifdef _OPENMP
+	threads = co.threads > 0 ? co.threads : omp_get_max_threads();
+#endif
+
+	// Expand the tree until there are enough independent subtrees to keep all
+	// threads busy. The subtrees are then generated in parallel.
+	auto frontier = vector<pair<int, string>>{};
+	frontier.emplace_back(0, make_root(co, rng));
+
+	for( size_t k = 0; frontier.size() < size_t(2 * threads) && k < frontier.size(); ){
+		auto id = frontier[k].first;
+		const auto& node = coll.nodes[id];
+		if( node.children[0] < 0){
+			k++;
+			continue;
+		}
+
+		auto seq = move(frontier[k].second);
+		frontier.erase(frontier.begin() + k);
+		for( auto child : node.children){
+			auto child_rng = make_rng(co.seed, child);
+			frontier.emplace_back(child, evolve(seq, coll.nodes[child].branch, co, child_rng));
+		}
+	}
+
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+	for( size_t k = 0; k < frontier.size(); k++){
+		auto seq = move(frontier[k].second);
+		descend(coll, frontier[k].first, seq);
+	}
+
+	return 0;
+}
@@ -0,0 +1,141 @@
+#include "libandi.h"
+#include <glib.h>
+#include <math.h>
+#include <string.h>
+
+/* The internals of the library must not clash with the symbols of a host. */
+int FLAGS = 0;
+int THREADS = 0;
+int MODEL = 0;
+
+/* Two sequences differing by a substitution every 100 nucleotides. */
+static char *S1, *S2, *S3;
+static const size_t LENGTH = 20000;
+
+static void init_sequences() {
+	GRand *rand = g_rand_new_with_seed(1729);
+	const char ACGT[] = "ACGT";
+
+	S1 = g_malloc(LENGTH + 1);
+	S2 = g_malloc(LENGTH + 1);
+	S3 = g_malloc(LENGTH + 1);
+	for (size_t i = 0; i < LENGTH; i++) {
+		S1[i] = S2[i] = S3[i] = ACGT[g_rand_int_range(rand, 0, 4)];
+		if (i % 100 == 50) {
+			S2[i] = S1[i] == 'A' ? 'C' : 'A';
+		}
+		if (i % 50 == 25) {
+			S3[i] = S1[i] == 'G' ? 'T' : 'G';
+		}
+	}
+	S1[LENGTH] = S2[LENGTH] = S3[LENGTH] = '\0';
+
+	g_rand_free(rand);
+}
+
+void test_libandi_index() {
+	struct andi_options options;
+	andi_options_init(&options);
+
+	andi_index *a = andi_index_new(S1, LENGTH, &options);
+	andi_index *b = andi_index_new(S2, LENGTH, &options);
+	g_assert(a != NULL && b != NULL);
+
+	struct andi_counts forward, backward, same;
+	g_assert_cmpint(andi_index_compare(a, b, &forward), ==, 0);
+	g_assert_cmpint(andi_index_compare(b, a, &backward), ==, 0);
+	g_assert_cmpint(andi_index_compare(a, a, &same), ==, 0);
+
+	g_assert_cmpuint(forward.length, ==, LENGTH);
+	g_assert_cmpfloat(andi_coverage(&forward), >, 0.95);
+	g_assert_cmpfloat(andi_distance(&same, &same, ANDI_MODEL_RAW), ==, 0.0);
+
+	double distance = andi_distance(&forward, &backward, ANDI_MODEL_RAW);
+	g_assert_cmpfloat(fabs(distance - 0.01), <, 0.001);
+
+	andi_index_free(a);
+	andi_index_free(b);
+
+	g_assert(andi_index_new("NNNN", 4, &options) == NULL);
+}
+
+void test_libandi_models() {
+	struct andi_options options;
+	andi_options_init(&options);
+
+	options.model = ANDI_MODEL_LOGDET;
+	andi_index *logdet = andi_index_new(S1, LENGTH, &options);
+	options.model = ANDI_MODEL_JC;
+	andi_index *jc = andi_index_new(S1, LENGTH, &options);
+	andi_index *query = andi_index_new(S2, LENGTH, &options);
+
+	// Each index keeps its model, regardless of the options of the others.
+	struct andi_counts a, b;
+	g_assert_cmpint(andi_index_compare(logdet, query, &a), ==, 0);
+	g_assert_cmpint(andi_index_compare(jc, query, &b), ==, 0);
+
+	// Both find the same matches; only LogDet tells their nucleotides apart.
+	unsigned int equal_a = 0, equal_b = 0;
+	for (int k = 0; k < 4; k++) {
+		equal_a += a.substitutions[5 * k];
+		equal_b += b.substitutions[5 * k];
+	}
+	g_assert_cmpuint(equal_a, ==, equal_b);
+	g_assert_cmpuint(b.substitutions[0], ==, b.substitutions[5]);
+	g_assert_cmpuint(a.substitutions[0], !=, a.substitutions[5]);
+
+	andi_index_free(logdet);
+	andi_index_free(jc);
+	andi_index_free(query);
+}
+
+struct collected {
+	struct andi_counts counts[3][3];
+	size_t calls;
+};
+
+static void collect(const struct andi_result *result, void *user_data) {
+	struct collected *c = user_data;
+	c->counts[result->subject][result->query] = result->counts;
+	c->calls++;
+}
+
+void test_libandi_all() {
+	struct andi_sequence sequences[] = {
+		{"S1", S1, LENGTH}, {"S2", S2, LENGTH}, {"S3", S3, LENGTH}};
+
+	struct andi_options options;
+	andi_options_init(&options);
+	options.threads = 1;
+
+	for (int low_memory = 0; low_memory < 2; low_memory++) {
+		options.low_memory = low_memory;
+
+		struct collected c = {};
+		int check = andi_compare_all(sequences, 3, &options, collect, &c);
+		g_assert_cmpint(check, ==, 0);
+		g_assert_cmpuint(c.calls, ==, 6);
+
+		double d12 = andi_distance(&c.counts[0][1], &c.counts[1][0],
+								   ANDI_MODEL_RAW);
+		double d13 = andi_distance(&c.counts[0][2], &c.counts[2][0],
+								   ANDI_MODEL_RAW);
+		g_assert_cmpfloat(fabs(d12 - 0.01), <, 0.001);
+		g_assert_cmpfloat(fabs(d13 - 0.02), <, 0.002);
+	}
+
+	struct andi_sequence empty[] = {{"S1", S1, LENGTH}, {"empty", "", 0}};
+	struct collected c = {};
+	g_assert_cmpint(andi_compare_all(empty, 2, &options, collect, &c), !=, 0);
+	g_assert_cmpuint(c.calls, ==, 0);
+}
+
+int main(int argc, char *argv[]) {
+	g_test_init(&argc, &argv, NULL);
+	init_sequences();
+	g_test_add_func("/libandi/index", test_libandi_index);
+	g_test_add_func("/libandi/models", test_libandi_models);
+	g_test_add_func("/libandi/all", test_libandi_all);
+
+	return g_test_run();
+}
@@ -9,6 +9,10 @@ long unsigned int BOOTSTRAP = 0;
 double ANCHOR_P_VALUE = 0.025;
 gsl_rng *RNG = NULL;
 int MODEL = M_JC;
+double PREFILTER_THRESHOLD = 0.005;
+double MIN_COVERAGE = 0.0;
+size_t SAMPLE_WINDOWS = 0;
+size_t SAMPLE_LENGTH = 10000;
 
 double shustring_cum_prob(size_t x, double g, size_t l);
 size_t min_anchor_length(double p, double g, size_t l);
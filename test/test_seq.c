@@ -7,6 +7,10 @@
 double ANCHOR_P_VALUE = 0.025;
 
 int FLAGS = F_NONE;
+int THREADS = 1;
+
+char *revcomp(const char *str, size_t len);
+char *catcomp(char *s, size_t len);
 
 void test_seq_basic(){
 
@@ -76,12 +80,69 @@ void test_seq_nonacgt(){
 
 }
 
+void test_seq_revcomp(){
+	// Cover the vectorized blocks as well as the scalar remainders.
+	const char alphabet[] = "ACGTACGTACGT!";
+	char str[301];
+
+	for (size_t len = 1; len < sizeof(str); len += 7) {
+		for (size_t i = 0; i < len; i++) {
+			str[i] = alphabet[(i * 7 + len) % (sizeof(alphabet) - 1)];
+		}
+		str[len] = '\0';
+
+		char *rev = revcomp(str, len);
+		char *cat = catcomp(str, len);
+
+		g_assert_cmpuint(strlen(rev), ==, len);
+		g_assert_cmpuint(strlen(cat), ==, 2 * len + 1);
+
+		for (size_t i = 0; i < len; i++) {
+			char c = str[len - 1 - i];
+			char d = c == 'A' ? 'T' : c == 'C' ? 'G' : c == 'G' ? 'C' :
+					 c == 'T' ? 'A' : ';';
+			g_assert_cmpint(rev[i], ==, d);
+		}
+
+		g_assert(strncmp(cat, rev, len) == 0);
+		g_assert_cmpint(cat[len], ==, '#');
+		g_assert_cmpstr(cat + len + 1, ==, str);
+
+		free(rev);
+		free(cat);
+	}
+}
+
+void test_seq_duplicates(){
+
+	seq_t S[5];
+	seq_init( &S[0], "ACGTACGT", "a");
+	seq_init( &S[1], "ACGTACGA", "b");
+	seq_init( &S[2], "acgtNNacgt", "a2");
+	seq_init( &S[3], "ACGT", "c");
+	seq_init( &S[4], "ACGTACGA", "b2");
+
+	size_t first[5];
+	g_assert_cmpuint(seq_duplicates(S, 5, first), ==, 3);
+	g_assert_cmpuint(first[0], ==, 0);
+	g_assert_cmpuint(first[1], ==, 1);
+	g_assert_cmpuint(first[2], ==, 0);
+	g_assert_cmpuint(first[3], ==, 3);
+	g_assert_cmpuint(first[4], ==, 1);
+
+	for (size_t i = 0; i < 5; i++) {
+		seq_free( &S[i]);
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	g_test_init( &argc, &argv, NULL);
 	g_test_add_func("/seq/basic", test_seq_basic);
 	g_test_add_func("/seq/full", test_seq_full);
 	g_test_add_func("/seq/non acgt", test_seq_nonacgt);
+	g_test_add_func("/seq/revcomp", test_seq_revcomp);
+	g_test_add_func("/seq/duplicates", test_seq_duplicates);
 
 	return g_test_run();
 }
@@ -0,0 +1,19 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+./test/test_fasta -s $SEED -l 10000 > trace.fasta
+./src/andi trace.fasta > trace_plain.out || exit 1
+
+# Test the trace export; two subjects are indexed and compared
+./src/andi trace.fasta --trace=trace.json > trace.out
+cmp trace_plain.out trace.out || exit 1
+grep -q '"traceEvents"' trace.json || exit 1
+test "$(grep -c '"name": "compare"' trace.json)" -eq 2 || exit 1
+
+rm -f trace.fasta trace_plain.out trace.out trace.json
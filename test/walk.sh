@@ -0,0 +1,17 @@
+#!/bin/sh -f
+
+./src/andi --version > /dev/null || exit 1
+
+SEED=${RANDOM_SEED:-0}
+if test $SEED -ne 0; then
+	SEED=$((SEED + 1))
+fi
+
+./test/test_fasta -s $SEED -l 10000 > walk.fasta
+./src/andi walk.fasta > walk_plain.out || exit 1
+
+# Test the diagonal walk; it may shift the distances a little
+./src/andi walk.fasta --walk > walk.out || exit 1
+paste walk_plain.out walk.out | awk 'NR > 1 {d = $6 - $3; if (d < -0.005 || d > 0.005) exit 1}' || exit 1
+
+rm -f walk.fasta walk_plain.out walk.out